@@ -0,0 +1,70 @@
+// *** AckLatencyBenchmark ***
+
+// This example times how long CmdMessenger takes to wait for an acknowledge while
+// other commands arrive first.
+// It demonstrates how to:
+// - Send a command and wait for its acknowledge
+// - Handle the commands that arrive while waiting: they are dispatched, not dropped
+//
+// Every request is answered by 40 unrelated commands followed by the acknowledge.
+
+#include <CmdMessenger.h>     // CmdMessenger
+#include <CmdMemoryStream.h>  // In-memory stream
+
+const int kWaits          = 1000;  // Acknowledge waits per measurement
+const int kOtherCommands  = 40;    // Commands that arrive before each acknowledge
+
+// Commands of this example
+enum
+{
+  kAcknowledge,
+  kRequest,
+  kReading,
+};
+
+CmdMemoryStreamBuffer<512> replyStream;
+CmdMessenger benchMessenger = CmdMessenger(replyStream);
+
+char reply[kOtherCommands * 12 + 4];  // Answer to every request
+
+long readings = 0;
+
+// Callback function for the commands that arrive before the acknowledge
+void OnReading()
+{
+  benchMessenger.readInt16Arg();
+  benchMessenger.readInt16Arg();
+  readings++;
+}
+
+// Setup function
+void setup()
+{
+  Serial.begin(115200);
+  benchMessenger.attach(kReading, OnReading);
+
+  reply[0] = '\0';
+  for (int i = 0; i < kOtherCommands; i++) strcat(reply, "2,1234,5678;");
+  strcat(reply, "0;");
+
+  // The answer is fed before the request goes out, and feeding it is not timed
+  int acknowledged = 0;
+  unsigned long elapsed = 0;
+  for (int i = 0; i < kWaits; i++) {
+    replyStream.feed(reply);
+    unsigned long start = micros();
+    if (benchMessenger.sendCmd(kRequest, true, kAcknowledge)) acknowledged++;
+    elapsed += micros() - start;
+  }
+  float perWait = (float)elapsed / kWaits;
+
+  Serial.print(F("acknowledges received: ")); Serial.print(acknowledged); Serial.print(F(" of ")); Serial.println(kWaits);
+  Serial.print(F("commands dispatched while waiting: ")); Serial.print(readings); Serial.print(F(" of ")); Serial.println((long)kWaits * kOtherCommands);
+  Serial.print(F("us per wait: ")); Serial.println(perWait);
+  Serial.println(acknowledged == kWaits && readings == (long)kWaits * kOtherCommands ? F("passed") : F("FAILED"));
+}
+
+// Loop function
+void loop()
+{
+}
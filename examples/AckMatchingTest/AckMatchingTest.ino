@@ -0,0 +1,109 @@
+// *** AckMatchingTest ***
+
+// This example tests how received commands are matched to the commands that wait
+// for an acknowledge.
+// It demonstrates how to:
+// - Send a command without blocking, and poll for its acknowledge
+// - Tell acknowledges apart from other commands that come in meanwhile
+//
+// Only the command with the acknowledge ID may complete a waiting command. A command
+// whose ID only shares its low byte with the acknowledge ID must be dispatched as usual.
+// With correlation IDs, only a trailing field of up to 255 is taken as correlation ID:
+// a longer number stays an argument, instead of wrapping around to a small ID.
+
+#include <CmdMessenger.h>     // CmdMessenger
+#include <CmdMemoryStream.h>  // In-memory stream
+
+// Commands
+enum
+{
+  kAcknowledge = 1,   // Acknowledge of kRequest
+  kRequest     = 5,   // Command that waits for an acknowledge
+  kReading     = 7,   // Command with one argument
+  kWide        = 257, // Command whose low byte is that of kAcknowledge
+};
+
+CmdMemoryStreamBuffer<64> linkStream;
+CmdMessenger messenger = CmdMessenger(linkStream);
+
+int acknowledged = 0;  // Acknowledges reported to the callback
+int widesHandled = 0;  // kWide commands dispatched
+char lastReading[16];  // Argument of the last kReading command
+
+// Callback function of the acknowledges
+void OnAcknowledge(byte cmdId, bool received)
+{
+  if (received && cmdId == kRequest) acknowledged++;
+}
+
+// Callback function of the commands without a callback of their own
+void OnUnknownCommand()
+{
+  if (messenger.commandID() == kWide) widesHandled++;
+}
+
+// Callback function of kReading
+void OnReading()
+{
+  char *reading = messenger.readStringArg();
+  if (!messenger.isArgOk()) return;
+  strncpy(lastReading, reading, sizeof(lastReading) - 1);
+  lastReading[sizeof(lastReading) - 1] = '\0';
+}
+
+// Prints a result, and returns if it passed
+bool report(const __FlashStringHelper *name, bool passed)
+{
+  Serial.print(name);
+  Serial.println(passed ? F(": passed") : F(": FAILED"));
+  return passed;
+}
+
+// Sends a request, and returns the handle to poll for its acknowledge
+CmdAckHandle sendRequest()
+{
+  acknowledged = 0;
+  widesHandled = 0;
+  messenger.sendCmdStart(kRequest);
+  return messenger.sendCmdEndAsync(kAcknowledge, 1000, OnAcknowledge);
+}
+
+// Command 257 comes in while acknowledge 1 is waited for
+bool testWideId()
+{
+  CmdAckHandle handle = sendRequest();
+  linkStream.feed("257;");
+  messenger.feedinSerialData();
+  bool passed = widesHandled == 1 && acknowledged == 0 && !handle.isDone();
+  linkStream.feed("1;");
+  messenger.feedinSerialData();
+  return passed && acknowledged == 1 && handle.isDone();
+}
+
+// A trailing field #65537 comes in, which would wrap around to correlation ID 1
+bool testLongCorrelation()
+{
+  messenger.correlateRequests(true);
+  lastReading[0] = '\0';
+  linkStream.feed("7,#65537;");
+  messenger.feedinSerialData();
+  messenger.correlateRequests(false);
+  return strcmp(lastReading, "#65537") == 0;
+}
+
+// Setup function
+void setup()
+{
+  Serial.begin(115200);
+  messenger.attach(OnUnknownCommand);
+  messenger.attach(kReading, OnReading);
+
+  bool passed = report(F("Command 257 while acknowledge 1 is pending"), testWideId());
+  passed &= report(F("Correlation field #65537"), testLongCorrelation());
+  Serial.println(passed ? F("All tests passed") : F("Some tests FAILED"));
+}
+
+// Loop function
+void loop()
+{
+}
@@ -5,20 +5,22 @@
 // - there is no PC counterpart 
 // - it will only receive commands, instead of sending commands it will use Serial.Pring
 //
+// - commands can be typed by name as well as by number
+//
 // Below is an example of interacting with the sample:
 // 
 //   Available commands
-//   0;                  - This command list
-//   1,<led state>;      - Set led. 0 = off, 1 = on
-//   2,<led brightness>; - Set led brighness. 0 - 1000
-//   3;                  - Show led state
+//   list;                           - This command list
+//   led,<led state>;                - Set led. 0 = off, 1 = on
+//   brightness,<led brightness>;    - Set led brighness. 0 - 1000
+//   status;                         - Show led state
 //  
-// Command> 3;
+// Command> status;
 //  
 //  Led status: on
 //  Led brightness: 500
 //  
-// Command> 2,1000;
+// Command> brightness,1000;
 //  
 //   Led status: on
 //   Led brightness: 1000
@@ -54,6 +56,16 @@ enum
   kStatus              , // Command to request led status
 };
 
+// Names of the commands. The names are hashed at compile time, and the table is kept in flash
+const CmdNameEntry commandNames[] PROGMEM =
+{
+  { cmdNameHash("list")      , kCommandList      },
+  { cmdNameHash("led")       , kSetLed           },
+  { cmdNameHash("brightness"), kSetLedBrightness },
+  { cmdNameHash("status")    , kStatus           },
+};
+uint8_t commandNameOrder[sizeof(commandNames) / sizeof(commandNames[0])];
+
 // Callbacks define on which received commands we take action
 void attachCommandCallbacks()
 {
@@ -63,6 +75,8 @@ void attachCommandCallbacks()
   cmdMessenger.attach(kSetLed, OnSetLed);
   cmdMessenger.attach(kSetLedBrightness, OnSetLedBrightness);
   cmdMessenger.attach(kStatus, OnStatus);
+  // Allow commands to be typed by name
+  cmdMessenger.attachNames(commandNames, commandNameOrder);
 }
 
 // Called when a received command has no attached function
@@ -108,11 +122,11 @@ void OnStatus()
 void ShowCommands() 
 {
   Serial.println("Available commands");
-  Serial.println(" 0;                 - This command list");
-  Serial.println(" 1,<led state>;     - Set led. 0 = off, 1 = on");
-  Serial.print  (" 2,<led brightness>; - Set led brighness. 0 - "); 
+  Serial.println(" list;                        - This command list");
+  Serial.println(" led,<led state>;             - Set led. 0 = off, 1 = on");
+  Serial.print  (" brightness,<led brightness>; - Set led brighness. 0 - "); 
   Serial.println(PWMinterval);
-  Serial.println(" 3;                  - Show led state");
+  Serial.println(" status;                      - Show led state");
 }
 
 // Show led state
@@ -0,0 +1,94 @@
+// *** DispatchBenchmark ***
+
+// This example times how long CmdMessenger takes to receive a command and call its
+// callback, for each kind of callback that can be attached.
+// It demonstrates how to:
+// - Attach a plain callback, a captureless lambda, a function with context and a member function
+// - Feed commands to a CmdMessenger from memory, without a serial connection
+//
+// Every kind of callback should take about as long: dispatch is one indirect call.
+
+#include <CmdMessenger.h>     // CmdMessenger
+#include <CmdMemoryStream.h>  // In-memory stream
+
+const int kCommands = 2000;  // Commands received per measurement
+
+CmdMemoryStreamBuffer<64> commandStream;
+CmdMessenger benchMessenger = CmdMessenger(commandStream);
+
+volatile long hits = 0;
+
+// Plain callback function
+void OnPlain()
+{
+  hits++;
+}
+
+// Callback function with context
+void OnContext(CmdMessenger &, void *context)
+{
+  (*(volatile long *)context)++;
+}
+
+// Object whose member function handles the command
+class Counter
+{
+public:
+  void onCommand(CmdMessenger &) { hits++; }
+};
+
+Counter counter;
+
+// Returns the time per command in microseconds. Only the time spent receiving counts, not feeding
+float timeCommands()
+{
+  unsigned long elapsed = 0;
+  for (int fed = 0; fed < kCommands; ) {
+    while (fed < kCommands && commandStream.room() >= 2) {
+      commandStream.feed("5;");
+      fed++;
+    }
+    unsigned long start = micros();
+    benchMessenger.feedinSerialData();
+    elapsed += micros() - start;
+  }
+  return (float)elapsed / kCommands;
+}
+
+// Times the attached callback, and checks that it was called for every command
+void report(const __FlashStringHelper *name)
+{
+  hits = 0;
+  float perCommand = timeCommands();
+  Serial.print(name);       Serial.print(F(", "));
+  Serial.print(perCommand); Serial.print(F(", "));
+  Serial.println(hits == kCommands ? F("ok") : F("MISSED"));
+}
+
+// Setup function
+void setup()
+{
+  Serial.begin(115200);
+
+  Serial.println(F("callback, us per command, result"));
+
+  benchMessenger.attach(5, OnPlain);
+  report(F("plain callback"));
+
+  benchMessenger.attach(5, []() { hits++; });
+  report(F("captureless lambda"));
+
+  benchMessenger.attach(5, OnContext, (void *)&hits);
+  report(F("function with context"));
+
+  benchMessenger.attach(5, CmdDelegate([](CmdMessenger &, void *context) { (*(volatile long *)context)++; }, (void *)&hits));
+  report(F("delegate lambda"));
+
+  benchMessenger.attach(5, CmdDelegate::bind<Counter, &Counter::onCommand>(&counter));
+  report(F("member function"));
+}
+
+// Loop function
+void loop()
+{
+}
@@ -0,0 +1,135 @@
+// *** PortForwardTest ***
+
+// This example tests forwarding from two ports into one target stream.
+// It demonstrates how to:
+// - Serve several streams with one messenger, using ports
+// - Forward a range of command IDs to another stream, using routes
+//
+// Two in-memory ports each send 100 numbered commands that are routed to the same
+// target. The commands come in a few bytes per poll, so the two ports take turns in
+// the middle of their commands. A command may not reach the target until the command
+// of the other port is complete: every command on the target must be whole, and the
+// commands of each port must arrive in order.
+
+#include <CmdMessenger.h>     // CmdMessenger
+#include <CmdPort.h>          // Ports of a messenger
+#include <CmdMemoryStream.h>  // In-memory stream
+
+const int kCommands     = 100;  // Commands sent on each port
+const int kBytesPerPoll = 3;    // Bytes that come in on a port per poll
+
+// Commands
+enum
+{
+  kRouted = 100,  // Command with a port letter and a sequence number, forwarded to the target
+};
+
+// Device on a port, that sends numbered commands a few bytes per poll
+class Source
+{
+public:
+  char letter;    // Letter of the port, sent in each command
+  int sent;       // Commands made so far
+  char frame[16]; // Command being sent
+  int length;
+  int position;   // Position of the next byte of the command
+
+  Source(char letter) : letter(letter), sent(0), length(0), position(0) {}
+
+  // Feeds the next bytes to the port, as far as it has room
+  void feed(CmdMemoryStream &port, int bytes)
+  {
+    for (; bytes > 0 && port.room() > 0; bytes--) {
+      if (position == length) {
+        if (sent == kCommands) return;
+        sprintf(frame, "%d,%c,%d;", kRouted, letter, sent++);
+        length = strlen(frame);
+        position = 0;
+      }
+      port.feed(&frame[position++], 1);
+    }
+  }
+};
+
+// Device on the target, that checks every command it gets
+class Target
+{
+public:
+  char frame[32];  // Command coming in
+  int length;
+  int expected[2]; // Next sequence number per port
+  int whole;       // Commands that arrived whole and in order
+  int broken;      // Commands that were mixed, or out of order
+
+  Target() : length(0), whole(0), broken(0)
+  {
+    expected[0] = 0;
+    expected[1] = 0;
+  }
+
+  // Checks the commands that came in
+  void check(CmdMemoryStream &stream)
+  {
+    while (stream.available() > 0) {
+      char c = stream.read();
+      if (c != ';') {
+        if (length < (int)sizeof(frame) - 1) frame[length++] = c;
+        continue;
+      }
+      frame[length] = '\0';
+      length = 0;
+      int id = -1;
+      char letter = 0;
+      int value = -1;
+      char rest = 0;
+      if (sscanf(frame, "%d,%c,%d%c", &id, &letter, &value, &rest) != 3 || id != kRouted ||
+          (letter != 'A' && letter != 'B')) {
+        broken++;
+        continue;
+      }
+      int port = letter - 'A';
+      if (value == expected[port]) {
+        whole++;
+        expected[port]++;
+      }
+      else broken++;
+    }
+  }
+};
+
+CmdMemoryStreamBuffer<16> portA;
+CmdMemoryStreamBuffer<16> portB;
+CmdMemoryStreamBuffer<16> targetStream;  // Stream the messenger forwards to
+CmdMemoryStreamBuffer<64> targetDevice;  // What the device on the target receives
+Source sourceA('A');
+Source sourceB('B');
+Target target;
+
+CmdMessenger messenger = CmdMessenger(portA);
+CmdPort ports[] = { CmdPort(portA), CmdPort(portB) };
+const CmdRoute routes[] = { { kRouted, kRouted, &targetStream } };
+
+// Setup function
+void setup()
+{
+  Serial.begin(115200);
+  targetStream.connect(&targetDevice);
+  messenger.attachPorts(ports);
+  messenger.attachRoutes(routes);
+
+  for (int poll = 0; poll < 10000 && target.whole + target.broken < 2 * kCommands; poll++) {
+    sourceA.feed(portA, kBytesPerPoll);
+    sourceB.feed(portB, kBytesPerPoll);
+    messenger.feedinSerialData();
+    target.check(targetDevice);
+  }
+
+  Serial.print(F("Whole commands: "));  Serial.print(target.whole); Serial.print(F(" of ")); Serial.println(2 * kCommands);
+  Serial.print(F("Broken commands: ")); Serial.println(target.broken);
+  Serial.println(target.whole == 2 * kCommands && target.broken == 0 ? F("passed") : F("FAILED"));
+}
+
+// Loop function
+void loop()
+{
+}
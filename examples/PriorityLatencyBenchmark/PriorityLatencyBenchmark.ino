@@ -0,0 +1,148 @@
+// *** PriorityLatencyBenchmark ***
+
+// This example times how long an emergency stop waits behind a flood of slow commands.
+// It demonstrates how to:
+// - Give command IDs a priority class
+// - Queue received commands with attachQueue, and dispatch them with dispatchPending
+//
+// Low priority commands arrive at 2 per ms, and each takes 1 ms to handle: more
+// than can be handled. An emergency stop arrives after 200 ms. Without a queue it
+// waits until all commands received before it are handled; with a queue it is
+// handled next.
+
+#include <CmdMessenger.h>      // CmdMessenger
+#include <CmdDispatchQueue.h>  // CmdDispatchQueue
+#include <CmdMemoryStream.h>   // In-memory stream
+
+const unsigned long kStopAt     = 200;   // Arrival of the emergency stop, in ms
+const unsigned long kGiveUpAt   = 5000;  // End of a measurement if the stop never runs, in ms
+const long kLowCommandsPerMs    = 2;     // Arrival rate of the low priority commands
+
+// Commands of this example
+enum
+{
+  kMove = 5,
+  kEmergencyStop = 9,
+};
+
+const char kMoveCommand[]   = "5,123;";
+const char kStopCommand[]   = "9;";
+const long kMoveLength      = sizeof(kMoveCommand) - 1;
+const long kStopLength      = sizeof(kStopCommand) - 1;
+const long kStopPosition    = kStopAt * kLowCommandsPerMs * kMoveLength;  // Where the stop is in the stream
+
+// Move commands as they arrive over time, with the emergency stop among them
+class Arrivals
+{
+public:
+  unsigned long start;  // Time of the start of the measurement, in us
+  long position;        // Number of bytes fed to the stream
+
+  void begin()
+  {
+    start = micros();
+    position = 0;
+  }
+
+  // Number of bytes arrived until now
+  long arrived()
+  {
+    unsigned long elapsed = micros() - start;
+    long bytes = (long)(elapsed * kLowCommandsPerMs / 1000) * kMoveLength;
+    if (elapsed >= kStopAt * 1000) bytes += kStopLength;
+    return bytes;
+  }
+
+  char at(long p)
+  {
+    if (p < kStopPosition) return kMoveCommand[p % kMoveLength];
+    if (p < kStopPosition + kStopLength) return kStopCommand[p - kStopPosition];
+    return kMoveCommand[(p - kStopPosition - kStopLength) % kMoveLength];
+  }
+
+  // Feeds the bytes that arrived since the last call, as far as the stream has room
+  void feed(CmdMemoryStream &stream)
+  {
+    for (long end = arrived(); position < end && stream.room() > 0; position++) {
+      char c = at(position);
+      stream.feed(&c, 1);
+    }
+  }
+};
+
+Arrivals arrivals;
+CmdMemoryStreamBuffer<256> commandStream;
+CmdMessenger benchMessenger = CmdMessenger(commandStream);
+CmdDispatchQueueSlots<8> queue;
+
+unsigned long stoppedAt;  // Time the emergency stop was handled, 0 if not yet
+uint16_t dropped;         // Moves dropped by the queue during the last measurement
+
+// Callback function of a move, which keeps the processor busy for 1 ms
+void OnMove()
+{
+  unsigned long begin = micros();
+  while (micros() - begin < 1000);
+}
+
+// Callback function of the emergency stop
+void OnEmergencyStop()
+{
+  stoppedAt = millis();
+}
+
+// Returns how long the emergency stop waited, in ms
+long measure(bool queued, uint8_t stopPriority)
+{
+  benchMessenger.setPriority(kEmergencyStop, stopPriority);
+  queue.reset();
+  benchMessenger.attachQueue(queued ? &queue : NULL);
+  uint16_t droppedBefore = queue.droppedCount();
+
+  stoppedAt = 0;
+  commandStream.clear();
+  arrivals.begin();
+  unsigned long begin = millis();
+  while (stoppedAt == 0 && millis() - begin < kGiveUpAt) {
+    arrivals.feed(commandStream);
+    benchMessenger.feedinSerialData();
+    benchMessenger.dispatchPending(1);
+  }
+
+  // Handle what was received before the next measurement
+  benchMessenger.feedinSerialData();
+  while (benchMessenger.dispatchPending() > 0);
+  benchMessenger.attachQueue(NULL);
+  dropped = queue.droppedCount() - droppedBefore;
+  return stoppedAt == 0 ? -1 : (long)(stoppedAt - begin - kStopAt);
+}
+
+// Setup function
+void setup()
+{
+  Serial.begin(115200);
+  benchMessenger.attach(kMove, OnMove);
+  benchMessenger.attach(kEmergencyStop, OnEmergencyStop);
+  benchMessenger.setPriority(kMove, kPriorityLow);
+  // Commands arrive faster than they are handled: return from feedinSerialData now and then
+  benchMessenger.setPollTimeLimit(10);
+
+  Serial.println(F("dispatch, emergency stop latency in ms, moves dropped"));
+
+  Serial.print(F("inline, "));
+  Serial.print(measure(false, kPriorityNormal));   Serial.print(F(", "));
+  Serial.println(dropped);
+
+  Serial.print(F("queued, stop high, "));
+  Serial.print(measure(true, kPriorityHigh));      Serial.print(F(", "));
+  Serial.println(dropped);
+
+  Serial.print(F("queued, stop immediate, "));
+  Serial.print(measure(true, kPriorityImmediate)); Serial.print(F(", "));
+  Serial.println(dropped);
+}
+
+// Loop function
+void loop()
+{
+}
@@ -0,0 +1,150 @@
+// *** ReliableLossTest ***
+
+// This example tests reliable delivery over a link that loses commands.
+// It demonstrates how to:
+// - Attach a reliable delivery layer to a messenger
+// - Keep another messenger running from the idle callback, while a send waits for room in the window
+//
+// Two messengers in this sketch talk over in-memory streams that drop 30% of the
+// frames and acknowledges. The sender sends 300 numbered commands through a window
+// of 4; all of them must arrive, in order. Then the sender restarts twice, the
+// second time while the receiver still expects a sequence number inside the window,
+// and the commands sent after the restarts must arrive too.
+// The two messengers need more RAM than an Uno has: use a Mega, a Due or another
+// board with 8 KB or more.
+
+#include <CmdMessenger.h>     // CmdMessenger
+#include <CmdReliable.h>      // Reliable delivery layer
+#include <CmdMemoryStream.h>  // In-memory stream
+
+const int  kCommands            = 300;  // Commands sent through the lossy link
+const int  kLossPercent         = 30;   // Frames lost, in both directions
+const int  kLinkBufferSize      = 256;  // Bytes one direction of the link can hold
+
+// One end of the link. Whole frames are passed on to the other end, or lost
+class LossyStream : public CmdMemoryStreamBuffer<kLinkBufferSize>
+{
+public:
+  LossyStream *peer;                 // Stream that receives what is written to this one
+  char frame[CMDMESSENGER_MESSENGERBUFFERSIZE + 16]; // Frame being written
+  int frameLength;
+  unsigned long seed;
+  int lossPercent;
+
+  LossyStream(unsigned long seed) : peer(NULL), frameLength(0), seed(seed), lossPercent(0) {}
+
+  // Keeps the bytes of a frame until its last one, and passes the frame on if it is not lost
+  size_t write(uint8_t c)
+  {
+    if (frameLength < (int)sizeof(frame)) frame[frameLength++] = c;
+    if (c != ';' || (frameLength > 1 && frame[frameLength - 2] == '/')) return 1;
+    seed = seed * 1103515245UL + 12345UL;
+    if ((int)((seed >> 16) % 100) >= lossPercent) peer->feed(frame, frameLength);
+    frameLength = 0;
+    return 1;
+  }
+  using Print::write;
+};
+
+LossyStream senderStream(1);
+LossyStream receiverStream(2);
+CmdMessenger sender   = CmdMessenger(senderStream);
+CmdMessenger receiver = CmdMessenger(receiverStream);
+CmdReliableWindow<4> senderWindow;
+CmdReliableWindow<4> receiverWindow;
+
+// Commands
+enum
+{
+  kValue, // Command with a sequence number as argument
+};
+
+int expectedValue = 0;   // Value of the next command that must arrive
+int received      = 0;   // Commands that arrived in order
+int misordered    = 0;   // Commands that arrived out of order or twice
+int sendFailures  = 0;   // Commands the window did not take
+
+// Callback function that checks the order of the received commands
+void OnValue()
+{
+  int value = receiver.readInt16Arg();
+  if (value == expectedValue) {
+    received++;
+    expectedValue++;
+  }
+  else {
+    misordered++;
+    expectedValue = value + 1;
+  }
+}
+
+// Keeps the receiver running while the sender waits for room in its window
+void OnSenderIdle()
+{
+  receiver.feedinSerialData();
+}
+
+// Sends values, and waits until the last one is acknowledged
+void sendValues(int first, int count)
+{
+  for (int i = first; i < first + count; i++) {
+    if (!sender.sendCmd(kValue, i)) sendFailures++;
+    sender.feedinSerialData();
+    receiver.feedinSerialData();
+  }
+  unsigned long start = millis();
+  while (senderWindow.unacknowledged() > 0 && millis() - start < 30000) {
+    sender.feedinSerialData();
+    receiver.feedinSerialData();
+  }
+}
+
+// Prints a result, and returns if it passed
+bool report(const __FlashStringHelper *name, bool passed)
+{
+  Serial.print(name);
+  Serial.println(passed ? F(": passed") : F(": FAILED"));
+  return passed;
+}
+
+// Setup function
+void setup()
+{
+  Serial.begin(115200);
+
+  senderStream.peer = &receiverStream;
+  receiverStream.peer = &senderStream;
+  senderStream.lossPercent = kLossPercent;
+  receiverStream.lossPercent = kLossPercent;
+  sender.attachReliable(&senderWindow);
+  receiver.attachReliable(&receiverWindow);
+  sender.attachIdleCallback(OnSenderIdle);
+  receiver.attach(kValue, OnValue);
+
+  unsigned long start = millis();
+  sendValues(0, kCommands);
+  bool passed = report(F("Lossy link"), received == kCommands && misordered == 0 && sendFailures == 0);
+  Serial.print(F("  delivered "));       Serial.print(received);
+  Serial.print(F(" of "));               Serial.print(kCommands);
+  Serial.print(F(" in "));               Serial.print(millis() - start);
+  Serial.print(F(" ms, resent frames ")); Serial.print(senderWindow.retransmitCount());
+  Serial.print(F(", time out "));        Serial.print(sender.retransmitTimeout());
+  Serial.println(F(" ms"));
+
+  // A restart after 2 frames leaves the receiver expecting a sequence number inside the window
+  senderWindow.reset();
+  expectedValue = 0;
+  received = 0;
+  sendValues(0, 2);
+  senderWindow.reset();
+  expectedValue = 0;
+  sendValues(0, 10);
+  passed &= report(F("Sender restarts"), received == 12 && misordered == 0 && sendFailures == 0);
+
+  Serial.println(passed ? F("All tests passed") : F("Some tests FAILED"));
+}
+
+// Loop function
+void loop()
+{
+}
@@ -0,0 +1,110 @@
+// *** TokenizerBenchmark ***
+
+// This example times how long CmdMessenger takes to receive adversarial commands
+// and read all their arguments, as the commands grow up to the command buffer.
+// It demonstrates how to:
+// - Feed commands to a CmdMessenger from memory, without a serial connection
+// - Check that the time per byte does not grow with the length of a command
+//
+// The commands are made of long runs of field separators, escape characters and
+// escaped separators, of one long field, and of many short fields. With a linear
+// tokenizer, the time per byte stays about the same for every length.
+// To try longer commands, raise CMDMESSENGER_MESSENGERBUFFERSIZE (up to 255) in CmdMessenger.h.
+
+#include <CmdMessenger.h>     // CmdMessenger
+#include <CmdMemoryStream.h>  // In-memory stream
+
+const int kFrames               = 200;  // Frames received per measurement
+const int kMaxArguments         = (CMDMESSENGER_MESSENGERBUFFERSIZE - 4) & ~1; // Room for the ID, separators and terminator, in whole pairs
+
+CmdMemoryStreamBuffer<CMDMESSENGER_MESSENGERBUFFERSIZE * 2> frameStream;
+CmdMessenger benchMessenger = CmdMessenger(frameStream);
+
+char frame[CMDMESSENGER_MESSENGERBUFFERSIZE + 4];
+long fieldsRead = 0;
+
+// Adversarial arguments, filled in up to a length
+enum
+{
+  kSeparators,        // ,,,,,,,,
+  kEscapes,           // ////////  (escaped escape characters, one field)
+  kEscapedSeparators, // /,/,/,/,  (one field)
+  kLongField,         // aaaaaaaa
+  kShortFields,       // a,a,a,a,
+  kPatternCount
+};
+
+const char *patternNames[kPatternCount] = { "separators", "escapes", "escaped separators", "long field", "short fields" };
+const char *patterns[kPatternCount]     = { ",,", "//", "/,", "aa", "a," };
+
+// Callback function that reads all arguments of the command
+void OnFrame()
+{
+  while (true) {
+    benchMessenger.readStringArg();
+    if (!benchMessenger.isArgOk()) break;
+    fieldsRead++;
+  }
+}
+
+// Makes a frame of command 0, with arguments of the pattern up to a length
+void makeFrame(int pattern, int length)
+{
+  int i = 0;
+  frame[i++] = '0';
+  frame[i++] = ',';
+  for (int j = 0; j < length; j++) frame[i++] = patterns[pattern][j % 2];
+  frame[i++] = ';';
+  frame[i] = '\0';
+}
+
+// Returns the time per frame in microseconds. Only the time spent receiving counts, not feeding
+float timeFrames(int pattern, int length)
+{
+  makeFrame(pattern, length);
+  int frameLength = strlen(frame);
+  unsigned long elapsed = 0;
+  for (int fed = 0; fed < kFrames; ) {
+    while (fed < kFrames && frameStream.room() >= frameLength) {
+      frameStream.feed(frame, frameLength);
+      fed++;
+    }
+    unsigned long start = micros();
+    benchMessenger.feedinSerialData();
+    elapsed += micros() - start;
+  }
+  return (float)elapsed / kFrames;
+}
+
+// Setup function
+void setup()
+{
+  Serial.begin(115200);
+  benchMessenger.attach(0, OnFrame);
+
+  Serial.println(F("pattern, argument bytes, us per frame, ns per byte"));
+  for (int pattern = 0; pattern < kPatternCount; pattern++) {
+    float shortest = 0;
+    float longest = 0;
+    for (int length = 8; ; length *= 2) {
+      if (length > kMaxArguments) length = kMaxArguments;
+      float perFrame = timeFrames(pattern, length);
+      float perByte = perFrame * 1000 / (length + 3);
+      if (shortest == 0) shortest = perByte;
+      longest = perByte;
+      Serial.print(patternNames[pattern]); Serial.print(F(", "));
+      Serial.print(length);                Serial.print(F(", "));
+      Serial.print(perFrame);              Serial.print(F(", "));
+      Serial.println(perByte);
+      if (length == kMaxArguments) break;
+    }
+    // The shortest frame carries the most overhead per byte: a quadratic tokenizer grows past it
+    Serial.print(patternNames[pattern]);
+    Serial.println(longest <= 2 * shortest ? F(": linear") : F(": NOT linear"));
+  }
+}
+
+// Loop function
+void loop()
+{
+}
@@ -0,0 +1,96 @@
+/*
+  CmdMessenger - library that provides command based messaging
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+  LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+  OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+  WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+  */
+
+#include <CommandMessenger.Transport.Serial/SerialTransport.h>
+
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+
+namespace CommandMessenger
+{
+	/**
+	 * Returns the termios speed of a baud rate, or B0 if it is not supported
+	 */
+	static speed_t baudConstant(int baudRate)
+	{
+		switch (baudRate) {
+		case 1200: return B1200;
+		case 2400: return B2400;
+		case 4800: return B4800;
+		case 9600: return B9600;
+		case 19200: return B19200;
+		case 38400: return B38400;
+		case 57600: return B57600;
+		case 115200: return B115200;
+		case 230400: return B230400;
+#ifdef B460800
+		case 460800: return B460800;
+#endif
+#ifdef B921600
+		case 921600: return B921600;
+#endif
+		default: return B0;
+		}
+	}
+
+	/**
+	 * SerialTransport constructor. The port is opened on connect
+	 */
+	SerialTransport::SerialTransport(const std::string &portName, int baudRate)
+		: portName(portName), baudRate(baudRate)
+	{
+	}
+
+	/**
+	 * Opens and configures the port
+	 */
+	bool SerialTransport::connect()
+	{
+		speed_t speed = baudConstant(baudRate);
+		if (speed == B0) return false;
+		int fd = open(portName.c_str(), O_RDWR | O_NOCTTY | O_CLOEXEC);
+		if (fd < 0) return false;
+
+		termios settings;
+		if (tcgetattr(fd, &settings) != 0) {
+			close(fd);
+			return false;
+		}
+		cfmakeraw(&settings);
+		settings.c_cflag |= CLOCAL | CREAD;
+		settings.c_cflag &= ~(CSTOPB | CRTSCTS);
+		settings.c_cc[VMIN] = 1;
+		settings.c_cc[VTIME] = 0;
+		cfsetispeed(&settings, speed);
+		cfsetospeed(&settings, speed);
+		if (tcsetattr(fd, TCSANOW, &settings) != 0) {
+			close(fd);
+			return false;
+		}
+		tcflush(fd, TCIOFLUSH);
+		setFileDescriptor(fd);
+		return FdTransport::connect();
+	}
+}
@@ -0,0 +1,49 @@
+/*
+  CmdMessenger - library that provides command based messaging
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+  LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+  OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+  WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+  */
+
+#pragma once
+
+#include <CommandMessenger/Transport/FdTransport.h>
+
+#include <string>
+
+namespace CommandMessenger
+{
+	/**
+	 * Transport over a serial port, in raw mode with 8 data bits, no parity and one stop bit.
+	 *  The port stays open after disconnect, while a reader thread may still poll it, and
+	 *  is closed when it is opened again or the transport is destroyed
+	 */
+	class SerialTransport : public FdTransport
+	{
+	private:
+		std::string portName;           // Device of the port, like /dev/ttyACM0
+		int baudRate;                   // Baud rate of the port
+
+	public:
+		SerialTransport(const std::string &portName, int baudRate = 115200);
+
+		bool connect() override;
+	};
+}
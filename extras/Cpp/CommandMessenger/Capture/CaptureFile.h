@@ -0,0 +1,67 @@
+/*
+  CmdMessenger - library that provides command based messaging
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+  LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+  OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+  WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+  */
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace CommandMessenger
+{
+	/**
+	 * Capture file format.
+	 *
+	 * A file starts with a header: the magic "CMCAP", a version byte, and the wall
+	 * clock time the capture started, in microseconds since the epoch, as 8 bytes
+	 * little endian. Records follow, appended as the bytes pass: a direction byte,
+	 * the time since the record before in microseconds (since the start for the
+	 * first one), and the number of bytes, both as LEB128 varints, then the bytes.
+	 * A capture cut off by a crash reads up to its last whole record.
+	 */
+	namespace CaptureFormat
+	{
+		static const char Magic[5] = { 'C', 'M', 'C', 'A', 'P' };
+		static const uint8_t Version = 1;
+		static const std::size_t HeaderSize = sizeof(Magic) + 1 + 8;
+		static const std::size_t MaxRecordHeader = 1 + 10 + 10; // Direction and two 64 bit varints
+	}
+
+	enum class CaptureDirection : uint8_t
+	{
+		Received = 0,                   // From the device to the host
+		Sent = 1                        // From the host to the device
+	};
+
+	/**
+	 * Record of a capture. data points into the mapped capture file
+	 */
+	struct CaptureRecord
+	{
+		CaptureDirection direction;
+		std::chrono::microseconds time; // Time since the capture started
+		const char *data;
+		std::size_t size;
+	};
+}
@@ -0,0 +1,134 @@
+/*
+  CmdMessenger - library that provides command based messaging
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+  LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+  OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+  WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+  */
+
+#include <CommandMessenger/Capture/CaptureReader.h>
+
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace CommandMessenger
+{
+	/**
+	 * Reads a LEB128 varint at position. Returns false if the data ends inside it
+	 */
+	static bool readVarint(const char *data, std::size_t size, std::size_t &position, uint64_t &value)
+	{
+		value = 0;
+		for (int shift = 0; shift < 64 && position < size; shift += 7) {
+			uint8_t byte = (uint8_t)data[position++];
+			value |= (uint64_t)(byte & 0x7F) << shift;
+			if ((byte & 0x80) == 0) return true;
+		}
+		return false;
+	}
+
+	/**
+	 * Unmaps the file
+	 */
+	CaptureReader::~CaptureReader()
+	{
+		close();
+	}
+
+	/**
+	 * Maps a capture file and checks its header
+	 */
+	bool CaptureReader::open(const std::string &path)
+	{
+		close();
+		int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+		if (fd < 0) return false;
+		struct stat status;
+		if (fstat(fd, &status) != 0 || (std::size_t)status.st_size < CaptureFormat::HeaderSize) {
+			::close(fd);
+			return false;
+		}
+		void *mapping = mmap(nullptr, (std::size_t)status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		// The mapping keeps the file, the descriptor is not needed anymore
+		::close(fd);
+		if (mapping == MAP_FAILED) return false;
+		madvise(mapping, (std::size_t)status.st_size, MADV_SEQUENTIAL);
+		data = (const char *)mapping;
+		size = (std::size_t)status.st_size;
+
+		if (std::memcmp(data, CaptureFormat::Magic, sizeof(CaptureFormat::Magic)) != 0 ||
+			(uint8_t)data[sizeof(CaptureFormat::Magic)] != CaptureFormat::Version) {
+			close();
+			return false;
+		}
+		uint64_t wallTime = 0;
+		for (int i = 0; i < 8; i++) wallTime |= (uint64_t)(uint8_t)data[sizeof(CaptureFormat::Magic) + 1 + i] << (8 * i);
+		startTime = std::chrono::system_clock::time_point(std::chrono::microseconds(wallTime));
+		rewind();
+		return true;
+	}
+
+	/**
+	 * Unmaps the file
+	 */
+	void CaptureReader::close()
+	{
+		if (data != nullptr) munmap((void *)data, size);
+		data = nullptr;
+		size = 0;
+	}
+
+	/**
+	 * Reads the next record. Returns false at the end of the capture, or at a record
+	 *  the file ends in, see truncated
+	 */
+	bool CaptureReader::next(CaptureRecord &record)
+	{
+		if (data == nullptr || position >= size) return false;
+		std::size_t at = position;
+		uint8_t direction = (uint8_t)data[at++];
+		uint64_t delta, length;
+		if (direction > (uint8_t)CaptureDirection::Sent || !readVarint(data, size, at, delta) ||
+			!readVarint(data, size, at, length) || length > size - at) {
+			cutOff = true;
+			return false;
+		}
+		time += std::chrono::microseconds(delta);
+		record.direction = (CaptureDirection)direction;
+		record.time = time;
+		record.data = data + at;
+		record.size = (std::size_t)length;
+		position = at + (std::size_t)length;
+		return true;
+	}
+
+	/**
+	 * Goes back to the first record
+	 */
+	void CaptureReader::rewind()
+	{
+		position = CaptureFormat::HeaderSize;
+		time = std::chrono::microseconds(0);
+		cutOff = false;
+	}
+}
@@ -0,0 +1,65 @@
+/*
+  CmdMessenger - library that provides command based messaging
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+  LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+  OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+  WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+  */
+
+#pragma once
+
+#include <CommandMessenger/Capture/CaptureFile.h>
+
+#include <chrono>
+#include <cstddef>
+#include <string>
+
+namespace CommandMessenger
+{
+	/**
+	 * Reads a capture file in place: the file is mapped into memory, and records
+	 *  point into the mapping, so reading does not copy the bytes
+	 */
+	class CaptureReader
+	{
+	private:
+		const char *data = nullptr;     // Mapped file
+		std::size_t size = 0;
+		std::size_t position = 0;       // Offset of the next record
+		std::chrono::microseconds time{ 0 }; // Time of the last record read
+		std::chrono::system_clock::time_point startTime; // Wall clock time the capture started
+		bool cutOff = false;            // Indicates if the file ended inside a record
+
+	public:
+		CaptureReader() = default;
+		~CaptureReader();
+
+		CaptureReader(const CaptureReader &) = delete;
+		CaptureReader &operator=(const CaptureReader &) = delete;
+
+		bool open(const std::string &path);
+		void close();
+		bool isOpen() const { return data != nullptr; }
+
+		bool next(CaptureRecord &record);
+		void rewind();
+		bool truncated() const { return cutOff; }
+		std::chrono::system_clock::time_point started() const { return startTime; }
+	};
+}
@@ -0,0 +1,140 @@
+/*
+  CmdMessenger - library that provides command based messaging
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+  LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+  OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+  WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+  */
+
+#include <CommandMessenger/Capture/CaptureWriter.h>
+
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace CommandMessenger
+{
+	static const std::size_t WriteSize = 64 * 1024; // Buffered bytes written to the file at once
+
+	/**
+	 * Appends a value as a LEB128 varint
+	 */
+	static void appendVarint(std::string &buffer, uint64_t value)
+	{
+		while (value >= 0x80) {
+			buffer += (char)(value | 0x80);
+			value >>= 7;
+		}
+		buffer += (char)value;
+	}
+
+	/**
+	 * Writes the records still buffered, and closes the file
+	 */
+	CaptureWriter::~CaptureWriter()
+	{
+		close();
+	}
+
+	/**
+	 * Creates the capture file, replacing one that is there, and writes its header
+	 */
+	bool CaptureWriter::open(const std::string &path)
+	{
+		close();
+		int newFd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+		if (newFd < 0) return false;
+
+		std::lock_guard<std::mutex> lock(mutex);
+		uint64_t wallTime = (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::system_clock::now().time_since_epoch()).count();
+		buffer.assign(CaptureFormat::Magic, sizeof(CaptureFormat::Magic));
+		buffer += (char)CaptureFormat::Version;
+		for (int i = 0; i < 8; i++) buffer += (char)(wallTime >> (8 * i));
+		start = std::chrono::steady_clock::now();
+		lastTime = 0;
+		failed = false;
+		fd = newFd;
+		return writeBuffer();
+	}
+
+	/**
+	 * Writes the records still buffered and closes the file. Returns false if any
+	 *  of the capture could not be written
+	 */
+	bool CaptureWriter::close()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (fd < 0) return false;
+		bool written = writeBuffer();
+		::close(fd);
+		fd = -1;
+		return written;
+	}
+
+	/**
+	 * Records bytes that passed in a direction, now
+	 */
+	void CaptureWriter::record(CaptureDirection direction, const char *data, std::size_t size)
+	{
+		if (size == 0) return;
+		std::lock_guard<std::mutex> lock(mutex);
+		if (fd < 0) return;
+		// Taken under the lock, so that record times do not go back
+		uint64_t time = (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now() - start).count();
+		buffer += (char)direction;
+		appendVarint(buffer, time - lastTime);
+		appendVarint(buffer, size);
+		buffer.append(data, size);
+		lastTime = time;
+		if (buffer.size() >= WriteSize) writeBuffer();
+	}
+
+	/**
+	 * Writes the buffered records to the file
+	 */
+	bool CaptureWriter::flush()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return fd >= 0 && writeBuffer();
+	}
+
+	/**
+	 * Writes the buffer to the file. Called with the lock held. After a failed write
+	 *  the capture stops growing, so that it keeps whole records only
+	 */
+	bool CaptureWriter::writeBuffer()
+	{
+		const char *data = buffer.data();
+		std::size_t size = buffer.size();
+		while (size > 0 && !failed) {
+			ssize_t length = ::write(fd, data, size);
+			if (length < 0) {
+				if (errno == EINTR) continue;
+				failed = true;
+				break;
+			}
+			data += length;
+			size -= (std::size_t)length;
+		}
+		buffer.clear();
+		return !failed;
+	}
+}
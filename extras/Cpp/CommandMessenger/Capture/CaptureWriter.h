@@ -0,0 +1,68 @@
+/*
+  CmdMessenger - library that provides command based messaging
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+  LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+  OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+  WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+  */
+
+#pragma once
+
+#include <CommandMessenger/Capture/CaptureFile.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+namespace CommandMessenger
+{
+	/**
+	 * Writes a capture file of the bytes a messenger receives and sends, see
+	 *  CmdMessenger::capture. Records are buffered and appended in blocks; record
+	 *  may be called from any thread
+	 */
+	class CaptureWriter
+	{
+	private:
+		int fd = -1;                    // Capture file, -1 if not open
+		std::mutex mutex;               // Guards buffer and the record times
+		std::string buffer;             // Records not yet written to the file
+		std::chrono::steady_clock::time_point start; // Time the capture started
+		uint64_t lastTime = 0;          // Time of the last record, in microseconds since start
+		bool failed = false;            // Indicates if writing the file failed
+
+		bool writeBuffer();
+
+	public:
+		CaptureWriter() = default;
+		~CaptureWriter();
+
+		CaptureWriter(const CaptureWriter &) = delete;
+		CaptureWriter &operator=(const CaptureWriter &) = delete;
+
+		bool open(const std::string &path);
+		bool close();
+		bool isOpen() const { return fd >= 0; }
+
+		void record(CaptureDirection direction, const char *data, std::size_t size);
+		bool flush();
+	};
+}
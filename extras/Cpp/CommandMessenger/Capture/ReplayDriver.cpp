@@ -0,0 +1,65 @@
+/*
+  CmdMessenger - library that provides command based messaging
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+  LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+  OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+  WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+  */
+
+#include <CommandMessenger/Capture/ReplayDriver.h>
+#include <CommandMessenger/CmdMessenger.h>
+
+#include <thread>
+
+namespace CommandMessenger
+{
+	/**
+	 * With the original timing, waits until the time of the record since the start
+	 */
+	void ReplayDriver::waitUntil(const CaptureRecord &record, std::chrono::steady_clock::time_point start) const
+	{
+		if (timing == Timing::Original) std::this_thread::sleep_until(start + record.time);
+	}
+
+	/**
+	 * Feeds the received bytes to a messenger, as its reader thread would: the
+	 *  handlers are called on its worker pool. The messenger must not be connected.
+	 *  Returns the number of bytes fed
+	 */
+	std::size_t ReplayDriver::replay(CmdMessenger &messenger)
+	{
+		if (messenger.reading || messenger.loop != nullptr) return 0;
+		std::size_t replayed = 0;
+		CaptureRecord record;
+		capture.rewind();
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		while (capture.next(record)) {
+			if (record.direction != CaptureDirection::Received) continue;
+			waitUntil(record, start);
+			messenger.receiveBytes(record.data, record.size);
+			while (!messenger.flushBacklog()) {
+				messenger.scheduleReceived();
+				std::this_thread::yield();
+			}
+			messenger.scheduleReceived();
+			replayed += record.size;
+		}
+		return replayed;
+	}
+}
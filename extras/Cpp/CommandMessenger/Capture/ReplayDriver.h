@@ -0,0 +1,85 @@
+/*
+  CmdMessenger - library that provides command based messaging
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+  LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+  OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+  WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+  */
+
+#pragma once
+
+#include <CommandMessenger/Capture/CaptureReader.h>
+#include <CommandMessenger/CommandParser.h>
+
+#include <chrono>
+#include <cstddef>
+#include <utility>
+
+namespace CommandMessenger
+{
+	class CmdMessenger;
+
+	/**
+	 * Feeds the received bytes of a capture to a messenger or a parser again, at
+	 *  full speed or at the timing they came in with. The sent bytes are skipped
+	 */
+	class ReplayDriver
+	{
+	public:
+		enum class Timing
+		{
+			FullSpeed,                  // Feed the records one after the other
+			Original                    // Feed each record at its time since the start
+		};
+
+	private:
+		CaptureReader &capture;
+		Timing timing;
+
+		void waitUntil(const CaptureRecord &record, std::chrono::steady_clock::time_point start) const;
+
+	public:
+		explicit ReplayDriver(CaptureReader &capture, Timing timing = Timing::FullSpeed)
+			: capture(capture), timing(timing)
+		{
+		}
+
+		std::size_t replay(CmdMessenger &messenger);
+
+		/**
+		 * Feeds the received bytes to a parser, and returns their number. onLine is
+		 *  called like by CommandParser::feed
+		 */
+		template<class F>
+		std::size_t replay(CommandParser &parser, F &&onLine)
+		{
+			std::size_t replayed = 0;
+			CaptureRecord record;
+			capture.rewind();
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			while (capture.next(record)) {
+				if (record.direction != CaptureDirection::Received) continue;
+				waitUntil(record, start);
+				parser.feed(record.data, record.size, onLine);
+				replayed += record.size;
+			}
+			return replayed;
+		}
+	};
+}
@@ -0,0 +1,330 @@
+/*
+  CmdMessenger - library that provides command based messaging
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+  LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+  OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+  WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+  */
+
+#include <CommandMessenger/CmdMessenger.h>
+#include <CommandMessenger/Capture/CaptureWriter.h>
+#include <CommandMessenger/EventLoop.h>
+
+namespace CommandMessenger
+{
+	static const std::size_t ReadSize = 4096;     // Bytes read from the transport at once
+	static const int DispatchBatch = 64;          // Commands handled before other messengers get a turn
+
+	/**
+	 * CmdMessenger constructor. queueSize is the number of received commands that
+	 *  may wait for a worker; when they are all waiting, the reader stops reading
+	 */
+	CmdMessenger::CmdMessenger(ITransport &transport, WorkerPool &pool, const Escaping &escaping,
+		std::size_t queueSize)
+		: transport(transport), pool(pool), escapeChars(escaping), parser(escaping), received(queueSize)
+	{
+	}
+
+	/**
+	 * Disconnects, and waits until a worker is done with the received commands
+	 */
+	CmdMessenger::~CmdMessenger()
+	{
+		disconnect();
+		while (scheduled || processing != 0) std::this_thread::yield();
+	}
+
+	/**
+	 * Connects the transport and starts the reader thread
+	 */
+	bool CmdMessenger::connect()
+	{
+		if (reading || loop != nullptr) return true;
+		// The reader thread ended on its own when the device went away
+		if (reader.joinable()) reader.join();
+		if (!transport.connect()) return false;
+		parser.reset();
+		reading = true;
+		reader = std::thread(&CmdMessenger::readLoop, this);
+		return true;
+	}
+
+	/**
+	 * Connects the transport and lets the event loop read from it, instead of a reader
+	 *  thread. The transport must have a file descriptor
+	 */
+	bool CmdMessenger::connect(EventLoop &eventLoop)
+	{
+		if (reading || loop != nullptr) return true;
+		if (reader.joinable()) reader.join();
+		if (!transport.connect()) return false;
+		parser.reset();
+		if (transport.fileDescriptor() < 0 || !eventLoop.add(this)) {
+			transport.disconnect();
+			return false;
+		}
+		return true;
+	}
+
+	/**
+	 * Disconnects the transport, and stops the reader thread or leaves the event loop
+	 */
+	bool CmdMessenger::disconnect()
+	{
+		EventLoop *eventLoop = loop;
+		if (eventLoop != nullptr) eventLoop->remove(this);
+		bool wasConnected = transport.disconnect();
+		reading = false;
+		if (reader.joinable() && reader.get_id() != std::this_thread::get_id()) reader.join();
+		return wasConnected;
+	}
+
+	/**
+	 * Returns if the transport is connected
+	 */
+	bool CmdMessenger::isConnected() const
+	{
+		return transport.isConnected();
+	}
+
+	/**
+	 * Enables printing newline after a sent command
+	 */
+	void CmdMessenger::printLfCr(bool addNewLine)
+	{
+		printNewlines = addNewLine;
+	}
+
+	/**
+	 * Attaches a default callback for commands without a handler
+	 */
+	void CmdMessenger::attach(MessengerCallbackFunction newFunction)
+	{
+		defaultCallback = std::move(newFunction);
+	}
+
+	/**
+	 * Attaches a callback to a command ID
+	 */
+	void CmdMessenger::attach(int messageId, MessengerCallbackFunction newFunction)
+	{
+		if (messageId < 0) return;
+		if ((std::size_t)messageId >= callbackList.size()) callbackList.resize(messageId + 1);
+		callbackList[messageId] = std::move(newFunction);
+	}
+
+	/**
+	 * Records the bytes received and sent from now on in a capture, or stops
+	 *  recording with nullptr. The writer must outlive the recording
+	 */
+	void CmdMessenger::capture(CaptureWriter *writer)
+	{
+		captureWriter = writer;
+	}
+
+	/**
+	 * Sends a command. With reqAc, blocks until the acknowledge comes in or the time
+	 *  out expires, and returns the acknowledge; it is not ok() when it did not come in
+	 */
+	ReceivedCommand CmdMessenger::sendCommand(const SendCommand &command)
+	{
+		std::string frame = command.commandString(escapeChars, printNewlines);
+		if (!command.reqAc) {
+			std::lock_guard<std::mutex> lock(writeMutex);
+			write(frame);
+			return ReceivedCommand();
+		}
+
+		// Register before sending, the acknowledge may come in before write returns
+		std::list<AckWaiter>::iterator waiter;
+		{
+			std::lock_guard<std::mutex> lock(ackMutex);
+			waiter = ackWaiters.insert(ackWaiters.end(), AckWaiter{ command.ackCmdId, {} });
+			ackWaiterCount++;
+		}
+		std::future<ReceivedCommand> acknowledge = waiter->promise.get_future();
+		bool written;
+		{
+			std::lock_guard<std::mutex> lock(writeMutex);
+			written = write(frame);
+		}
+		bool arrived = written && acknowledge.wait_for(command.timeout) == std::future_status::ready;
+		{
+			std::lock_guard<std::mutex> lock(ackMutex);
+			// The reader thread removes the waiter when it fulfils the promise
+			if (!arrived && acknowledge.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+				ackWaiters.erase(waiter);
+				ackWaiterCount--;
+				return ReceivedCommand();
+			}
+		}
+		return acknowledge.get();
+	}
+
+	/**
+	 * Writes a command, or hands it to the event loop that writes for the messenger
+	 */
+	bool CmdMessenger::write(const std::string &frame)
+	{
+		CaptureWriter *writer = captureWriter;
+		if (writer != nullptr) writer->record(CaptureDirection::Sent, frame.data(), frame.size());
+		EventLoop *eventLoop = loop;
+		if (eventLoop != nullptr && eventLoop->queueWrite(this, frame)) return true;
+		return transport.write(frame.data(), frame.size());
+	}
+
+	/**
+	 * Sends commands that are put together already
+	 */
+	bool CmdMessenger::sendString(const std::string &commands)
+	{
+		std::lock_guard<std::mutex> lock(writeMutex);
+		return write(commands);
+	}
+
+	/**
+	 * Reader thread: reads from the transport and cuts the bytes into commands
+	 */
+	void CmdMessenger::readLoop()
+	{
+		char buffer[ReadSize];
+		while (reading) {
+			std::size_t length = transport.read(buffer, sizeof(buffer));
+			if (length == 0) break;
+			receiveBytes(buffer, length);
+			// A reader thread of its own can wait for the workers to make room
+			while (!flushBacklog() && reading) {
+				scheduleReceived();
+				std::this_thread::yield();
+			}
+			scheduleReceived();
+		}
+		reading = false;
+	}
+
+	/**
+	 * Cuts received bytes into commands and queues them. Called by the reader thread,
+	 *  or the event loop, which schedules the messenger once for all the bytes it read
+	 */
+	void CmdMessenger::receiveBytes(const char *data, std::size_t size)
+	{
+		CaptureWriter *writer = captureWriter;
+		if (writer != nullptr) writer->record(CaptureDirection::Received, data, size);
+		parser.feed(data, size, [this](const char *line, std::size_t length) { processLine(line, length); });
+	}
+
+	/**
+	 * Makes a command of a received line, and queues it. The line may lie in a read
+	 *  buffer that is reused after the call: the command gets its own copy of the fields
+	 */
+	void CmdMessenger::processLine(const char *line, std::size_t size)
+	{
+		std::size_t start = escapeChars.lineStart(line, size);
+		if (start == size) return;
+		line += start;
+		size -= start;
+		ReceivedCommand command(escapeChars.split(line, size), escapeChars);
+		command.rawString.assign(line, size);
+		command.timeStamp = std::chrono::steady_clock::now();
+		if (handOverAck(command)) return;
+
+		// Keep the order: once commands wait in the backlog, new ones go behind them
+		if (!backlog.empty() || !received.tryPush(std::move(command)))
+			backlog.push_back(std::move(command));
+	}
+
+	/**
+	 * Moves commands from the backlog to the queue. Returns true when the backlog is empty
+	 */
+	bool CmdMessenger::flushBacklog()
+	{
+		while (!backlog.empty()) {
+			if (!received.tryPush(std::move(backlog.front()))) return false;
+			backlog.pop_front();
+		}
+		return true;
+	}
+
+	/**
+	 * Hands the messenger to the worker pool if commands are queued and it is not there yet
+	 */
+	void CmdMessenger::scheduleReceived()
+	{
+		if (!received.empty() && !scheduled.exchange(true)) pool.schedule(this);
+	}
+
+	/**
+	 * Passes the command to a sendCommand that waits for it. Returns false if none does
+	 */
+	bool CmdMessenger::handOverAck(ReceivedCommand &command)
+	{
+		if (ackWaiterCount.load(std::memory_order_acquire) == 0) return false;
+		std::lock_guard<std::mutex> lock(ackMutex);
+		for (std::list<AckWaiter>::iterator waiter = ackWaiters.begin(); waiter != ackWaiters.end(); ++waiter) {
+			if (waiter->ackCmdId != command.cmdId) continue;
+			waiter->promise.set_value(std::move(command));
+			ackWaiters.erase(waiter);
+			ackWaiterCount--;
+			return true;
+		}
+		return false;
+	}
+
+	/**
+	 * Worker: handles the received commands in order, up to a batch, then gives the
+	 *  worker to the next messenger
+	 */
+	void CmdMessenger::processReceived()
+	{
+		// Counted before scheduled is cleared, so that the destructor waits for the last check.
+		// The worker before may still be leaving, after it saw the command that rescheduled us
+		processing++;
+		ReceivedCommand command;
+		for (int handled = 0; handled < DispatchBatch; handled++) {
+			if (!received.tryPop(command)) {
+				// Pairs with the fence in EventLoop::holdBack: either it sees the room, or we see it wait
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+				if (waitingForRoom.load(std::memory_order_relaxed) && waitingForRoom.exchange(false)) {
+					EventLoop *eventLoop = loop;
+					if (eventLoop != nullptr) eventLoop->wake();
+				}
+				scheduled = false;
+				// A command pushed after the pop failed, but before the flag was cleared
+				if (received.empty() || scheduled.exchange(true)) {
+					processing--;
+					return;
+				}
+			}
+			else handleMessage(command);
+		}
+		processing--;
+		pool.schedule(this);
+	}
+
+	/**
+	 * Calls the handler of a command, or the default callback
+	 */
+	void CmdMessenger::handleMessage(ReceivedCommand &command)
+	{
+		if (command.ok() && (std::size_t)command.cmdId < callbackList.size() && callbackList[command.cmdId])
+			callbackList[command.cmdId](command);
+		else if (defaultCallback)
+			defaultCallback(command);
+	}
+}
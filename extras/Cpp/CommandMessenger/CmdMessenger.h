@@ -0,0 +1,137 @@
+/*
+  CmdMessenger - library that provides command based messaging
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+  LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+  OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+  WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+  */
+
+#pragma once
+
+#include <CommandMessenger/Command.h>
+#include <CommandMessenger/CommandParser.h>
+#include <CommandMessenger/Escaping.h>
+#include <CommandMessenger/WorkerPool.h>
+#include <CommandMessenger/Queue/SpscQueue.h>
+#include <CommandMessenger/Transport/ITransport.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <list>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace CommandMessenger
+{
+	class CaptureWriter;
+	class EventLoop;
+
+	/**
+	 * Messenger of one device, the host side counterpart of the Arduino library.
+	 *
+	 * A reader thread per messenger blocks on the transport, cuts the incoming bytes
+	 * into commands and passes them to the worker pool through a lock-free queue.
+	 * Workers call the attached handlers, in order of arrival per device. Acknowledges
+	 * that a sendCommand waits for are handed over by the reader thread directly, so
+	 * a handler may send a command and wait for its acknowledge.
+	 * Instead of a reader thread, an EventLoop can read for many messengers, see
+	 * connect(EventLoop &).
+	 * Attach handlers before connect: the handler table is not locked.
+	 */
+	class CmdMessenger
+	{
+	public:
+		// callback functions follow the signature: void cmd(ReceivedCommand &command);
+		typedef std::function<void(ReceivedCommand &)> MessengerCallbackFunction;
+
+		CmdMessenger(ITransport &transport, WorkerPool &pool, const Escaping &escaping = Escaping(),
+			std::size_t queueSize = 256);
+		~CmdMessenger();
+
+		CmdMessenger(const CmdMessenger &) = delete;
+		CmdMessenger &operator=(const CmdMessenger &) = delete;
+
+		bool connect();
+		bool connect(EventLoop &eventLoop);
+		bool disconnect();
+		bool isConnected() const;
+
+		void printLfCr(bool addNewLine = true);
+		void attach(MessengerCallbackFunction newFunction);
+		void attach(int messageId, MessengerCallbackFunction newFunction);
+
+		ReceivedCommand sendCommand(const SendCommand &command);
+		const Escaping &escaping() const { return escapeChars; }
+		void capture(CaptureWriter *writer);
+
+	private:
+		struct AckWaiter
+		{
+			int ackCmdId;               // ID of the expected acknowledge command
+			std::promise<ReceivedCommand> promise; // Fulfilled by the reader thread
+		};
+
+		ITransport &transport;
+		WorkerPool &pool;
+		Escaping escapeChars;           // Separators and escape character
+		bool printNewlines = false;     // Indicates if \r\n is added after a sent command
+
+		MessengerCallbackFunction defaultCallback;
+		std::vector<MessengerCallbackFunction> callbackList; // Handlers by command ID
+
+		std::thread reader;             // Reads from the transport
+		std::atomic<bool> reading{ false }; // Indicates if the reader thread runs
+		std::atomic<EventLoop *> loop{ nullptr }; // Event loop that reads instead of a reader thread
+		uint32_t loopSlot = 0;          // Registration with the event loop
+		CommandParser parser;           // Cuts received bytes into commands
+		SpscQueue<ReceivedCommand> received; // Commands from the reader to a worker
+		std::deque<ReceivedCommand> backlog; // Received commands that did not fit in the queue yet
+		std::atomic<bool> waitingForRoom{ false }; // Indicates if the event loop waits for the queue to empty
+		std::atomic<bool> scheduled{ false }; // Indicates if the messenger is with the worker pool
+		std::atomic<int> processing{ 0 }; // Number of workers in processReceived
+
+		std::mutex writeMutex;          // Keeps sent commands whole and in order
+		std::mutex ackMutex;            // Guards ackWaiters
+		std::list<AckWaiter> ackWaiters; // sendCommand calls that wait for an acknowledge
+		std::atomic<int> ackWaiterCount{ 0 };
+		std::atomic<CaptureWriter *> captureWriter{ nullptr }; // Records the received and sent bytes
+
+		bool write(const std::string &frame);
+		bool sendString(const std::string &commands);
+		void readLoop();
+		void receiveBytes(const char *data, std::size_t size);
+		void processLine(const char *line, std::size_t size);
+		bool flushBacklog();
+		void scheduleReceived();
+		bool handOverAck(ReceivedCommand &command);
+		void processReceived();
+		void handleMessage(ReceivedCommand &command);
+
+		friend class WorkerPool;
+		friend class EventLoop;
+		friend class SendCommandQueue;
+		friend class ReplayDriver;
+	};
+}
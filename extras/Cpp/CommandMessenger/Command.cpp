@@ -0,0 +1,248 @@
+/*
+  CmdMessenger - library that provides command based messaging
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+  LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+  OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+  WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+  */
+
+#include <CommandMessenger/Command.h>
+
+#include <charconv>
+#include <cstdio>
+
+namespace CommandMessenger
+{
+	// **** SendCommand ****
+
+	/**
+	 * Command that is sent without waiting for an acknowledge
+	 */
+	SendCommand::SendCommand(int cmdId)
+	{
+		this->cmdId = cmdId;
+	}
+
+	/**
+	 * Command that waits for the acknowledge command ackCmdId, up to the time out
+	 */
+	SendCommand::SendCommand(int cmdId, int ackCmdId, std::chrono::milliseconds timeout)
+	{
+		this->cmdId = cmdId;
+		this->ackCmdId = ackCmdId;
+		this->timeout = timeout;
+		reqAc = true;
+	}
+
+	/**
+	 * Adds a text argument, escaped
+	 */
+	void SendCommand::addArgument(const std::string &argument, const Escaping &escaping)
+	{
+		arguments.push_back(escaping.escape(argument));
+	}
+
+	/**
+	 * Adds a text argument, escaped
+	 */
+	void SendCommand::addArgument(const char *argument, const Escaping &escaping)
+	{
+		addArgument(std::string(argument), escaping);
+	}
+
+	/**
+	 * Adds a boolean argument as 1 or 0
+	 */
+	void SendCommand::addArgument(bool argument)
+	{
+		arguments.push_back(argument ? "1" : "0");
+	}
+
+	/**
+	 * Adds a float argument as text, with the precision of a float
+	 */
+	void SendCommand::addArgument(float argument)
+	{
+		char text[32];
+		std::snprintf(text, sizeof(text), "%.7g", argument);
+		arguments.push_back(text);
+	}
+
+	/**
+	 * Adds a double argument as text, with the precision of a double
+	 */
+	void SendCommand::addArgument(double argument)
+	{
+		char text[32];
+		std::snprintf(text, sizeof(text), "%.15g", argument);
+		arguments.push_back(text);
+	}
+
+	/**
+	 * Returns the command as it is sent: id,arg,arg;
+	 */
+	std::string SendCommand::commandString(const Escaping &escaping, bool printLfCr) const
+	{
+		std::string command = std::to_string(cmdId);
+		for (const std::string &argument : arguments) {
+			command += escaping.fieldSeparator;
+			command += argument;
+		}
+		command += escaping.commandSeparator;
+		if (printLfCr) command += "\r\n";
+		return command;
+	}
+
+	// **** ReceivedCommand ****
+
+	/**
+	 * Received command made from its fields, the first one being the command ID
+	 */
+	ReceivedCommand::ReceivedCommand(std::vector<std::string> &&fields, const Escaping &escaping)
+		: escapeCharacter(escaping.escapeCharacter)
+	{
+		if (fields.empty()) return;
+		const std::string &id = fields.front();
+		int value = -1;
+		std::from_chars_result result = std::from_chars(id.data(), id.data() + id.size(), value);
+		if (result.ec != std::errc() || result.ptr != id.data() + id.size() || value < 0) return;
+		cmdId = value;
+		arguments.assign(std::make_move_iterator(fields.begin() + 1), std::make_move_iterator(fields.end()));
+	}
+
+	/**
+	 * Returns the argument to read, or nullptr when all have been read
+	 */
+	const std::string *ReceivedCommand::current()
+	{
+		argOk = (parameter < arguments.size());
+		return argOk ? &arguments[parameter] : nullptr;
+	}
+
+	/**
+	 * Returns if there is an argument left to read. An argument that could not be
+	 *  read is not skipped
+	 */
+	bool ReceivedCommand::next()
+	{
+		return parameter < arguments.size();
+	}
+
+	/**
+	 * Returns if a next argument is available
+	 */
+	bool ReceivedCommand::available()
+	{
+		return next();
+	}
+
+	/**
+	 * Reads the current argument as a number of type T, the whole argument must be read
+	 */
+	template<class T>
+	T ReceivedCommand::readNumber()
+	{
+		const std::string *argument = current();
+		if (argument == nullptr) return 0;
+		T value = 0;
+		const char *end = argument->data() + argument->size();
+		std::from_chars_result result = std::from_chars(argument->data(), end, value);
+		argOk = (result.ec == std::errc() && result.ptr == end);
+		if (!argOk) return 0;
+		parameter++;
+		return value;
+	}
+
+	/**
+	 * Reads the current argument as a boolean: any number other than 0 is true
+	 */
+	bool ReceivedCommand::readBoolArg()
+	{
+		return readInt32Arg() != 0;
+	}
+
+	/**
+	 * Reads the current argument as a 16 bit integer
+	 */
+	int16_t ReceivedCommand::readInt16Arg()
+	{
+		return readNumber<int16_t>();
+	}
+
+	/**
+	 * Reads the current argument as an unsigned 16 bit integer
+	 */
+	uint16_t ReceivedCommand::readUInt16Arg()
+	{
+		return readNumber<uint16_t>();
+	}
+
+	/**
+	 * Reads the current argument as a 32 bit integer
+	 */
+	int32_t ReceivedCommand::readInt32Arg()
+	{
+		return readNumber<int32_t>();
+	}
+
+	/**
+	 * Reads the current argument as an unsigned 32 bit integer
+	 */
+	uint32_t ReceivedCommand::readUInt32Arg()
+	{
+		return readNumber<uint32_t>();
+	}
+
+	/**
+	 * Reads the current argument as a float
+	 */
+	float ReceivedCommand::readFloatArg()
+	{
+		return readNumber<float>();
+	}
+
+	/**
+	 * Reads the current argument as a double
+	 */
+	double ReceivedCommand::readDoubleArg()
+	{
+		return readNumber<double>();
+	}
+
+	/**
+	 * Reads the current argument as text, unescaped
+	 */
+	std::string ReceivedCommand::readStringArg()
+	{
+		const std::string *argument = current();
+		if (argument == nullptr) return std::string();
+		parameter++;
+		return unescapeArg(*argument);
+	}
+
+	/**
+	 * Removes the escape characters of an argument
+	 */
+	std::string ReceivedCommand::unescapeArg(const std::string &argument) const
+	{
+		Escaping escaping;
+		escaping.escapeCharacter = escapeCharacter;
+		return escaping.unescape(argument);
+	}
+}
@@ -0,0 +1,154 @@
+/*
+  CmdMessenger - library that provides command based messaging
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+  LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+  OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+  WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+  */
+
+#pragma once
+
+#include <CommandMessenger/Escaping.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace CommandMessenger
+{
+	/**
+	 * Command ID with its arguments, as they are on the wire: escaped
+	 */
+	class Command
+	{
+	public:
+		int cmdId = -1;                 // Command ID, -1 if it could not be read
+		std::vector<std::string> arguments; // Escaped arguments
+		std::chrono::steady_clock::time_point timeStamp; // Time the command was received or sent
+
+		/**
+		 * Returns if the command holds a valid ID
+		 */
+		bool ok() const { return cmdId >= 0; }
+	};
+
+	/**
+	 * Command to send, with the acknowledge it waits for, if any
+	 */
+	class SendCommand : public Command
+	{
+	public:
+		bool reqAc = false;             // Indicates if sending waits for an acknowledge
+		int ackCmdId = 1;               // ID of the acknowledge command
+		std::chrono::milliseconds timeout{ 5000 }; // Time to wait for the acknowledge
+
+		explicit SendCommand(int cmdId);
+		SendCommand(int cmdId, int ackCmdId, std::chrono::milliseconds timeout);
+
+		void addArgument(const std::string &argument, const Escaping &escaping = Escaping());
+		void addArgument(const char *argument, const Escaping &escaping = Escaping());
+		void addArgument(bool argument);
+		void addArgument(float argument);
+		void addArgument(double argument);
+
+		/**
+		 * Adds an integer argument as text
+		 */
+		template<class T, typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value, int>::type = 0>
+		void addArgument(T argument)
+		{
+			arguments.push_back(std::to_string(argument));
+		}
+
+		/**
+		 * Adds an argument in binary format: its bytes, escaped. Note that a double on
+		 *  an AVR board is a float
+		 */
+		template<class T>
+		void addBinArgument(const T &argument, const Escaping &escaping = Escaping())
+		{
+			static_assert(std::is_trivially_copyable<T>::value, "Binary arguments are copied byte for byte");
+			std::string bytes(sizeof(T), '\0');
+			std::memcpy(&bytes[0], &argument, sizeof(T));
+			arguments.push_back(escaping.escape(bytes));
+		}
+
+		std::string commandString(const Escaping &escaping = Escaping(), bool printLfCr = false) const;
+	};
+
+	/**
+	 * Received command, with readers for its arguments like those of the Arduino library
+	 */
+	class ReceivedCommand : public Command
+	{
+	private:
+		std::size_t parameter = 0;      // Index of the next argument to read
+		bool argOk = false;             // Indicates if the last argument could be read
+		char escapeCharacter = '/';     // Escape character of the arguments
+
+		const std::string *current();
+
+	public:
+		std::string rawString;          // The command as it came in
+
+		ReceivedCommand() = default;
+		ReceivedCommand(std::vector<std::string> &&fields, const Escaping &escaping);
+
+		bool next();
+		bool available();
+		bool isArgOk() const { return argOk; }
+
+		bool readBoolArg();
+		int16_t readInt16Arg();
+		uint16_t readUInt16Arg();
+		int32_t readInt32Arg();
+		uint32_t readUInt32Arg();
+		float readFloatArg();
+		double readDoubleArg();
+		std::string readStringArg();
+
+		/**
+		 * Reads the current argument in binary format. Note that a double on an AVR
+		 *  board is a float
+		 */
+		template<class T>
+		T readBinArg()
+		{
+			static_assert(std::is_trivially_copyable<T>::value, "Binary arguments are copied byte for byte");
+			T value{};
+			const std::string *argument = current();
+			if (argument == nullptr) return value;
+			std::string bytes = unescapeArg(*argument);
+			argOk = (bytes.size() == sizeof(T));
+			if (!argOk) return value;
+			std::memcpy(&value, bytes.data(), sizeof(T));
+			parameter++;
+			return value;
+		}
+
+	private:
+		std::string unescapeArg(const std::string &argument) const;
+
+		template<class T>
+		T readNumber();
+	};
+}
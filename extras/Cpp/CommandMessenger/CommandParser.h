@@ -0,0 +1,89 @@
+/*
+  CmdMessenger - library that provides command based messaging
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+  LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+  OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+  WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+  */
+
+#pragma once
+
+#include <CommandMessenger/Escaping.h>
+
+#include <cstddef>
+#include <string>
+
+namespace CommandMessenger
+{
+	/**
+	 * Cuts a byte stream into commands on unescaped command separators. Keeps the
+	 *  command that is partly received, and whether the last byte was an escape
+	 *  character, between calls, so bytes may come in any pieces. Commands are read
+	 *  from the fed bytes in place; only a command cut off at the end is copied
+	 */
+	class CommandParser
+	{
+	private:
+		char commandSeparator;          // Character indicating end of command
+		char escapeCharacter;           // Character indicating escaping of special chars
+		bool escapeNext = false;        // Indicates if the next byte is escaped
+		std::string line;               // Start of a command cut off at the end of the previous bytes
+
+	public:
+		explicit CommandParser(const Escaping &escaping)
+			: commandSeparator(escaping.commandSeparator), escapeCharacter(escaping.escapeCharacter)
+		{
+		}
+
+		/**
+		 * Feeds bytes, and calls onLine(const char *, std::size_t) for every command completed
+		 *  by them, without its separator. A command that lies within the bytes is passed
+		 *  where it is, so it is only valid during the call
+		 */
+		template<class F>
+		void feed(const char *data, std::size_t size, F &&onLine)
+		{
+			std::size_t start = 0;
+			for (std::size_t i = 0; i < size; i++) {
+				char c = data[i];
+				if (escapeNext) escapeNext = false;
+				else if (c == escapeCharacter) escapeNext = true;
+				else if (c == commandSeparator) {
+					if (line.empty()) onLine(data + start, i - start);
+					else {
+						line.append(data + start, i - start);
+						onLine(line.data(), line.size());
+						line.clear();
+					}
+					start = i + 1;
+				}
+			}
+			line.append(data + start, size - start);
+		}
+
+		/**
+		 * Drops the command that is partly received
+		 */
+		void reset()
+		{
+			escapeNext = false;
+			line.clear();
+		}
+	};
+}
@@ -0,0 +1,102 @@
+/*
+  CmdMessenger - library that provides command based messaging
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+  LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+  OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+  WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+  */
+
+#include <CommandMessenger/Escaping.h>
+
+namespace CommandMessenger
+{
+	/**
+	 * Puts the escape character in front of separators, escape characters and zeros
+	 */
+	std::string Escaping::escape(const std::string &input) const
+	{
+		std::string output;
+		output.reserve(input.size());
+		for (char c : input) {
+			if (c == fieldSeparator || c == commandSeparator || c == escapeCharacter || c == '\0')
+				output += escapeCharacter;
+			output += c;
+		}
+		return output;
+	}
+
+	/**
+	 * Removes the escape characters
+	 */
+	std::string Escaping::unescape(const std::string &input) const
+	{
+		std::string output;
+		output.reserve(input.size());
+		for (std::size_t i = 0; i < input.size(); i++) {
+			if (input[i] == escapeCharacter && i + 1 < input.size()) i++;
+			output += input[i];
+		}
+		return output;
+	}
+
+	/**
+	 * Splits a command on unescaped field separators. Escape characters are kept, and
+	 *  empty fields are skipped, like the Arduino library does
+	 */
+	std::vector<std::string> Escaping::split(const char *input, std::size_t size) const
+	{
+		std::vector<std::string> fields;
+		std::string field;
+		for (std::size_t i = 0; i < size; i++) {
+			char c = input[i];
+			if (c == fieldSeparator) {
+				if (!field.empty()) fields.push_back(std::move(field));
+				field.clear();
+				continue;
+			}
+			if (c == escapeCharacter && i + 1 < size) {
+				field += c;
+				c = input[++i];
+			}
+			field += c;
+		}
+		if (!field.empty()) fields.push_back(std::move(field));
+		return fields;
+	}
+
+	/**
+	 * Returns where a command starts, after the line end that a device with printLfCr
+	 *  sends after the previous command. Line ends at the end are kept, they may be
+	 *  binary argument bytes
+	 */
+	std::size_t Escaping::lineStart(const char *line, std::size_t size) const
+	{
+		std::size_t start = 0;
+		while (start < size && (line[start] == '\r' || line[start] == '\n')) start++;
+		return start;
+	}
+
+	/**
+	 * Removes the line end that a device with printLfCr sends after the previous command
+	 */
+	std::string Escaping::trimLine(const std::string &line) const
+	{
+		return line.substr(lineStart(line.data(), line.size()));
+	}
+}
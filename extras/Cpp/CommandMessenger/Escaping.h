@@ -0,0 +1,50 @@
+/*
+  CmdMessenger - library that provides command based messaging
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+  LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+  OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+  WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+  */
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace CommandMessenger
+{
+	/**
+	 * Separator and escape characters of the wire format, the same as those of the
+	 *  Arduino library: id,arg,arg; with '/' in front of special characters
+	 */
+	struct Escaping
+	{
+		char fieldSeparator = ',';      // Character indicating end of argument
+		char commandSeparator = ';';    // Character indicating end of command
+		char escapeCharacter = '/';     // Character indicating escaping of special chars
+
+		std::string escape(const std::string &input) const;
+		std::string unescape(const std::string &input) const;
+		std::vector<std::string> split(const char *input, std::size_t size) const;
+		std::vector<std::string> split(const std::string &input) const { return split(input.data(), input.size()); }
+		std::size_t lineStart(const char *line, std::size_t size) const;
+		std::string trimLine(const std::string &line) const;
+	};
+}
@@ -0,0 +1,619 @@
+/*
+  CmdMessenger - library that provides command based messaging
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+  LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+  OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+  WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+  */
+
+#include <CommandMessenger/EventLoop.h>
+#include <CommandMessenger/CmdMessenger.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace CommandMessenger
+{
+	static const int MaxEvents = 256;             // Events taken from epoll at once
+	static const std::size_t ReadSize = 4096;     // Bytes read from a descriptor at once
+	static const std::size_t ReadBudget = 65536;  // Bytes read from one descriptor per wake up
+	static const unsigned SubmissionEntries = 256; // Size of the io_uring submission ring
+	static const unsigned CompletionEntries = 4096; // Size of the io_uring completion ring
+	static const unsigned BufferCount = 1024;     // Provided buffers, a power of two
+	static const unsigned BufferSize = 4096;      // Bytes per provided buffer
+	static const std::size_t MaxLinkedWrites = 8; // Writes linked in one chain
+	static const std::size_t WriteSize = 16384;   // Bytes of sent commands joined into one write
+
+	// Event data and io_uring tags. A tag without a kind in the top byte points to a write
+	static const uint64_t WakeToken = ~(uint64_t)0;
+	static const uint64_t KindMask = (uint64_t)0xFF << 56;
+	static const uint64_t ReadKind = (uint64_t)1 << 56;
+	static const uint64_t CancelKind = (uint64_t)2 << 56;
+	static const uint32_t GenerationMask = 0xFFFFFF;
+
+	/**
+	 * Writes of a messenger that are linked, so that they complete in order
+	 */
+	struct EventLoop::WriteChain
+	{
+		struct Write
+		{
+			WriteChain *chain;
+			std::string data;           // Commands joined
+			std::size_t written;        // Bytes written
+			int32_t result;             // -errno if the write failed or was cancelled
+		};
+
+		uint32_t slot;                  // Slot of the messenger
+		bool orphan;                    // The messenger left; the chain is freed when done
+		std::size_t pending;            // Writes not completed yet
+		std::vector<std::unique_ptr<Write>> writes;
+	};
+
+	/**
+	 * Returns the tag of the reads of a slot
+	 */
+	static uint64_t readTag(uint32_t slot, uint32_t generation)
+	{
+		return ReadKind | (uint64_t)(generation & GenerationMask) << 32 | slot;
+	}
+
+	/**
+	 * EventLoop constructor. Uses the preferred backend if the kernel supports it,
+	 *  Epoll otherwise. Check isValid when the descriptors could not be made
+	 */
+	EventLoop::EventLoop(Backend preferred)
+		: activeBackend(Backend::Epoll), wakeFd(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK))
+	{
+		if (wakeFd < 0) return;
+		if (preferred == Backend::IoUring && ring.open(SubmissionEntries, CompletionEntries, BufferCount, BufferSize)) {
+			activeBackend = Backend::IoUring;
+			armWake();
+			ring.submit();
+			return;
+		}
+		epollFd = epoll_create1(EPOLL_CLOEXEC);
+		if (epollFd < 0) return;
+		epoll_event event = {};
+		event.events = EPOLLIN;
+		event.data.u64 = WakeToken;
+		epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &event);
+	}
+
+	/**
+	 * Stops the loop. Messengers still in the loop are no longer read for
+	 */
+	EventLoop::~EventLoop()
+	{
+		stop();
+		std::lock_guard<std::recursive_mutex> lock(entryMutex);
+		for (uint32_t slot = 0; slot < entries.size(); slot++)
+			if (entries[slot].messenger != nullptr) removeSlot(slot);
+		if (activeBackend == Backend::IoUring) {
+			// The kernel may still read the buffers of writes: wait until it let go of them
+			ring.prepareCancelAll(CancelKind);
+			ring.submit();
+			std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+			while (pending > 0 && std::chrono::steady_clock::now() < deadline) {
+				ring.wait(10);
+				IoUring::Completion completion;
+				while (ring.nextCompletion(completion)) complete(completion);
+			}
+		}
+		if (epollFd >= 0) close(epollFd);
+		if (wakeFd >= 0) close(wakeFd);
+	}
+
+	/**
+	 * Returns if the descriptors of the loop could be made
+	 */
+	bool EventLoop::isValid() const
+	{
+		if (wakeFd < 0) return false;
+		return activeBackend == Backend::IoUring ? ring.isOpen() : epollFd >= 0;
+	}
+
+	/**
+	 * Registers the connected transport of a messenger, and makes its descriptor non blocking
+	 */
+	bool EventLoop::add(CmdMessenger *messenger)
+	{
+		if (!isValid()) return false;
+		int fd = messenger->transport.fileDescriptor();
+		int flags = fcntl(fd, F_GETFL);
+		if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) != 0) return false;
+
+		std::lock_guard<std::recursive_mutex> lock(entryMutex);
+		uint32_t slot;
+		if (!freeSlots.empty()) {
+			slot = freeSlots.back();
+			freeSlots.pop_back();
+		}
+		else {
+			slot = (uint32_t)entries.size();
+			entries.push_back(Entry{ nullptr, 0, false, false, false, false, false, nullptr, {} });
+		}
+		Entry &entry = entries[slot];
+		entry.messenger = messenger;
+		entry.closing = entry.armed = entry.touched = entry.hungUp = false;
+		entry.reading = true;
+		if (activeBackend == Backend::Epoll) {
+			epoll_event event = {};
+			event.events = EPOLLIN;
+			event.data.u64 = readTag(slot, entry.generation);
+			if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) != 0) {
+				entry.messenger = nullptr;
+				freeSlots.push_back(slot);
+				return false;
+			}
+		}
+		else {
+			armRead(slot);
+			if (!entry.armed || ring.submit() < 0) {
+				entry.messenger = nullptr;
+				freeSlots.push_back(slot);
+				return false;
+			}
+		}
+		messenger->loopSlot = slot;
+		messenger->loop = this;
+		return true;
+	}
+
+	/**
+	 * Takes a messenger out of the loop. Once this returns, the loop does not touch it
+	 */
+	void EventLoop::remove(CmdMessenger *messenger)
+	{
+		std::lock_guard<std::recursive_mutex> lock(entryMutex);
+		if (messenger->loop != this) return;
+		removeSlot(messenger->loopSlot);
+	}
+
+	/**
+	 * Frees the slot of a messenger. Events and completions still pending for it are
+	 *  ignored by generation, and its writes on their way are freed when done
+	 */
+	void EventLoop::removeSlot(uint32_t slot)
+	{
+		Entry &entry = entries[slot];
+		if (activeBackend == Backend::Epoll) {
+			// The descriptor is left already when the device went away
+			if (!entry.closing) epoll_ctl(epollFd, EPOLL_CTL_DEL, entry.messenger->transport.fileDescriptor(), nullptr);
+		}
+		else {
+			if (entry.armed) ring.prepareCancel(readTag(slot, entry.generation), CancelKind);
+			if (entry.chain != nullptr) entry.chain->orphan = true;
+			entry.chain = nullptr;
+			entry.outgoing.clear();
+			ring.submit();
+		}
+		{
+			std::lock_guard<std::mutex> lock(writeMutex);
+			CmdMessenger *messenger = entry.messenger;
+			messenger->loop = nullptr;
+			queuedWrites.erase(std::remove_if(queuedWrites.begin(), queuedWrites.end(),
+				[messenger](const std::pair<CmdMessenger *, std::string> &write) { return write.first == messenger; }),
+				queuedWrites.end());
+		}
+		entry.messenger = nullptr;
+		entry.armed = entry.touched = false;
+		entry.generation++;
+		freeSlots.push_back(slot);
+		throttled.erase(std::remove(throttled.begin(), throttled.end(), slot), throttled.end());
+	}
+
+	/**
+	 * Starts or stops reading from a messenger
+	 */
+	bool EventLoop::setReading(uint32_t slot, bool reading)
+	{
+		Entry &entry = entries[slot];
+		entry.reading = reading;
+		if (activeBackend == Backend::IoUring) {
+			// A cancelled read completes later; dispatch posts it again if it is wanted by then
+			if (!reading && entry.armed) return ring.prepareCancel(readTag(slot, entry.generation), CancelKind);
+			if (reading && !entry.armed) armRead(slot);
+			return true;
+		}
+		epoll_event event = {};
+		event.events = reading ? (uint32_t)EPOLLIN : 0;
+		event.data.u64 = readTag(slot, entry.generation);
+		return epoll_ctl(epollFd, EPOLL_CTL_MOD, entry.messenger->transport.fileDescriptor(), &event) == 0;
+	}
+
+	/**
+	 * Asks the worker of a messenger with a full queue to wake the loop when it has
+	 *  emptied the queue. Returns false if there is room by now and the backlog is queued
+	 */
+	bool EventLoop::holdBack(CmdMessenger *messenger)
+	{
+		messenger->waitingForRoom = true;
+		// Pairs with the fence in CmdMessenger::processReceived
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (!messenger->flushBacklog()) return true;
+		messenger->waitingForRoom = false;
+		return false;
+	}
+
+	/**
+	 * Wakes the loop from another thread
+	 */
+	void EventLoop::wake()
+	{
+		uint64_t wakeUp = 1;
+		while (::write(wakeFd, &wakeUp, sizeof(wakeUp)) < 0 && errno == EINTR);
+	}
+
+	/**
+	 * Queues a command for the loop to write, with the IoUring backend. Returns false
+	 *  if the messenger should write itself
+	 */
+	bool EventLoop::queueWrite(CmdMessenger *messenger, const std::string &frame)
+	{
+		if (activeBackend != Backend::IoUring) return false;
+		{
+			std::lock_guard<std::mutex> lock(writeMutex);
+			if (messenger->loop != this) return false;
+			queuedWrites.emplace_back(messenger, frame);
+		}
+		if (!writesQueued.exchange(true)) wake();
+		return true;
+	}
+
+	/**
+	 * Reads what a ready descriptor holds, up to the budget. Epoll backend
+	 */
+	void EventLoop::readReady(uint32_t slot)
+	{
+		CmdMessenger *messenger = entries[slot].messenger;
+		int fd = messenger->transport.fileDescriptor();
+		char buffer[ReadSize];
+		std::size_t budget = ReadBudget;
+		bool gone = false;
+		while (budget > 0) {
+			ssize_t length = ::read(fd, buffer, std::min(sizeof(buffer), budget));
+			if (length > 0) {
+				messenger->receiveBytes(buffer, (std::size_t)length);
+				budget -= (std::size_t)length;
+				// A short read took all there was
+				if ((std::size_t)length < sizeof(buffer)) break;
+				continue;
+			}
+			if (length < 0 && errno == EINTR) continue;
+			if (length < 0 && errno == EAGAIN) break;
+			// End of file, or the device is gone (a pseudo terminal without its other end gives EIO)
+			gone = true;
+			break;
+		}
+		dispatch(slot, gone);
+	}
+
+	/**
+	 * Queues the commands a messenger received in this wake up, and schedules it once
+	 *  for all of them. Holds back reading while its queue is full
+	 */
+	void EventLoop::dispatch(uint32_t slot, bool gone)
+	{
+		Entry &entry = entries[slot];
+		CmdMessenger *messenger = entry.messenger;
+		bool queued = messenger->flushBacklog() || !holdBack(messenger);
+		messenger->scheduleReceived();
+		if (gone) {
+			messenger->transport.disconnect();
+			if (queued) {
+				removeSlot(slot);
+				return;
+			}
+			if (activeBackend == Backend::Epoll) epoll_ctl(epollFd, EPOLL_CTL_DEL, messenger->transport.fileDescriptor(), nullptr);
+			entry.closing = true;
+			if (entry.reading) throttled.push_back(slot);
+			entry.reading = false;
+			return;
+		}
+		// Not reading means that the slot is held back already
+		if (!queued) {
+			if (entry.reading) {
+				throttled.push_back(slot);
+				setReading(slot, false);
+			}
+		}
+		else if (activeBackend == Backend::IoUring && entry.reading && !entry.armed) armRead(slot);
+	}
+
+	/**
+	 * Queues the backlog of messengers that were not read from because their queue
+	 *  was full, and reads from them again once it is queued
+	 */
+	void EventLoop::retryThrottled()
+	{
+		std::vector<uint32_t> waiting;
+		waiting.swap(throttled);
+		for (uint32_t slot : waiting) {
+			CmdMessenger *messenger = entries[slot].messenger;
+			bool queued = messenger->flushBacklog() || !holdBack(messenger);
+			messenger->scheduleReceived();
+			if (!queued) throttled.push_back(slot);
+			else if (entries[slot].closing) removeSlot(slot);
+			else setReading(slot, true);
+		}
+	}
+
+	/**
+	 * Waits up to timeoutMs, -1 for no limit, for bytes to come in and dispatches them.
+	 *  Returns the number of events handled, or -1 if the backend failed
+	 */
+	int EventLoop::runOnce(int timeoutMs)
+	{
+		return activeBackend == Backend::IoUring ? runIoUring(timeoutMs) : runEpoll(timeoutMs);
+	}
+
+	/**
+	 * Waits for descriptors to become ready and reads from them
+	 */
+	int EventLoop::runEpoll(int timeoutMs)
+	{
+		{
+			std::lock_guard<std::recursive_mutex> lock(entryMutex);
+			if (!throttled.empty()) retryThrottled();
+		}
+
+		epoll_event events[MaxEvents];
+		int count = epoll_wait(epollFd, events, MaxEvents, timeoutMs);
+		if (count < 0) return errno == EINTR ? 0 : -1;
+
+		std::lock_guard<std::recursive_mutex> lock(entryMutex);
+		for (int i = 0; i < count; i++) {
+			uint64_t data = events[i].data.u64;
+			if (data == WakeToken) {
+				uint64_t wakeUps;
+				while (::read(wakeFd, &wakeUps, sizeof(wakeUps)) < 0 && errno == EINTR);
+				continue;
+			}
+			uint32_t slot = (uint32_t)data;
+			// The messenger may have left, in this batch or before it
+			if (slot >= entries.size() || entries[slot].messenger == nullptr || entries[slot].closing ||
+				data != readTag(slot, entries[slot].generation)) continue;
+			readReady(slot);
+		}
+		return count;
+	}
+
+	/**
+	 * Submits the queued writes, waits for completions and handles them all, then
+	 *  dispatches the messengers that received bytes
+	 */
+	int EventLoop::runIoUring(int timeoutMs)
+	{
+		{
+			std::lock_guard<std::recursive_mutex> lock(entryMutex);
+			if (!throttled.empty()) retryThrottled();
+			takeWrites();
+			if (ring.submit() < 0) return -1;
+		}
+
+		if (ring.wait(timeoutMs) < 0) return -1;
+
+		std::lock_guard<std::recursive_mutex> lock(entryMutex);
+		int count = 0;
+		IoUring::Completion completion;
+		while (ring.nextCompletion(completion)) {
+			complete(completion);
+			count++;
+		}
+		for (uint32_t slot : touched) {
+			Entry &entry = entries[slot];
+			// The messenger may have left while an earlier one was dispatched
+			if (!entry.touched) continue;
+			bool gone = entry.hungUp;
+			entry.touched = entry.hungUp = false;
+			dispatch(slot, gone);
+		}
+		touched.clear();
+		ring.submit();
+		return count;
+	}
+
+	/**
+	 * Handles a completion: parses the bytes of a read in place and gives the buffer
+	 *  back, or finishes a write
+	 */
+	void EventLoop::complete(const IoUring::Completion &completion)
+	{
+		if (completion.userData == WakeToken) {
+			pending--;
+			if (completion.result != -ECANCELED) armWake();
+			return;
+		}
+		uint64_t kind = completion.userData & KindMask;
+		if (kind == CancelKind) return;
+		if (kind != ReadKind) {
+			completeWrite(completion);
+			return;
+		}
+
+		bool more = IoUring::hasMore(completion);
+		if (!more) pending--;
+		uint32_t slot = (uint32_t)completion.userData;
+		Entry *entry = slot < entries.size() && entries[slot].messenger != nullptr && !entries[slot].closing &&
+			completion.userData == readTag(slot, entries[slot].generation) ? &entries[slot] : nullptr;
+		if (entry != nullptr) {
+			if (!more) entry->armed = false;
+			int32_t result = completion.result;
+			if (result > 0 && IoUring::hasBuffer(completion))
+				entry->messenger->receiveBytes(ring.buffer(completion), (std::size_t)result);
+			// Out of buffers, or cancelled while the queue was full: posted again by dispatch
+			else if (result != -ENOBUFS && result != -ECANCELED && result != -EAGAIN && result != -EINTR)
+				entry->hungUp = true;
+			if (!entry->touched) {
+				entry->touched = true;
+				touched.push_back(slot);
+			}
+		}
+		if (IoUring::hasBuffer(completion)) ring.recycleBuffer(completion);
+	}
+
+	/**
+	 * Handles the completion of a write. When its chain is done, what a short write
+	 *  left, and the writes cancelled after it, are sent again in order
+	 */
+	void EventLoop::completeWrite(const IoUring::Completion &completion)
+	{
+		WriteChain::Write *write = (WriteChain::Write *)(uintptr_t)completion.userData;
+		WriteChain *chain = write->chain;
+		pending--;
+		if (completion.result > 0) write->written += (std::size_t)completion.result;
+		else write->result = completion.result;
+		if (--chain->pending > 0) return;
+
+		std::unique_ptr<WriteChain> done(chain);
+		if (chain->orphan) return;
+		Entry &entry = entries[chain->slot];
+		entry.chain = nullptr;
+		for (const std::unique_ptr<WriteChain::Write> &sent : chain->writes) {
+			int32_t result = sent->result;
+			// The device is gone; the reads find out
+			if (result < 0 && result != -ECANCELED && result != -EAGAIN && result != -EINTR) return;
+		}
+		for (std::size_t i = chain->writes.size(); i-- > 0;) {
+			WriteChain::Write &sent = *chain->writes[i];
+			if (sent.written < sent.data.size()) entry.outgoing.push_front(sent.data.substr(sent.written));
+		}
+		submitWrites(chain->slot);
+	}
+
+	/**
+	 * Posts a multi-shot read on the descriptor of a slot
+	 */
+	void EventLoop::armRead(uint32_t slot)
+	{
+		Entry &entry = entries[slot];
+		if (!ring.prepareReadMultishot(entry.messenger->transport.fileDescriptor(), readTag(slot, entry.generation))) return;
+		entry.armed = true;
+		pending++;
+	}
+
+	/**
+	 * Posts a read on the wake descriptor
+	 */
+	void EventLoop::armWake()
+	{
+		if (ring.prepareRead(wakeFd, &wakeValue, sizeof(wakeValue), WakeToken)) pending++;
+	}
+
+	/**
+	 * Moves the commands sent since the last wake up to their messengers, and writes them
+	 */
+	void EventLoop::takeWrites()
+	{
+		if (!writesQueued) return;
+		std::vector<std::pair<CmdMessenger *, std::string>> writes;
+		{
+			std::lock_guard<std::mutex> lock(writeMutex);
+			writes.swap(queuedWrites);
+			writesQueued = false;
+		}
+		// Messengers that left took their writes with them, the others are still here
+		for (std::pair<CmdMessenger *, std::string> &write : writes)
+			entries[write.first->loopSlot].outgoing.push_back(std::move(write.second));
+		for (std::pair<CmdMessenger *, std::string> &write : writes) submitWrites(write.first->loopSlot);
+	}
+
+	/**
+	 * Joins the waiting commands of a messenger into writes, and submits them as one
+	 *  linked chain. One chain per messenger is on its way at a time
+	 */
+	void EventLoop::submitWrites(uint32_t slot)
+	{
+		Entry &entry = entries[slot];
+		if (entry.chain != nullptr || entry.outgoing.empty() || entry.closing) return;
+		// The links of a chain must be submitted at once
+		if (ring.space() < MaxLinkedWrites) ring.submit();
+		std::size_t room = std::min<std::size_t>(ring.space(), MaxLinkedWrites);
+		if (room == 0) return;
+
+		WriteChain *chain = new WriteChain{ slot, false, 0, {} };
+		while (!entry.outgoing.empty() && chain->writes.size() < room) {
+			std::unique_ptr<WriteChain::Write> write(new WriteChain::Write{ chain, std::move(entry.outgoing.front()), 0, 0 });
+			entry.outgoing.pop_front();
+			while (!entry.outgoing.empty() && write->data.size() + entry.outgoing.front().size() <= WriteSize) {
+				write->data += entry.outgoing.front();
+				entry.outgoing.pop_front();
+			}
+			chain->writes.push_back(std::move(write));
+		}
+		int fd = entry.messenger->transport.fileDescriptor();
+		for (std::size_t i = 0; i < chain->writes.size(); i++) {
+			WriteChain::Write *write = chain->writes[i].get();
+			ring.prepareWrite(fd, write->data.data(), (unsigned)write->data.size(), (uint64_t)(uintptr_t)write,
+				i + 1 < chain->writes.size());
+		}
+		chain->pending = chain->writes.size();
+		pending += (int)chain->writes.size();
+		entry.chain = chain;
+	}
+
+	/**
+	 * Runs the loop on the calling thread until stop
+	 */
+	void EventLoop::run()
+	{
+		running = true;
+		while (running)
+			if (runOnce() < 0) break;
+	}
+
+	/**
+	 * Runs the loop on a thread of its own. Returns false if it runs already
+	 */
+	bool EventLoop::start()
+	{
+		if (!isValid() || thread.joinable()) return false;
+		running = true;
+		thread = std::thread([this] {
+			while (running)
+				if (runOnce() < 0) break;
+		});
+		return true;
+	}
+
+	/**
+	 * Ends run, or the thread of start
+	 */
+	void EventLoop::stop()
+	{
+		running = false;
+		if (wakeFd >= 0) wake();
+		if (thread.joinable() && thread.get_id() != std::this_thread::get_id()) thread.join();
+	}
+
+	/**
+	 * Returns the number of messengers in the loop
+	 */
+	std::size_t EventLoop::size()
+	{
+		std::lock_guard<std::recursive_mutex> lock(entryMutex);
+		return entries.size() - freeSlots.size();
+	}
+}
@@ -0,0 +1,140 @@
+/*
+  CmdMessenger - library that provides command based messaging
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+  LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+  OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+  WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+  */
+
+#pragma once
+
+#include <CommandMessenger/IoUring.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace CommandMessenger
+{
+	class CmdMessenger;
+
+	/**
+	 * Reads for many messengers on one thread, instead of a reader thread per device.
+	 *
+	 * The descriptors of the transports, serial ports, pseudo terminals and TCP or UNIX
+	 * sockets, are made non blocking and waited on with one of two backends:
+	 * - IoUring keeps a multi-shot read posted on every descriptor. The kernel fills
+	 *   provided buffers that the parser reads in place, so reading takes no system
+	 *   call per read. Sent commands are queued to the loop, which writes them as
+	 *   linked submissions, several per system call.
+	 * - Epoll reads what each ready descriptor holds, up to a budget. The messengers
+	 *   write themselves.
+	 * IoUring needs Linux 6.7 for multi-shot reads; on older kernels, or when io_uring
+	 * is not allowed, the loop uses Epoll.
+	 *
+	 * On a wake up the loop cuts the bytes into commands with the parser of each
+	 * messenger, and schedules the messenger on its worker pool once for all of them.
+	 * A messenger whose queue is full is not read from until its worker has emptied
+	 * it and woken the loop, so one slow device does not hold up the others.
+	 * Connect a messenger with CmdMessenger::connect(EventLoop &); a messenger that
+	 * disconnects, or whose device goes away, leaves the loop. Disconnect the
+	 * messengers before the loop is destroyed.
+	 */
+	class EventLoop
+	{
+	public:
+		enum class Backend { Epoll, IoUring };
+
+	private:
+		struct WriteChain;
+
+		struct Entry
+		{
+			CmdMessenger *messenger;    // Messenger read for, nullptr if the slot is free
+			uint32_t generation;        // Tells events of an earlier messenger in the slot apart
+			bool closing;               // The device went away, the backlog is still queued
+			bool reading;               // Indicates if bytes are wanted, false while the queue is full
+			bool armed;                 // Indicates if a multi-shot read is posted
+			bool touched;               // Indicates if bytes came in during this wake up
+			bool hungUp;                // Indicates if the device went away during this wake up
+			WriteChain *chain;          // Linked writes on their way, nullptr if none
+			std::deque<std::string> outgoing; // Commands waiting for the chain to complete
+		};
+
+		Backend activeBackend;
+		IoUring ring;                   // Used by the IoUring backend
+		int epollFd = -1;               // Used by the Epoll backend
+		int wakeFd;                     // Event descriptor that wakes the loop
+		uint64_t wakeValue = 0;         // Read from wakeFd by the IoUring backend
+		int pending = 0;                // Requests the kernel still holds, IoUring backend
+		std::recursive_mutex entryMutex; // Guards the entries; held while reading for them
+		std::vector<Entry> entries;     // Registered messengers by slot
+		std::vector<uint32_t> freeSlots;
+		std::vector<uint32_t> throttled; // Slots not read from until their backlog is queued
+		std::vector<uint32_t> touched;  // Slots with bytes in this wake up, IoUring backend
+		std::mutex writeMutex;          // Guards queuedWrites
+		std::vector<std::pair<CmdMessenger *, std::string>> queuedWrites; // Commands sent since the last wake up
+		std::atomic<bool> writesQueued{ false }; // Indicates if the loop was woken for queuedWrites
+		std::atomic<bool> running{ false };
+		std::thread thread;             // Runs the loop after start
+
+		bool add(CmdMessenger *messenger);
+		void remove(CmdMessenger *messenger);
+		void removeSlot(uint32_t slot);
+		bool setReading(uint32_t slot, bool reading);
+		bool holdBack(CmdMessenger *messenger);
+		void wake();
+		bool queueWrite(CmdMessenger *messenger, const std::string &frame);
+		void readReady(uint32_t slot);
+		void dispatch(uint32_t slot, bool gone);
+		void retryThrottled();
+		int runEpoll(int timeoutMs);
+		int runIoUring(int timeoutMs);
+		void complete(const IoUring::Completion &completion);
+		void completeWrite(const IoUring::Completion &completion);
+		void armRead(uint32_t slot);
+		void armWake();
+		void takeWrites();
+		void submitWrites(uint32_t slot);
+
+		friend class CmdMessenger;
+
+	public:
+		explicit EventLoop(Backend preferred = Backend::IoUring);
+		~EventLoop();
+
+		EventLoop(const EventLoop &) = delete;
+		EventLoop &operator=(const EventLoop &) = delete;
+
+		Backend backend() const { return activeBackend; }
+		bool isValid() const;
+		int runOnce(int timeoutMs = -1);
+		void run();
+		bool start();
+		void stop();
+		std::size_t size();
+	};
+}
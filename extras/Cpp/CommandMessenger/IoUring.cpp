@@ -0,0 +1,363 @@
+/*
+  CmdMessenger - library that provides command based messaging
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+  LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+  OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+  WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+  */
+
+#include <CommandMessenger/IoUring.h>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define COMMANDMESSENGER_IO_URING 1
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace CommandMessenger
+{
+#ifdef COMMANDMESSENGER_IO_URING
+	static const uint8_t ReadMultishotOp = 49;    // IORING_OP_READ_MULTISHOT, Linux 6.7, newer than some headers
+	static const uint16_t BufferGroup = 0;        // Group of the provided buffers
+
+	IoUring::IoUring()
+	{
+	}
+
+	IoUring::~IoUring()
+	{
+		close();
+	}
+
+	/**
+	 * Sets up the rings and the provided buffers. Returns false if the kernel lacks
+	 *  io_uring, or one of the features the EventLoop needs
+	 */
+	bool IoUring::open(unsigned entries, unsigned completionEntries, unsigned bufferCount, unsigned bufferSize)
+	{
+		io_uring_params params;
+		std::memset(&params, 0, sizeof(params));
+		params.flags = IORING_SETUP_CQSIZE;
+		params.cq_entries = completionEntries;
+		ringFd = (int)syscall(__NR_io_uring_setup, entries, &params);
+		if (ringFd < 0) return false;
+		const unsigned needed = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG;
+		if ((params.features & needed) != needed) {
+			close();
+			return false;
+		}
+
+		std::size_t sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+		std::size_t cqSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+		ringSize = sqSize > cqSize ? sqSize : cqSize;
+		ringMemory = mmap(nullptr, ringSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+		sqeSize = params.sq_entries * sizeof(io_uring_sqe);
+		sqeMemory = mmap(nullptr, sqeSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+		if (ringMemory == MAP_FAILED || sqeMemory == MAP_FAILED) {
+			if (ringMemory == MAP_FAILED) ringMemory = nullptr;
+			if (sqeMemory == MAP_FAILED) sqeMemory = nullptr;
+			close();
+			return false;
+		}
+		char *ring = (char *)ringMemory;
+		sqHead = (unsigned *)(ring + params.sq_off.head);
+		sqTail = (unsigned *)(ring + params.sq_off.tail);
+		sqMask = *(unsigned *)(ring + params.sq_off.ring_mask);
+		sqEntries = params.sq_entries;
+		sqArray = (unsigned *)(ring + params.sq_off.array);
+		for (unsigned i = 0; i < sqEntries; i++) sqArray[i] = i;
+		cqHead = (unsigned *)(ring + params.cq_off.head);
+		cqTail = (unsigned *)(ring + params.cq_off.tail);
+		cqMask = *(unsigned *)(ring + params.cq_off.ring_mask);
+		cqes = ring + params.cq_off.cqes;
+		localTail = submitted = *sqTail;
+
+		// The multi-shot read must be known to the kernel
+		std::size_t probeSize = sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op);
+		io_uring_probe *probe = (io_uring_probe *)calloc(1, probeSize);
+		bool supported = probe != nullptr &&
+			syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_PROBE, probe, 256) == 0 &&
+			probe->last_op >= ReadMultishotOp && (probe->ops[ReadMultishotOp].flags & IO_URING_OP_SUPPORTED);
+		free(probe);
+		if (!supported) {
+			close();
+			return false;
+		}
+
+		// Buffers the kernel fills and the parser reads in place, handed back after each read
+		this->bufferCount = bufferCount;
+		this->bufferSize = bufferSize;
+		bufferRingSize = bufferCount * sizeof(io_uring_buf) + (std::size_t)bufferCount * bufferSize;
+		bufferRing = mmap(nullptr, bufferRingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+		if (bufferRing == MAP_FAILED) {
+			bufferRing = nullptr;
+			close();
+			return false;
+		}
+		buffers = (char *)bufferRing + bufferCount * sizeof(io_uring_buf);
+		io_uring_buf_reg registration;
+		std::memset(&registration, 0, sizeof(registration));
+		registration.ring_addr = (uint64_t)(uintptr_t)bufferRing;
+		registration.ring_entries = bufferCount;
+		registration.bgid = BufferGroup;
+		if (syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_PBUF_RING, &registration, 1) != 0) {
+			close();
+			return false;
+		}
+		for (unsigned id = 0; id < bufferCount; id++) provideBuffer((uint16_t)id);
+		return true;
+	}
+
+	/**
+	 * Unmaps the rings and closes the ring descriptor
+	 */
+	void IoUring::close()
+	{
+		if (ringFd >= 0) ::close(ringFd);
+		ringFd = -1;
+		if (sqeMemory != nullptr) munmap(sqeMemory, sqeSize);
+		if (ringMemory != nullptr) munmap(ringMemory, ringSize);
+		if (bufferRing != nullptr) munmap(bufferRing, bufferRingSize);
+		sqeMemory = ringMemory = bufferRing = nullptr;
+	}
+
+	/**
+	 * Returns the number of submission entries that can still be prepared
+	 */
+	unsigned IoUring::space() const
+	{
+		return sqEntries - (localTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE));
+	}
+
+	/**
+	 * Returns a cleared submission entry, submitting the prepared ones when the ring is full
+	 */
+	void *IoUring::nextSqe()
+	{
+		if (space() == 0 && (submit() < 0 || space() == 0)) return nullptr;
+		io_uring_sqe *sqe = (io_uring_sqe *)sqeMemory + (localTail & sqMask);
+		std::memset(sqe, 0, sizeof(*sqe));
+		localTail++;
+		return sqe;
+	}
+
+	/**
+	 * Prepares a read that stays posted, and completes with a provided buffer each
+	 *  time bytes come in, until it fails, is cancelled or runs out of buffers
+	 */
+	bool IoUring::prepareReadMultishot(int fd, uint64_t userData)
+	{
+		io_uring_sqe *sqe = (io_uring_sqe *)nextSqe();
+		if (sqe == nullptr) return false;
+		sqe->opcode = ReadMultishotOp;
+		sqe->fd = fd;
+		sqe->flags = IOSQE_BUFFER_SELECT;
+		sqe->buf_group = BufferGroup;
+		sqe->user_data = userData;
+		return true;
+	}
+
+	/**
+	 * Prepares a read into a buffer of the caller
+	 */
+	bool IoUring::prepareRead(int fd, void *buffer, unsigned size, uint64_t userData)
+	{
+		io_uring_sqe *sqe = (io_uring_sqe *)nextSqe();
+		if (sqe == nullptr) return false;
+		sqe->opcode = IORING_OP_READ;
+		sqe->fd = fd;
+		sqe->addr = (uint64_t)(uintptr_t)buffer;
+		sqe->len = size;
+		sqe->off = (uint64_t)-1;
+		sqe->user_data = userData;
+		return true;
+	}
+
+	/**
+	 * Prepares a write. With linkNext, the next prepared entry starts only after this
+	 *  one wrote all its bytes, and is cancelled otherwise
+	 */
+	bool IoUring::prepareWrite(int fd, const void *data, unsigned size, uint64_t userData, bool linkNext)
+	{
+		io_uring_sqe *sqe = (io_uring_sqe *)nextSqe();
+		if (sqe == nullptr) return false;
+		sqe->opcode = IORING_OP_WRITE;
+		sqe->fd = fd;
+		sqe->flags = linkNext ? IOSQE_IO_LINK : 0;
+		sqe->addr = (uint64_t)(uintptr_t)data;
+		sqe->len = size;
+		sqe->off = (uint64_t)-1;
+		sqe->user_data = userData;
+		return true;
+	}
+
+	/**
+	 * Prepares the cancel of the requests tagged target
+	 */
+	bool IoUring::prepareCancel(uint64_t target, uint64_t userData)
+	{
+		io_uring_sqe *sqe = (io_uring_sqe *)nextSqe();
+		if (sqe == nullptr) return false;
+		sqe->opcode = IORING_OP_ASYNC_CANCEL;
+		sqe->fd = -1;
+		sqe->addr = target;
+		sqe->cancel_flags = IORING_ASYNC_CANCEL_ALL;
+		sqe->user_data = userData;
+		return true;
+	}
+
+	/**
+	 * Prepares the cancel of every request
+	 */
+	bool IoUring::prepareCancelAll(uint64_t userData)
+	{
+		io_uring_sqe *sqe = (io_uring_sqe *)nextSqe();
+		if (sqe == nullptr) return false;
+		sqe->opcode = IORING_OP_ASYNC_CANCEL;
+		sqe->fd = -1;
+		sqe->cancel_flags = IORING_ASYNC_CANCEL_ANY;
+		sqe->user_data = userData;
+		return true;
+	}
+
+	/**
+	 * Hands the prepared entries to the kernel. Returns their number, or -errno
+	 */
+	int IoUring::submit()
+	{
+		unsigned count = localTail - submitted;
+		if (count == 0) return 0;
+		__atomic_store_n(sqTail, localTail, __ATOMIC_RELEASE);
+		int result;
+		do result = (int)syscall(__NR_io_uring_enter, ringFd, count, 0, 0, nullptr, 0);
+		while (result < 0 && errno == EINTR);
+		if (result < 0) return -errno;
+		submitted += (unsigned)result;
+		return result;
+	}
+
+	/**
+	 * Waits up to timeoutMs, -1 for no limit, for a completion. Does not touch the
+	 *  submission ring, so that entries may be prepared and submitted meanwhile.
+	 *  Returns 0, also when the time ran out, or -errno
+	 */
+	int IoUring::wait(int timeoutMs)
+	{
+		__kernel_timespec timeout = { timeoutMs / 1000, (long long)(timeoutMs % 1000) * 1000000 };
+		io_uring_getevents_arg argument;
+		std::memset(&argument, 0, sizeof(argument));
+		argument.sigmask_sz = _NSIG / 8;
+		argument.ts = timeoutMs >= 0 ? (uint64_t)(uintptr_t)&timeout : 0;
+		int result = (int)syscall(__NR_io_uring_enter, ringFd, 0, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+			&argument, sizeof(argument));
+		if (result < 0 && errno != EINTR && errno != ETIME) return -errno;
+		return 0;
+	}
+
+	/**
+	 * Takes the next completion off the ring. Returns false if there is none
+	 */
+	bool IoUring::nextCompletion(Completion &completion)
+	{
+		unsigned head = *cqHead;
+		if (head == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) return false;
+		const io_uring_cqe &cqe = ((const io_uring_cqe *)cqes)[head & cqMask];
+		completion.userData = cqe.user_data;
+		completion.result = cqe.res;
+		completion.flags = cqe.flags;
+		__atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+		return true;
+	}
+
+	/**
+	 * Returns if a provided buffer holds the bytes of the completion
+	 */
+	bool IoUring::hasBuffer(const Completion &completion)
+	{
+		return (completion.flags & IORING_CQE_F_BUFFER) != 0;
+	}
+
+	/**
+	 * Returns if the request stays posted and completes again
+	 */
+	bool IoUring::hasMore(const Completion &completion)
+	{
+		return (completion.flags & IORING_CQE_F_MORE) != 0;
+	}
+
+	/**
+	 * Returns the provided buffer of a completion
+	 */
+	const char *IoUring::buffer(const Completion &completion) const
+	{
+		return buffers + (std::size_t)(completion.flags >> IORING_CQE_BUFFER_SHIFT) * bufferSize;
+	}
+
+	/**
+	 * Hands the buffer of a completion back to the kernel
+	 */
+	void IoUring::recycleBuffer(const Completion &completion)
+	{
+		provideBuffer((uint16_t)(completion.flags >> IORING_CQE_BUFFER_SHIFT));
+	}
+
+	/**
+	 * Adds a buffer to the provided buffer ring
+	 */
+	void IoUring::provideBuffer(uint16_t id)
+	{
+		// The ring is an array of io_uring_buf, the tail overlays resv of the first. Not
+		//  io_uring_buf_ring: its flexible array is misplaced when compiled as C++
+		io_uring_buf *ring = (io_uring_buf *)bufferRing;
+		io_uring_buf &entry = ring[bufferTail & (bufferCount - 1)];
+		entry.addr = (uint64_t)(uintptr_t)(buffers + (std::size_t)id * bufferSize);
+		entry.len = bufferSize;
+		entry.bid = id;
+		bufferTail++;
+		__atomic_store_n(&ring[0].resv, bufferTail, __ATOMIC_RELEASE);
+	}
+#else
+	// Without io_uring headers, open fails and the EventLoop uses epoll
+	IoUring::IoUring() {}
+	IoUring::~IoUring() {}
+	bool IoUring::open(unsigned, unsigned, unsigned, unsigned) { return false; }
+	void IoUring::close() {}
+	unsigned IoUring::space() const { return 0; }
+	void *IoUring::nextSqe() { return nullptr; }
+	bool IoUring::prepareReadMultishot(int, uint64_t) { return false; }
+	bool IoUring::prepareRead(int, void *, unsigned, uint64_t) { return false; }
+	bool IoUring::prepareWrite(int, const void *, unsigned, uint64_t, bool) { return false; }
+	bool IoUring::prepareCancel(uint64_t, uint64_t) { return false; }
+	bool IoUring::prepareCancelAll(uint64_t) { return false; }
+	int IoUring::submit() { return -1; }
+	int IoUring::wait(int) { return -1; }
+	bool IoUring::nextCompletion(Completion &) { return false; }
+	bool IoUring::hasBuffer(const Completion &) { return false; }
+	bool IoUring::hasMore(const Completion &) { return false; }
+	const char *IoUring::buffer(const Completion &) const { return nullptr; }
+	void IoUring::recycleBuffer(const Completion &) {}
+	void IoUring::provideBuffer(uint16_t) {}
+#endif
+}
@@ -0,0 +1,95 @@
+/*
+  CmdMessenger - library that provides command based messaging
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+  LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+  OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+  WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+  */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace CommandMessenger
+{
+	/**
+	 * Minimal io_uring on raw system calls, for the EventLoop: a submission and a
+	 *  completion ring, and one ring of provided buffers that multi-shot reads pick
+	 *  from. Not thread safe; the EventLoop serializes all calls
+	 */
+	class IoUring
+	{
+	public:
+		struct Completion
+		{
+			uint64_t userData;      // Tag of the submission
+			int32_t result;         // Bytes transferred, or -errno
+			uint32_t flags;         // IORING_CQE_F_* flags
+		};
+
+		IoUring();
+		~IoUring();
+
+		IoUring(const IoUring &) = delete;
+		IoUring &operator=(const IoUring &) = delete;
+
+		bool open(unsigned entries, unsigned completionEntries, unsigned bufferCount, unsigned bufferSize);
+		bool isOpen() const { return ringFd >= 0; }
+
+		unsigned space() const;
+		bool prepareReadMultishot(int fd, uint64_t userData);
+		bool prepareRead(int fd, void *buffer, unsigned size, uint64_t userData);
+		bool prepareWrite(int fd, const void *data, unsigned size, uint64_t userData, bool linkNext);
+		bool prepareCancel(uint64_t target, uint64_t userData);
+		bool prepareCancelAll(uint64_t userData);
+		int submit();
+		int wait(int timeoutMs);
+		bool nextCompletion(Completion &completion);
+
+		static bool hasBuffer(const Completion &completion);
+		static bool hasMore(const Completion &completion);
+		const char *buffer(const Completion &completion) const;
+		void recycleBuffer(const Completion &completion);
+
+	private:
+		int ringFd = -1;
+		void *ringMemory = nullptr;     // Submission and completion rings, mapped at once
+		std::size_t ringSize = 0;
+		void *sqeMemory = nullptr;      // Submission entries
+		std::size_t sqeSize = 0;
+		unsigned *sqHead = nullptr, *sqTail = nullptr, *sqArray = nullptr;
+		unsigned sqMask = 0, sqEntries = 0;
+		unsigned *cqHead = nullptr, *cqTail = nullptr;
+		unsigned cqMask = 0;
+		void *cqes = nullptr;
+		unsigned localTail = 0;         // Submission entries prepared, some not yet submitted
+		unsigned submitted = 0;         // Submission entries handed to the kernel
+
+		void *bufferRing = nullptr;     // Provided buffer ring, then the buffers
+		std::size_t bufferRingSize = 0;
+		char *buffers = nullptr;
+		unsigned bufferCount = 0, bufferSize = 0;
+		uint16_t bufferTail = 0;
+
+		void *nextSqe();
+		void provideBuffer(uint16_t id);
+		void close();
+	};
+}
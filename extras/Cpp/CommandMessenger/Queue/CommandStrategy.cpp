@@ -0,0 +1,53 @@
+/*
+  CmdMessenger - library that provides command based messaging
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+  LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+  OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+  WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+  */
+
+#include <CommandMessenger/Queue/CommandStrategy.h>
+#include <CommandMessenger/Queue/ListQueue.h>
+
+namespace CommandMessenger
+{
+	void CommandStrategy::enqueue(ListQueue &queue)
+	{
+		queue.enqueue(this);
+	}
+
+	void TopCommandStrategy::enqueue(ListQueue &queue)
+	{
+		queue.enqueueFront(this);
+	}
+
+	void CollapseCommandStrategy::enqueue(ListQueue &queue)
+	{
+		// If on the queue, replace with the new command, else add to the back
+		if (!queue.replaceFirst(this)) queue.enqueue(this);
+	}
+
+	void StaleGeneralStrategy::onDequeue(ListQueue &queue)
+	{
+		// Work from oldest to newest: once a command is fresh, the ones after it are too
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		while (queue.count() > 1 && now - queue.peek()->command.timeStamp > commandTimeOut)
+			queue.removeFront();
+	}
+}
@@ -0,0 +1,114 @@
+/*
+  CmdMessenger - library that provides command based messaging
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+  LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+  OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+  WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+  */
+
+#pragma once
+
+#include <CommandMessenger/Command.h>
+#include <CommandMessenger/Queue/MpscQueue.h>
+
+#include <chrono>
+#include <utility>
+
+namespace CommandMessenger
+{
+	class ListQueue;
+
+	/**
+	 * Base command strategy: the command is added to the back of the queue.
+	 *
+	 * A strategy wraps a command on its way through a SendCommandQueue. It is
+	 * applied by the sending thread, when it takes the command in, so it can look at
+	 * and change the queue without locks.
+	 */
+	class CommandStrategy : public MpscNode
+	{
+	public:
+		SendCommand command;            // The command wrapped in the strategy
+
+		explicit CommandStrategy(SendCommand command) : command(std::move(command)) {}
+		virtual ~CommandStrategy() = default;
+
+		/**
+		 * Adds this command (strategy) to the queue, which takes it over
+		 */
+		virtual void enqueue(ListQueue &queue);
+	};
+
+	/**
+	 * Top strategy: the command is added to the front of the queue
+	 */
+	class TopCommandStrategy : public CommandStrategy
+	{
+	public:
+		explicit TopCommandStrategy(SendCommand command) : CommandStrategy(std::move(command)) {}
+
+		void enqueue(ListQueue &queue) override;
+	};
+
+	/**
+	 * Collapse strategy: a command replaces the queued command with the same ID, in
+	 *  its place, so that the queue holds no duplicates of it and does not lag
+	 */
+	class CollapseCommandStrategy : public CommandStrategy
+	{
+	public:
+		explicit CollapseCommandStrategy(SendCommand command) : CommandStrategy(std::move(command)) {}
+
+		void enqueue(ListQueue &queue) override;
+	};
+
+	/**
+	 * Base of general strategies, applied to all queued and dequeued commands
+	 */
+	class GeneralStrategy
+	{
+	public:
+		virtual ~GeneralStrategy() = default;
+
+		/**
+		 * Called after a command (strategy) was added to the queue
+		 */
+		virtual void onEnqueue(ListQueue &) {}
+
+		/**
+		 * Called after a command (strategy) was taken off the queue to be sent
+		 */
+		virtual void onDequeue(ListQueue &) {}
+	};
+
+	/**
+	 * Stale strategy: commands older than the time out are removed from the queue.
+	 *  The last command is kept
+	 */
+	class StaleGeneralStrategy : public GeneralStrategy
+	{
+	private:
+		std::chrono::milliseconds commandTimeOut; // Age at which a queued command is stale
+
+	public:
+		explicit StaleGeneralStrategy(std::chrono::milliseconds commandTimeOut) : commandTimeOut(commandTimeOut) {}
+
+		void onDequeue(ListQueue &queue) override;
+	};
+}
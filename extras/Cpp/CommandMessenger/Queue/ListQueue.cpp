@@ -0,0 +1,117 @@
+/*
+  CmdMessenger - library that provides command based messaging
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+  LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+  OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+  WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+  */
+
+#include <CommandMessenger/Queue/ListQueue.h>
+
+namespace CommandMessenger
+{
+	/**
+	 * Deletes the strategies still queued
+	 */
+	ListQueue::~ListQueue()
+	{
+		clear();
+	}
+
+	/**
+	 * Adds a strategy to the back of the queue
+	 */
+	void ListQueue::enqueue(CommandStrategy *strategy)
+	{
+		Position position = items.insert(items.end(), strategy);
+		byId[strategy->command.cmdId].push_back(position);
+	}
+
+	/**
+	 * Adds a strategy to the front of the queue
+	 */
+	void ListQueue::enqueueFront(CommandStrategy *strategy)
+	{
+		Position position = items.insert(items.begin(), strategy);
+		byId[strategy->command.cmdId].push_front(position);
+	}
+
+	/**
+	 * Puts a strategy in the place of the oldest queued one with the same command ID,
+	 *  which is deleted. Returns false if there is none
+	 */
+	bool ListQueue::replaceFirst(CommandStrategy *strategy)
+	{
+		std::unordered_map<int, std::deque<Position>>::iterator found = byId.find(strategy->command.cmdId);
+		if (found == byId.end()) return false;
+		Position position = found->second.front();
+		delete *position;
+		*position = strategy;
+		return true;
+	}
+
+	/**
+	 * Returns the strategy at the front of the queue, or nullptr if it is empty
+	 */
+	CommandStrategy *ListQueue::peek() const
+	{
+		return items.empty() ? nullptr : items.front();
+	}
+
+	/**
+	 * Takes the strategy at the front off the queue. Returns nullptr if it is empty
+	 */
+	std::unique_ptr<CommandStrategy> ListQueue::dequeue()
+	{
+		if (items.empty()) return nullptr;
+		std::unique_ptr<CommandStrategy> strategy(items.front());
+		unindex(items.begin());
+		items.pop_front();
+		return strategy;
+	}
+
+	/**
+	 * Deletes the strategy at the front of the queue
+	 */
+	void ListQueue::removeFront()
+	{
+		dequeue();
+	}
+
+	/**
+	 * Deletes all queued strategies
+	 */
+	void ListQueue::clear()
+	{
+		for (CommandStrategy *strategy : items) delete strategy;
+		items.clear();
+		byId.clear();
+	}
+
+	/**
+	 * Drops the index of the front item. Commands leave from the front only, so it is
+	 *  the oldest of its command ID
+	 */
+	void ListQueue::unindex(Position position)
+	{
+		std::unordered_map<int, std::deque<Position>>::iterator found = byId.find((*position)->command.cmdId);
+		found->second.pop_front();
+		if (found->second.empty()) byId.erase(found);
+	}
+}
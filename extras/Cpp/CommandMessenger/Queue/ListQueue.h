@@ -0,0 +1,70 @@
+/*
+  CmdMessenger - library that provides command based messaging
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+  LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+  OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+  WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+  */
+
+#pragma once
+
+#include <CommandMessenger/Queue/CommandStrategy.h>
+
+#include <cstddef>
+#include <deque>
+#include <list>
+#include <memory>
+#include <unordered_map>
+
+namespace CommandMessenger
+{
+	/**
+	 * Queue of command strategies, owned by the sending thread of a SendCommandQueue.
+	 *  Holds the strategies it is given, and indexes them by command ID, so that a
+	 *  collapse finds the queued command without a search
+	 */
+	class ListQueue
+	{
+	private:
+		typedef std::list<CommandStrategy *>::iterator Position;
+
+		std::list<CommandStrategy *> items; // Oldest first
+		std::unordered_map<int, std::deque<Position>> byId; // Positions of each command ID, oldest first
+
+		void unindex(Position position);
+
+	public:
+		ListQueue() = default;
+		~ListQueue();
+
+		ListQueue(const ListQueue &) = delete;
+		ListQueue &operator=(const ListQueue &) = delete;
+
+		void enqueue(CommandStrategy *strategy);
+		void enqueueFront(CommandStrategy *strategy);
+		bool replaceFirst(CommandStrategy *strategy);
+		CommandStrategy *peek() const;
+		std::unique_ptr<CommandStrategy> dequeue();
+		void removeFront();
+		void clear();
+
+		std::size_t count() const { return items.size(); }
+		bool isEmpty() const { return items.empty(); }
+	};
+}
@@ -0,0 +1,121 @@
+/*
+  CmdMessenger - library that provides command based messaging
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+  LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+  OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+  WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+  */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+namespace CommandMessenger
+{
+	/**
+	 * Bounded lock-free queue for any number of producer and consumer threads.
+	 *
+	 * After Dmitry Vyukov's bounded MPMC queue: every slot has a sequence number
+	 * that tells whether it is free for the push at that position or holds the item
+	 * for the pop at that position. Threads claim positions with a compare and swap
+	 * on the head or the tail, and never wait for one another.
+	 */
+	template<class T>
+	class MpmcQueue
+	{
+	private:
+		static constexpr std::size_t CacheLine = 64;
+
+		struct Slot
+		{
+			std::atomic<std::size_t> sequence; // Position the slot is ready for
+			T item;
+		};
+
+		std::unique_ptr<Slot[]> slots;  // Ring of slots
+		std::size_t mask;               // Number of slots minus one
+
+		alignas(CacheLine) std::atomic<std::size_t> head{ 0 }; // Next position to pop
+		alignas(CacheLine) std::atomic<std::size_t> tail{ 0 }; // Next position to push
+
+	public:
+		/**
+		 * Queue of at least capacity slots
+		 */
+		explicit MpmcQueue(std::size_t capacity)
+		{
+			std::size_t size = 2;
+			while (size < capacity) size <<= 1;
+			slots.reset(new Slot[size]);
+			mask = size - 1;
+			for (std::size_t i = 0; i < size; i++)
+				slots[i].sequence.store(i, std::memory_order_relaxed);
+		}
+
+		MpmcQueue(const MpmcQueue &) = delete;
+		MpmcQueue &operator=(const MpmcQueue &) = delete;
+
+		/**
+		 * Adds an item. Returns false if the queue is full
+		 */
+		bool tryPush(T &&item)
+		{
+			std::size_t position = tail.load(std::memory_order_relaxed);
+			while (true) {
+				Slot &slot = slots[position & mask];
+				std::size_t sequence = slot.sequence.load(std::memory_order_acquire);
+				std::ptrdiff_t difference = (std::ptrdiff_t)sequence - (std::ptrdiff_t)position;
+				if (difference == 0) {
+					if (tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+						slot.item = std::move(item);
+						slot.sequence.store(position + 1, std::memory_order_release);
+						return true;
+					}
+				}
+				else if (difference < 0) return false;
+				else position = tail.load(std::memory_order_relaxed);
+			}
+		}
+
+		/**
+		 * Takes the oldest item. Returns false if the queue is empty
+		 */
+		bool tryPop(T &item)
+		{
+			std::size_t position = head.load(std::memory_order_relaxed);
+			while (true) {
+				Slot &slot = slots[position & mask];
+				std::size_t sequence = slot.sequence.load(std::memory_order_acquire);
+				std::ptrdiff_t difference = (std::ptrdiff_t)sequence - (std::ptrdiff_t)(position + 1);
+				if (difference == 0) {
+					if (head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+						item = std::move(slot.item);
+						slot.sequence.store(position + mask + 1, std::memory_order_release);
+						return true;
+					}
+				}
+				else if (difference < 0) return false;
+				else position = head.load(std::memory_order_relaxed);
+			}
+		}
+	};
+}
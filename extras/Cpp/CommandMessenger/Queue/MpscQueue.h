@@ -0,0 +1,112 @@
+/*
+  CmdMessenger - library that provides command based messaging
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+  LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+  OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+  WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+  */
+
+#pragma once
+
+#include <atomic>
+
+namespace CommandMessenger
+{
+	/**
+	 * Link of an item in an MpscQueue. Items derive from it
+	 */
+	struct MpscNode
+	{
+		std::atomic<MpscNode *> mpscNext{ nullptr };
+	};
+
+	/**
+	 * Unbounded lock-free queue for any number of producer threads and one consumer
+	 *  thread, intrusive so that pushing does not allocate (Vyukov's design).
+	 *
+	 * A producer swaps itself in as the head and then links the item it replaced to
+	 * it: one atomic exchange, no retries. The consumer walks the links from the tail.
+	 * A pop that finds a producer between its two steps returns nullptr, though the
+	 * queue is not empty; that producer is about to finish.
+	 */
+	template<class T>
+	class MpscQueue
+	{
+	private:
+		std::atomic<MpscNode *> head;   // Last pushed item, written by the producers
+		MpscNode *tail;                 // Next item to pop, or the stub, owned by the consumer
+		MpscNode stub;                  // Stands in when all items are popped
+
+		void pushNode(MpscNode *node)
+		{
+			node->mpscNext.store(nullptr, std::memory_order_relaxed);
+			MpscNode *previous = head.exchange(node, std::memory_order_acq_rel);
+			previous->mpscNext.store(node, std::memory_order_release);
+		}
+
+	public:
+		MpscQueue() : head(&stub), tail(&stub) {}
+
+		MpscQueue(const MpscQueue &) = delete;
+		MpscQueue &operator=(const MpscQueue &) = delete;
+
+		/**
+		 * Adds an item, from any thread. The queue holds it until it is popped
+		 */
+		void push(T *item)
+		{
+			pushNode(item);
+		}
+
+		/**
+		 * Takes the oldest item off, from the consumer thread. Returns nullptr if there
+		 *  is none, or a producer is still linking it in
+		 */
+		T *tryPop()
+		{
+			MpscNode *node = tail;
+			MpscNode *next = node->mpscNext.load(std::memory_order_acquire);
+			if (node == &stub) {
+				if (next == nullptr) return nullptr;
+				tail = next;
+				node = next;
+				next = next->mpscNext.load(std::memory_order_acquire);
+			}
+			if (next != nullptr) {
+				tail = next;
+				return static_cast<T *>(node);
+			}
+			// The last item: it can only be taken once the stub is queued behind it
+			if (node != head.load(std::memory_order_acquire)) return nullptr;
+			pushNode(&stub);
+			next = node->mpscNext.load(std::memory_order_acquire);
+			if (next == nullptr) return nullptr;
+			tail = next;
+			return static_cast<T *>(node);
+		}
+
+		/**
+		 * Returns if no item is queued, from the consumer thread
+		 */
+		bool empty() const
+		{
+			return tail == &stub && head.load(std::memory_order_acquire) == &stub;
+		}
+	};
+}
@@ -0,0 +1,214 @@
+/*
+  CmdMessenger - library that provides command based messaging
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+  LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+  OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+  WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+  */
+
+#include <CommandMessenger/Queue/SendCommandQueue.h>
+#include <CommandMessenger/CmdMessenger.h>
+
+namespace CommandMessenger
+{
+	/**
+	 * SendCommandQueue constructor. Add general strategies, then start
+	 */
+	SendCommandQueue::SendCommandQueue(CmdMessenger &messenger, std::size_t sendBufferMaxLength, std::size_t maxQueueLength)
+		: messenger(messenger), sendBufferMaxLength(sendBufferMaxLength), maxQueueLength(maxQueueLength)
+	{
+	}
+
+	/**
+	 * Stops the sending thread; commands still queued are not sent
+	 */
+	SendCommandQueue::~SendCommandQueue()
+	{
+		stop();
+	}
+
+	/**
+	 * Sends a command. Note that the command is put at the front of the queue
+	 */
+	void SendCommandQueue::sendCommand(SendCommand command)
+	{
+		queueCommand(std::unique_ptr<CommandStrategy>(new TopCommandStrategy(std::move(command))));
+	}
+
+	/**
+	 * Queues a command at the back of the queue
+	 */
+	void SendCommandQueue::queueCommand(SendCommand command)
+	{
+		queueCommand(std::unique_ptr<CommandStrategy>(new CommandStrategy(std::move(command))));
+	}
+
+	/**
+	 * Queues a command wrapped in a strategy, from any thread. Waits while the queue
+	 *  holds maxQueueLength commands
+	 */
+	void SendCommandQueue::queueCommand(std::unique_ptr<CommandStrategy> strategy)
+	{
+		while ((std::size_t)queuedCount.load(std::memory_order_relaxed) >= maxQueueLength && running && !suspended)
+			std::this_thread::yield();
+		strategy->command.timeStamp = std::chrono::steady_clock::now();
+		queuedCount.fetch_add(1, std::memory_order_relaxed);
+		incoming.push(strategy.release());
+		signalWorker();
+	}
+
+	/**
+	 * Adds a general strategy, applied to all queued and dequeued commands. Add them
+	 *  before start
+	 */
+	void SendCommandQueue::addGeneralStrategy(std::unique_ptr<GeneralStrategy> generalStrategy)
+	{
+		if (running) return;
+		generalStrategies.push_back(std::move(generalStrategy));
+	}
+
+	/**
+	 * Starts the sending thread
+	 */
+	void SendCommandQueue::start()
+	{
+		if (running.exchange(true)) return;
+		worker = std::thread(&SendCommandQueue::run, this);
+	}
+
+	/**
+	 * Stops the sending thread and drops the queued commands
+	 */
+	void SendCommandQueue::stop()
+	{
+		running = false;
+		{
+			std::lock_guard<std::mutex> lock(waitMutex);
+			wakeUp.notify_all();
+		}
+		if (worker.joinable()) worker.join();
+		// Commands still being pushed are left to the destructor of the queue
+		while (CommandStrategy *strategy = incoming.tryPop()) {
+			delete strategy;
+			queuedCount--;
+		}
+		queuedCount -= (std::ptrdiff_t)queue.count();
+		queue.clear();
+	}
+
+	/**
+	 * Holds the commands on the queue until resume
+	 */
+	void SendCommandQueue::suspend()
+	{
+		suspended = true;
+	}
+
+	/**
+	 * Sends the commands on the queue again
+	 */
+	void SendCommandQueue::resume()
+	{
+		suspended = false;
+		std::lock_guard<std::mutex> lock(waitMutex);
+		wakeUp.notify_all();
+	}
+
+	/**
+	 * Wakes the sending thread if it sleeps
+	 */
+	void SendCommandQueue::signalWorker()
+	{
+		// Pairs with the fence in run: either the worker sees the command, or we see it sleep
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (waiting.load(std::memory_order_relaxed)) {
+			std::lock_guard<std::mutex> lock(waitMutex);
+			wakeUp.notify_one();
+		}
+	}
+
+	/**
+	 * Sending thread
+	 */
+	void SendCommandQueue::run()
+	{
+		while (running) {
+			if (!suspended) {
+				takeIncoming();
+				if (!queue.isEmpty()) {
+					sendCommandsFromQueue();
+					continue;
+				}
+			}
+			std::unique_lock<std::mutex> lock(waitMutex);
+			waiting.store(true, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (running && (suspended || incoming.empty())) wakeUp.wait(lock);
+			waiting.store(false, std::memory_order_relaxed);
+		}
+	}
+
+	/**
+	 * Applies the strategies of the commands queued since the last call, in order
+	 */
+	void SendCommandQueue::takeIncoming()
+	{
+		while (CommandStrategy *strategy = incoming.tryPop()) {
+			std::size_t before = queue.count();
+			strategy->enqueue(queue);
+			for (std::unique_ptr<GeneralStrategy> &generalStrategy : generalStrategies) generalStrategy->onEnqueue(queue);
+			// A collapsed command replaced one: the queue did not grow
+			queuedCount -= (std::ptrdiff_t)before + 1 - (std::ptrdiff_t)queue.count();
+		}
+	}
+
+	/**
+	 * Takes the front command off the queue, and applies the general strategies
+	 */
+	std::unique_ptr<CommandStrategy> SendCommandQueue::dequeue()
+	{
+		std::size_t before = queue.count();
+		std::unique_ptr<CommandStrategy> strategy = queue.dequeue();
+		for (std::unique_ptr<GeneralStrategy> &generalStrategy : generalStrategies) generalStrategy->onDequeue(queue);
+		queuedCount -= (std::ptrdiff_t)(before - queue.count());
+		return strategy;
+	}
+
+	/**
+	 * Sends the commands from the queue. Commands are joined until sendBufferMaxLength
+	 *  is reached, or a command requires an acknowledge; that one is sent on its own
+	 */
+	void SendCommandQueue::sendCommandsFromQueue()
+	{
+		std::string sendBuffer;
+		int commandCount = 0;
+		while (sendBuffer.size() < sendBufferMaxLength && !queue.isEmpty()) {
+			if (queue.peek()->command.reqAc) {
+				if (commandCount > 0) break;
+				std::unique_ptr<CommandStrategy> strategy = dequeue();
+				messenger.sendCommand(strategy->command);
+				continue;
+			}
+			std::unique_ptr<CommandStrategy> strategy = dequeue();
+			sendBuffer += strategy->command.commandString(messenger.escapeChars, messenger.printNewlines);
+			commandCount++;
+		}
+		if (!sendBuffer.empty()) messenger.sendString(sendBuffer);
+	}
+}
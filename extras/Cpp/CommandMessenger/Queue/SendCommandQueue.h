@@ -0,0 +1,99 @@
+/*
+  CmdMessenger - library that provides command based messaging
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+  LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+  OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+  WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+  */
+
+#pragma once
+
+#include <CommandMessenger/Command.h>
+#include <CommandMessenger/Queue/CommandStrategy.h>
+#include <CommandMessenger/Queue/ListQueue.h>
+#include <CommandMessenger/Queue/MpscQueue.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace CommandMessenger
+{
+	class CmdMessenger;
+
+	/**
+	 * Queue of commands to send, with strategies, like the one of the C# library.
+	 *
+	 * Any thread queues a command wrapped in a strategy; that is one push on a
+	 * lock-free queue. A sending thread takes the strategies in, applies them to its
+	 * own ListQueue, and sends the commands from the front: commands without an
+	 * acknowledge are joined until sendBufferMaxLength bytes, a command that waits
+	 * for an acknowledge is sent on its own. General strategies are applied to every
+	 * command taken in and sent.
+	 */
+	class SendCommandQueue
+	{
+	private:
+		CmdMessenger &messenger;
+		std::size_t sendBufferMaxLength; // Bytes of commands joined into one write
+		std::size_t maxQueueLength;     // Commands queued before queueCommand waits
+		MpscQueue<CommandStrategy> incoming; // Strategies not yet taken in by the sending thread
+		ListQueue queue;                // Commands to send, owned by the sending thread
+		std::vector<std::unique_ptr<GeneralStrategy>> generalStrategies;
+		std::atomic<std::ptrdiff_t> queuedCount{ 0 }; // Commands in incoming and queue
+
+		std::thread worker;             // Sending thread
+		std::atomic<bool> running{ false };
+		std::atomic<bool> suspended{ false };
+		std::atomic<bool> waiting{ false }; // Indicates if the sending thread sleeps
+		std::mutex waitMutex;
+		std::condition_variable wakeUp;
+
+		void run();
+		void takeIncoming();
+		void sendCommandsFromQueue();
+		std::unique_ptr<CommandStrategy> dequeue();
+		void signalWorker();
+
+	public:
+		explicit SendCommandQueue(CmdMessenger &messenger, std::size_t sendBufferMaxLength = 62,
+			std::size_t maxQueueLength = 5000);
+		~SendCommandQueue();
+
+		SendCommandQueue(const SendCommandQueue &) = delete;
+		SendCommandQueue &operator=(const SendCommandQueue &) = delete;
+
+		void sendCommand(SendCommand command);
+		void queueCommand(SendCommand command);
+		void queueCommand(std::unique_ptr<CommandStrategy> strategy);
+		void addGeneralStrategy(std::unique_ptr<GeneralStrategy> generalStrategy);
+
+		void start();
+		void stop();
+		void suspend();
+		void resume();
+		bool isRunning() const { return running; }
+		bool isSuspended() const { return suspended; }
+		std::size_t count() const { return (std::size_t)queuedCount.load(); }
+	};
+}
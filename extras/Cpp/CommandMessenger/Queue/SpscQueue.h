@@ -0,0 +1,109 @@
+/*
+  CmdMessenger - library that provides command based messaging
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+  LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+  OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+  WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+  */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+namespace CommandMessenger
+{
+	/**
+	 * Bounded lock-free queue for one producer thread and one consumer thread.
+	 *
+	 * A ring of a power of two slots. The producer only writes the tail and the
+	 * consumer only writes the head, each on its own cache line, and each keeps a
+	 * copy of the other index so that it only reads the shared one when the ring
+	 * looks full or empty.
+	 */
+	template<class T>
+	class SpscQueue
+	{
+	private:
+		static constexpr std::size_t CacheLine = 64;
+
+		std::unique_ptr<T[]> slots;     // Ring of slots
+		std::size_t mask;               // Number of slots minus one
+
+		alignas(CacheLine) std::atomic<std::size_t> head{ 0 }; // Next slot to pop, written by the consumer
+		std::size_t cachedTail = 0;     // Consumer copy of the tail
+		alignas(CacheLine) std::atomic<std::size_t> tail{ 0 }; // Next slot to push, written by the producer
+		std::size_t cachedHead = 0;     // Producer copy of the head
+
+	public:
+		/**
+		 * Queue of at least capacity slots
+		 */
+		explicit SpscQueue(std::size_t capacity)
+		{
+			std::size_t size = 2;
+			while (size < capacity) size <<= 1;
+			slots.reset(new T[size]);
+			mask = size - 1;
+		}
+
+		SpscQueue(const SpscQueue &) = delete;
+		SpscQueue &operator=(const SpscQueue &) = delete;
+
+		/**
+		 * Adds an item, from the producer thread. Returns false if the queue is full
+		 */
+		bool tryPush(T &&item)
+		{
+			std::size_t position = tail.load(std::memory_order_relaxed);
+			if (position - cachedHead > mask) {
+				cachedHead = head.load(std::memory_order_acquire);
+				if (position - cachedHead > mask) return false;
+			}
+			slots[position & mask] = std::move(item);
+			tail.store(position + 1, std::memory_order_release);
+			return true;
+		}
+
+		/**
+		 * Takes the oldest item, from the consumer thread. Returns false if the queue is empty
+		 */
+		bool tryPop(T &item)
+		{
+			std::size_t position = head.load(std::memory_order_relaxed);
+			if (position == cachedTail) {
+				cachedTail = tail.load(std::memory_order_acquire);
+				if (position == cachedTail) return false;
+			}
+			item = std::move(slots[position & mask]);
+			head.store(position + 1, std::memory_order_release);
+			return true;
+		}
+
+		/**
+		 * Returns if the queue is empty. Exact from the consumer thread only
+		 */
+		bool empty() const
+		{
+			return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+		}
+	};
+}
@@ -0,0 +1,141 @@
+/*
+  CmdMessenger - library that provides command based messaging
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+  LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+  OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+  WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+  */
+
+#include <CommandMessenger/Transport/FdTransport.h>
+
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+namespace CommandMessenger
+{
+	/**
+	 * FdTransport constructor. Takes over the descriptor
+	 */
+	FdTransport::FdTransport(int fd)
+		: fd(fd)
+	{
+		if (pipe2(wakeFds, O_CLOEXEC | O_NONBLOCK) != 0) {
+			wakeFds[0] = -1;
+			wakeFds[1] = -1;
+		}
+	}
+
+	/**
+	 * Closes the descriptor and the wake pipe
+	 */
+	FdTransport::~FdTransport()
+	{
+		if (fd >= 0) close(fd);
+		if (wakeFds[0] >= 0) close(wakeFds[0]);
+		if (wakeFds[1] >= 0) close(wakeFds[1]);
+	}
+
+	/**
+	 * Replaces the descriptor, closing the one held before
+	 */
+	void FdTransport::setFileDescriptor(int newFd)
+	{
+		if (fd >= 0 && fd != newFd) close(fd);
+		fd = newFd;
+	}
+
+	/**
+	 * Connects the transport if it holds a descriptor
+	 */
+	bool FdTransport::connect()
+	{
+		if (fd < 0 || wakeFds[0] < 0) return false;
+		// Forget wake ups of an earlier disconnect
+		char drain[16];
+		while (::read(wakeFds[0], drain, sizeof(drain)) > 0);
+		connected = true;
+		return true;
+	}
+
+	/**
+	 * Disconnects the transport, a blocked read returns 0
+	 */
+	bool FdTransport::disconnect()
+	{
+		if (!connected.exchange(false)) return false;
+		char wake = 0;
+		while (::write(wakeFds[1], &wake, 1) < 0 && errno == EINTR);
+		return true;
+	}
+
+	/**
+	 * Returns if the transport is connected
+	 */
+	bool FdTransport::isConnected() const
+	{
+		return connected;
+	}
+
+	/**
+	 * Waits for bytes on the descriptor or a disconnect, and reads what is there
+	 */
+	std::size_t FdTransport::read(char *buffer, std::size_t size)
+	{
+		while (connected) {
+			pollfd fds[2] = { { fd, POLLIN, 0 }, { wakeFds[0], POLLIN, 0 } };
+			int ready = poll(fds, 2, -1);
+			if (ready < 0) {
+				if (errno == EINTR) continue;
+				break;
+			}
+			if (fds[1].revents != 0 || !connected) return 0;
+			if (fds[0].revents == 0) continue;
+			ssize_t length = ::read(fd, buffer, size);
+			if (length > 0) return (std::size_t)length;
+			if (length < 0 && (errno == EINTR || errno == EAGAIN)) continue;
+			// End of file, or the device is gone
+			connected = false;
+			break;
+		}
+		return 0;
+	}
+
+	/**
+	 * Writes all bytes, waiting for room on a non blocking descriptor
+	 */
+	bool FdTransport::write(const char *data, std::size_t size)
+	{
+		while (size > 0) {
+			if (!connected) return false;
+			ssize_t length = ::write(fd, data, size);
+			if (length < 0) {
+				if (errno == EINTR) continue;
+				if (errno != EAGAIN) return false;
+				pollfd room = { fd, POLLOUT, 0 };
+				poll(&room, 1, 100);
+				continue;
+			}
+			data += length;
+			size -= (std::size_t)length;
+		}
+		return true;
+	}
+}
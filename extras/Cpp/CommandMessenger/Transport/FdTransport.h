@@ -0,0 +1,62 @@
+/*
+  CmdMessenger - library that provides command based messaging
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+  LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+  OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+  WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+  */
+
+#pragma once
+
+#include <CommandMessenger/Transport/ITransport.h>
+
+#include <atomic>
+
+namespace CommandMessenger
+{
+	/**
+	 * Transport over a file descriptor: a serial port, a pseudo terminal, a pipe or
+	 *  a socket. Owns the descriptor and closes it when destroyed
+	 */
+	class FdTransport : public ITransport
+	{
+	private:
+		int fd;                         // Descriptor read and written, -1 if none
+		int wakeFds[2];                 // Pipe that wakes a blocked read on disconnect
+		std::atomic<bool> connected{ false }; // Indicates if the transport is connected
+
+	protected:
+		void setFileDescriptor(int newFd);
+
+	public:
+		explicit FdTransport(int fd = -1);
+		~FdTransport() override;
+
+		FdTransport(const FdTransport &) = delete;
+		FdTransport &operator=(const FdTransport &) = delete;
+
+		bool connect() override;
+		bool disconnect() override;
+		bool isConnected() const override;
+		std::size_t read(char *buffer, std::size_t size) override;
+		bool write(const char *data, std::size_t size) override;
+
+		int fileDescriptor() const override { return fd; }
+	};
+}
@@ -0,0 +1,72 @@
+/*
+  CmdMessenger - library that provides command based messaging
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+  LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+  OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+  WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+  */
+
+#pragma once
+
+#include <cstddef>
+
+namespace CommandMessenger
+{
+	/**
+	 * Transport layer of a messenger. read is called from the reader thread of the
+	 *  messenger only, write from any thread, one at a time. An EventLoop reads from
+	 *  fileDescriptor itself instead of calling read
+	 */
+	class ITransport
+	{
+	public:
+		virtual ~ITransport() = default;
+
+		/**
+		 * Connects the transport. Returns true when connected
+		 */
+		virtual bool connect() = 0;
+
+		/**
+		 * Disconnects the transport, and wakes a read that is blocked
+		 */
+		virtual bool disconnect() = 0;
+
+		/**
+		 * Returns the connection status
+		 */
+		virtual bool isConnected() const = 0;
+
+		/**
+		 * Blocks until bytes come in and reads up to size of them. Returns the number
+		 *  of bytes read, or 0 once the transport is disconnected
+		 */
+		virtual std::size_t read(char *buffer, std::size_t size) = 0;
+
+		/**
+		 * Writes all bytes. Returns false if the transport failed
+		 */
+		virtual bool write(const char *data, std::size_t size) = 0;
+
+		/**
+		 * Returns the file descriptor an EventLoop can wait on, or -1 if there is none
+		 */
+		virtual int fileDescriptor() const { return -1; }
+	};
+}
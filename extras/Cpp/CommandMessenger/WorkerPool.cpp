@@ -0,0 +1,109 @@
+/*
+  CmdMessenger - library that provides command based messaging
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+  LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+  OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+  WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+  */
+
+#include <CommandMessenger/WorkerPool.h>
+#include <CommandMessenger/CmdMessenger.h>
+
+namespace CommandMessenger
+{
+	/**
+	 * WorkerPool constructor. maxMessengers is the number of messengers that may have
+	 *  received commands at the same time, at least the number of messengers
+	 */
+	WorkerPool::WorkerPool(std::size_t threads, std::size_t maxMessengers)
+		: ready(maxMessengers)
+	{
+		if (threads == 0) threads = 1;
+		for (std::size_t i = 0; i < threads; i++)
+			workers.emplace_back(&WorkerPool::run, this);
+	}
+
+	/**
+	 * Stops the workers. Commands that are still queued are handled first
+	 */
+	WorkerPool::~WorkerPool()
+	{
+		running = false;
+		{
+			std::lock_guard<std::mutex> lock(sleepMutex);
+			wakeUp.notify_all();
+		}
+		for (std::thread &worker : workers) worker.join();
+		while (runOne());
+	}
+
+	/**
+	 * Puts a messenger with received commands on the ready queue, and wakes a worker
+	 */
+	void WorkerPool::schedule(CmdMessenger *messenger)
+	{
+		while (!ready.tryPush(std::move(messenger))) std::this_thread::yield();
+		// Pairs with the fence in run: either the worker sees the messenger, or we see the worker sleep
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (sleepers.load(std::memory_order_relaxed) > 0) {
+			std::lock_guard<std::mutex> lock(sleepMutex);
+			wakeUp.notify_one();
+		}
+	}
+
+	/**
+	 * Handles the received commands of one ready messenger. Returns false if there is none
+	 */
+	bool WorkerPool::runOne()
+	{
+		CmdMessenger *messenger;
+		if (!ready.tryPop(messenger)) return false;
+		messenger->processReceived();
+		return true;
+	}
+
+	/**
+	 * Worker loop
+	 */
+	void WorkerPool::run()
+	{
+		const int spins = 64;
+		while (running) {
+			bool worked = false;
+			for (int i = 0; i < spins && !worked; i++) {
+				worked = runOne();
+				if (!worked) std::this_thread::yield();
+			}
+			if (worked) continue;
+
+			std::unique_lock<std::mutex> lock(sleepMutex);
+			sleepers.fetch_add(1, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			CmdMessenger *messenger;
+			if (ready.tryPop(messenger)) {
+				sleepers.fetch_sub(1, std::memory_order_relaxed);
+				lock.unlock();
+				messenger->processReceived();
+				continue;
+			}
+			if (running) wakeUp.wait(lock);
+			sleepers.fetch_sub(1, std::memory_order_relaxed);
+		}
+	}
+}
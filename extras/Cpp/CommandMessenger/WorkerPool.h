@@ -0,0 +1,74 @@
+/*
+  CmdMessenger - library that provides command based messaging
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+  LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+  OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+  WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+  */
+
+#pragma once
+
+#include <CommandMessenger/Queue/MpmcQueue.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace CommandMessenger
+{
+	class CmdMessenger;
+
+	/**
+	 * Threads that run the handlers of received commands, shared by any number of messengers.
+	 *
+	 * A messenger with received commands is put on a lock-free ready queue once, and
+	 * a worker takes it off and handles its commands in order. So the commands of one
+	 * device never run at the same time, while different devices are handled in
+	 * parallel. A worker that finds no work spins briefly, then sleeps until a
+	 * messenger is scheduled.
+	 */
+	class WorkerPool
+	{
+	private:
+		MpmcQueue<CmdMessenger *> ready; // Messengers with received commands
+		std::vector<std::thread> workers;
+		std::atomic<bool> running{ true };
+		std::atomic<int> sleepers{ 0 };  // Number of workers that wait for work
+		std::mutex sleepMutex;
+		std::condition_variable wakeUp;
+
+		void schedule(CmdMessenger *messenger);
+		bool runOne();
+		void run();
+
+		friend class CmdMessenger;
+
+	public:
+		explicit WorkerPool(std::size_t threads = std::thread::hardware_concurrency(), std::size_t maxMessengers = 1024);
+		~WorkerPool();
+
+		WorkerPool(const WorkerPool &) = delete;
+		WorkerPool &operator=(const WorkerPool &) = delete;
+
+		std::size_t size() const { return workers.size(); }
+	};
+}
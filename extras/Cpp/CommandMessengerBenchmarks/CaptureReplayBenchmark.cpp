@@ -0,0 +1,114 @@
+/*
+  CmdMessenger - library that provides command based messaging
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+  LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+  OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+  WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+  */
+
+// Replays the received bytes of a capture at full speed: through the parser alone,
+// and through a messenger that hands the commands to a worker. Reports bytes and
+// commands per second. Without a capture file, one with generated traffic is made.
+//
+// Usage: CaptureReplayBenchmark [capture file]
+
+#include <CommandMessenger/Capture/CaptureWriter.h>
+#include <CommandMessenger/Capture/ReplayDriver.h>
+#include <CommandMessenger/CmdMessenger.h>
+#include <CommandMessenger/Transport/FdTransport.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+using namespace CommandMessenger;
+
+static const long GeneratedCommands = 2000000; // Commands of the generated capture
+static const std::size_t ReadSize = 64;        // Bytes per record, about what a serial read returns
+
+/**
+ * Writes a capture of sensor readings with escaped text now and then, cut into
+ *  records like reads of a serial port
+ */
+static bool generateCapture(const std::string &path)
+{
+	CaptureWriter writer;
+	if (!writer.open(path)) return false;
+	std::string pending;
+	for (long i = 0; i < GeneratedCommands; i++) {
+		SendCommand command((int)(i % 16));
+		command.addArgument((int32_t)(i * 7919 % 100000));
+		command.addArgument((float)(i % 1000) / 8);
+		if (i % 10 == 0) command.addArgument("state,ok;1/2");
+		pending += command.commandString(Escaping(), i % 2 == 0);
+		while (pending.size() >= ReadSize) {
+			writer.record(CaptureDirection::Received, pending.data(), ReadSize);
+			pending.erase(0, ReadSize);
+		}
+	}
+	writer.record(CaptureDirection::Received, pending.data(), pending.size());
+	return writer.close();
+}
+
+int main(int argc, char **argv)
+{
+	std::string path;
+	if (argc > 1) path = argv[1];
+	else {
+		char generated[] = "/tmp/CaptureReplayBenchmark.XXXXXX";
+		int fd = mkstemp(generated);
+		if (fd < 0) return 1;
+		close(fd);
+		path = generated;
+		if (!generateCapture(path)) return 1;
+	}
+	CaptureReader capture;
+	if (!capture.open(path)) {
+		std::fprintf(stderr, "Cannot read capture %s\n", path.c_str());
+		return 1;
+	}
+	ReplayDriver driver(capture);
+
+	Escaping escaping;
+	CommandParser parser(escaping);
+	long lines = 0;
+	auto start = std::chrono::steady_clock::now();
+	std::size_t bytes = driver.replay(parser, [&](const char *, std::size_t) { lines++; });
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	std::printf("%-10s %10.1f MB/s %12.0f commands/s\n", "parser", bytes / elapsed.count() / 1e6, lines / elapsed.count());
+
+	WorkerPool pool(1);
+	FdTransport transport;
+	CmdMessenger messenger(transport, pool);
+	std::atomic<long> handled{ 0 };
+	messenger.attach([&](ReceivedCommand &) { handled.fetch_add(1, std::memory_order_relaxed); });
+	start = std::chrono::steady_clock::now();
+	bytes = driver.replay(messenger);
+	while (handled < lines) std::this_thread::yield();
+	elapsed = std::chrono::steady_clock::now() - start;
+	std::printf("%-10s %10.1f MB/s %12.0f commands/s\n", "messenger", bytes / elapsed.count() / 1e6, handled / elapsed.count());
+
+	if (capture.truncated()) std::printf("The capture ends inside a record\n");
+	if (argc <= 1) unlink(path.c_str());
+	return 0;
+}
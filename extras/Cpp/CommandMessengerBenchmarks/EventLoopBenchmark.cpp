@@ -0,0 +1,242 @@
+/*
+  CmdMessenger - library that provides command based messaging
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+  LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+  OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+  WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+  */
+
+// Compares a reader thread per device with one event loop for all devices, on
+// its epoll and io_uring backends, over pseudo terminals. Reports messages per
+// second and the CPU time they take, as the number of devices grows: received
+// from the devices, and sent to them.
+//
+// Usage: EventLoopBenchmark [devices ...]   (default 1 10 100 300)
+
+#include <CommandMessenger/CmdMessenger.h>
+#include <CommandMessenger/EventLoop.h>
+#include <CommandMessenger.Transport.Serial/SerialTransport.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <memory>
+#include <string>
+#include <sys/resource.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace CommandMessenger;
+
+static const long TotalMessages = 300000;       // Messages of a run, spread over the devices
+
+enum class Reader { Threads, Epoll, IoUring };
+
+struct Result
+{
+	double seconds;                 // Wall time from the first write to the last handled command
+	double cpuSeconds;              // CPU time of the host side, the simulated devices left out
+	long messages;
+};
+
+/**
+ * Returns the CPU time used so far by the process or by the calling thread
+ */
+static double cpuTime(int who)
+{
+	rusage usage;
+	getrusage(who, &usage);
+	return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+/**
+ * Per device count of handled commands, on a cache line of its own
+ */
+struct alignas(64) Counter
+{
+	long handled = 0;
+};
+
+/**
+ * Simulated devices on pseudo terminals, with the host side connected by the reader
+ */
+struct Bench
+{
+	EventLoop loop;
+	WorkerPool pool;
+	std::vector<int> masters;
+	std::vector<std::unique_ptr<SerialTransport>> transports;
+	std::vector<std::unique_ptr<CmdMessenger>> messengers;
+	std::vector<Counter> counters;
+	std::atomic<int> finished{ 0 };
+
+	Bench(Reader reader) : loop(reader == Reader::Epoll ? EventLoop::Backend::Epoll : EventLoop::Backend::IoUring) {}
+
+	~Bench()
+	{
+		messengers.clear();
+		for (int master : masters) close(master);
+	}
+
+	bool connect(Reader reader, int deviceCount, long perDevice)
+	{
+		if (reader != Reader::Threads && !loop.start()) return false;
+		if (reader == Reader::IoUring && loop.backend() != EventLoop::Backend::IoUring) {
+			std::fprintf(stderr, "No io_uring, the event loop uses epoll\n");
+			return false;
+		}
+		counters.resize(deviceCount);
+		for (int i = 0; i < deviceCount; i++) {
+			int master = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC | O_NONBLOCK);
+			if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+				std::fprintf(stderr, "No pseudo terminal for device %d\n", i);
+				if (master >= 0) close(master);
+				return false;
+			}
+			masters.push_back(master);
+			transports.emplace_back(new SerialTransport(ptsname(master)));
+			messengers.emplace_back(new CmdMessenger(*transports[i], pool));
+			messengers[i]->attach(1, [this, i, perDevice](ReceivedCommand &command) {
+				command.readInt32Arg();
+				if (++counters[i].handled == perDevice) finished++;
+			});
+			if (!(reader == Reader::Threads ? messengers[i]->connect() : messengers[i]->connect(loop))) return false;
+		}
+		return true;
+	}
+};
+
+/**
+ * The devices send commands as fast as the terminals take them
+ */
+static bool receive(Reader reader, int deviceCount, Result &result)
+{
+	long perDevice = TotalMessages / deviceCount;
+	std::string stream;
+	for (long n = 0; n < perDevice; n++) stream += "1," + std::to_string(n) + ",42;";
+	Bench bench(reader);
+	if (!bench.connect(reader, deviceCount, perDevice)) return false;
+
+	// The devices write on this thread, which is left out of the CPU time
+	std::vector<std::size_t> written(deviceCount, 0);
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	double cpuStart = cpuTime(RUSAGE_SELF) - cpuTime(RUSAGE_THREAD);
+	int done = 0;
+	while (done < deviceCount) {
+		bool progress = false;
+		for (int i = 0; i < deviceCount; i++) {
+			if (written[i] == stream.size()) continue;
+			ssize_t length = write(bench.masters[i], stream.data() + written[i], std::min<std::size_t>(4096, stream.size() - written[i]));
+			if (length <= 0) continue;
+			written[i] += (std::size_t)length;
+			if (written[i] == stream.size()) done++;
+			progress = true;
+		}
+		if (!progress) std::this_thread::sleep_for(std::chrono::microseconds(100));
+	}
+	while (bench.finished < deviceCount) std::this_thread::sleep_for(std::chrono::microseconds(100));
+	result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	result.cpuSeconds = cpuTime(RUSAGE_SELF) - cpuTime(RUSAGE_THREAD) - cpuStart;
+	result.messages = perDevice * deviceCount;
+	return true;
+}
+
+/**
+ * The host sends commands to every device from four threads, and the devices read them
+ */
+static bool send(Reader reader, int deviceCount, Result &result)
+{
+	const int senderCount = 4;
+	long perDevice = TotalMessages / deviceCount;
+	Bench bench(reader);
+	if (!bench.connect(reader, deviceCount, perDevice)) return false;
+
+	std::atomic<bool> draining{ true };
+	std::atomic<long> bytes{ 0 };
+	double drainCpu = 0;
+	std::thread drain([&] {
+		double drainStart = cpuTime(RUSAGE_THREAD);
+		char buffer[65536];
+		while (draining) {
+			bool progress = false;
+			for (int master : bench.masters) {
+				ssize_t length = read(master, buffer, sizeof(buffer));
+				if (length > 0) {
+					bytes += length;
+					progress = true;
+				}
+			}
+			if (!progress) std::this_thread::sleep_for(std::chrono::microseconds(100));
+		}
+		drainCpu = cpuTime(RUSAGE_THREAD) - drainStart;
+	});
+
+	long expected = 0;
+	for (long n = 0; n < perDevice; n++) expected += (long)(std::string("1,") + std::to_string(n) + ",42;").size();
+	expected *= deviceCount;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	double cpuStart = cpuTime(RUSAGE_SELF);
+	std::vector<std::thread> senders;
+	for (int s = 0; s < senderCount; s++)
+		senders.emplace_back([&, s] {
+			for (int i = s; i < deviceCount * (int)perDevice; i += senderCount) {
+				SendCommand command(1);
+				command.addArgument((int32_t)(i / deviceCount));
+				command.addArgument(42);
+				bench.messengers[i % deviceCount]->sendCommand(command);
+			}
+		});
+	for (std::thread &sender : senders) sender.join();
+	while (bytes < expected) std::this_thread::sleep_for(std::chrono::microseconds(100));
+	result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	draining = false;
+	drain.join();
+	result.cpuSeconds = cpuTime(RUSAGE_SELF) - cpuStart - drainCpu;
+	result.messages = perDevice * deviceCount;
+	return true;
+}
+
+int main(int argc, char **argv)
+{
+	std::vector<int> deviceCounts;
+	for (int i = 1; i < argc; i++) deviceCounts.push_back(std::atoi(argv[i]));
+	if (deviceCounts.empty()) deviceCounts = { 1, 10, 100, 300 };
+	const char *readerNames[] = { "threads", "epoll", "io_uring" };
+
+	std::printf("%d cores, %ld messages per run\n", (int)std::thread::hardware_concurrency(), TotalMessages);
+	std::printf("%-8s %8s  %-9s %12s %10s %14s\n", "", "devices", "reader", "messages/s", "CPU cores", "messages/CPU s");
+	for (bool sending : { false, true })
+		for (int deviceCount : deviceCounts) {
+			if (deviceCount <= 0) continue;
+			for (Reader reader : { Reader::Threads, Reader::Epoll, Reader::IoUring }) {
+				Result result;
+				if (!(sending ? send(reader, deviceCount, result) : receive(reader, deviceCount, result))) {
+					if (reader == Reader::IoUring) continue;
+					return 1;
+				}
+				std::printf("%-8s %8d  %-9s %12.0f %10.2f %14.0f\n", sending ? "send" : "receive", deviceCount,
+					readerNames[(int)reader], result.messages / result.seconds, result.cpuSeconds / result.seconds,
+					result.messages / result.cpuSeconds);
+			}
+		}
+	return 0;
+}
@@ -0,0 +1,221 @@
+/*
+  CmdMessenger - library that provides command based messaging
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+  LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+  OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+  WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+  */
+
+// Queues commands from many producer threads on a SendCommandQueue, and on a
+// queue that locks for every command and searches the queue for the command to
+// collapse, like the C# library does. Reports commands queued per second, until
+// the queue is empty, for plain commands and for commands collapsed over a set of
+// command IDs. The commands go to a transport that drops them.
+//
+// Usage: SendQueueBenchmark [producers ...]   (default 1 8 16)
+
+#include <CommandMessenger/CmdMessenger.h>
+#include <CommandMessenger/Queue/SendCommandQueue.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace CommandMessenger;
+
+static const long TotalCommands = 1000000;      // Commands of a run, spread over the producers
+static const int CollapseIds = 1000;            // Command IDs the collapsed commands are spread over
+
+/**
+ * Transport that counts the bytes written and drops them
+ */
+class NullTransport : public ITransport
+{
+public:
+	std::atomic<long> written{ 0 };
+
+	bool connect() override { return true; }
+	bool disconnect() override { return true; }
+	bool isConnected() const override { return true; }
+	std::size_t read(char *, std::size_t) override { return 0; }
+	bool write(const char *, std::size_t size) override { written += (long)size; return true; }
+};
+
+/**
+ * Send queue of the C# design: one lock for producers and the sending thread, and
+ *  a linear search for the command to collapse
+ */
+class LockedSendQueue
+{
+private:
+	ITransport &transport;
+	std::mutex mutex;
+	std::condition_variable wakeUp;
+	std::list<std::unique_ptr<CommandStrategy>> queue;
+	bool running = true;
+	std::thread worker;
+
+	void run()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		while (running || !queue.empty()) {
+			if (queue.empty()) {
+				wakeUp.wait(lock);
+				continue;
+			}
+			std::string sendBuffer;
+			while (sendBuffer.size() < 62 && !queue.empty()) {
+				sendBuffer += queue.front()->command.commandString();
+				queue.pop_front();
+			}
+			lock.unlock();
+			transport.write(sendBuffer.data(), sendBuffer.size());
+			lock.lock();
+		}
+	}
+
+public:
+	explicit LockedSendQueue(ITransport &transport) : transport(transport), worker(&LockedSendQueue::run, this) {}
+
+	~LockedSendQueue()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			running = false;
+		}
+		wakeUp.notify_one();
+		worker.join();
+	}
+
+	void queueCommand(SendCommand command, bool collapse)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (collapse) {
+			int cmdId = command.cmdId;
+			auto queued = std::find_if(queue.begin(), queue.end(),
+				[cmdId](const std::unique_ptr<CommandStrategy> &strategy) { return strategy->command.cmdId == cmdId; });
+			if (queued != queue.end()) {
+				(*queued)->command = std::move(command);
+				return;
+			}
+		}
+		queue.emplace_back(new CommandStrategy(std::move(command)));
+		wakeUp.notify_one();
+	}
+
+	std::size_t count()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return queue.size();
+	}
+};
+
+/**
+ * Returns the command a producer queues as its i-th command
+ */
+static SendCommand makeCommand(int producer, long i, bool collapse)
+{
+	SendCommand command(collapse ? (int)(i % CollapseIds) : producer);
+	command.addArgument((int32_t)i);
+	return command;
+}
+
+/**
+ * Runs the producers, and returns the commands queued per second until the queue is empty
+ */
+template<class Queue>
+static double run(int producerCount, Queue &queue, bool collapse)
+{
+	long perProducer = TotalCommands / producerCount;
+	std::atomic<bool> go{ false };
+	std::vector<std::thread> producers;
+	for (int p = 0; p < producerCount; p++)
+		producers.emplace_back([&, p] {
+			while (!go) std::this_thread::yield();
+			for (long i = 0; i < perProducer; i++) queue.queue(makeCommand(p, i, collapse), collapse);
+		});
+	auto start = std::chrono::steady_clock::now();
+	go = true;
+	for (std::thread &producer : producers) producer.join();
+	while (queue.count() != 0) std::this_thread::yield();
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	return perProducer * producerCount / elapsed.count();
+}
+
+struct LockFree
+{
+	SendCommandQueue &sendQueue;
+
+	void queue(SendCommand command, bool collapse)
+	{
+		if (collapse) sendQueue.queueCommand(std::unique_ptr<CommandStrategy>(new CollapseCommandStrategy(std::move(command))));
+		else sendQueue.queueCommand(std::move(command));
+	}
+	std::size_t count() { return sendQueue.count(); }
+};
+
+struct Locked
+{
+	LockedSendQueue &lockedQueue;
+
+	void queue(SendCommand command, bool collapse) { lockedQueue.queueCommand(std::move(command), collapse); }
+	std::size_t count() { return lockedQueue.count(); }
+};
+
+int main(int argc, char **argv)
+{
+	std::vector<int> producerCounts;
+	for (int i = 1; i < argc; i++) producerCounts.push_back(std::atoi(argv[i]));
+	if (producerCounts.empty()) producerCounts = { 1, 8, 16 };
+
+	NullTransport transport;
+	WorkerPool pool(1);
+	CmdMessenger messenger(transport, pool);
+
+	std::printf("%d cores, %ld commands per run, collapsed over %d IDs\n", (int)std::thread::hardware_concurrency(),
+		TotalCommands, CollapseIds);
+	std::printf("%-9s %9s %16s %16s\n", "", "producers", "lock-free cmd/s", "locked cmd/s");
+	for (bool collapse : { false, true })
+		for (int producerCount : producerCounts) {
+			if (producerCount <= 0) continue;
+			double lockFreeRate, lockedRate;
+			{
+				SendCommandQueue sendQueue(messenger);
+				sendQueue.start();
+				LockFree lockFree{ sendQueue };
+				lockFreeRate = run(producerCount, lockFree, collapse);
+			}
+			{
+				LockedSendQueue lockedQueue(transport);
+				Locked locked{ lockedQueue };
+				lockedRate = run(producerCount, locked, collapse);
+			}
+			std::printf("%-9s %9d %16.0f %16.0f\n", collapse ? "collapse" : "general", producerCount, lockFreeRate, lockedRate);
+		}
+	return 0;
+}
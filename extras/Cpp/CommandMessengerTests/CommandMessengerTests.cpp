@@ -0,0 +1,471 @@
+/*
+  CmdMessenger - library that provides command based messaging
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+  LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+  OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+  WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+  */
+
+// Tests of the host runtime against simulated devices on socket pairs and pseudo terminals
+
+#include <CommandMessenger/Capture/CaptureWriter.h>
+#include <CommandMessenger/Capture/ReplayDriver.h>
+#include <CommandMessenger/CmdMessenger.h>
+#include <CommandMessenger/EventLoop.h>
+#include <CommandMessenger/Queue/SendCommandQueue.h>
+#include <CommandMessenger/Transport/FdTransport.h>
+#include <CommandMessenger.Transport.Serial/SerialTransport.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <memory>
+#include <string>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace CommandMessenger;
+
+static int failures = 0;
+
+#define CHECK(condition) \
+	do { if (!(condition)) { std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); failures++; } } while (0)
+
+/**
+ * Device end of a simulated connection
+ */
+struct Device
+{
+	int fd = -1;
+
+	void send(const std::string &data) { CHECK(::write(fd, data.data(), data.size()) == (ssize_t)data.size()); }
+
+	/**
+	 * Reads one command, up to and including the command separator
+	 */
+	std::string receive()
+	{
+		std::string command;
+		char c;
+		while (::read(fd, &c, 1) == 1) {
+			command += c;
+			if (c == ';' && (command.size() < 2 || command[command.size() - 2] != '/')) break;
+		}
+		return command;
+	}
+};
+
+/**
+ * Makes a connected pair of a transport and a device end
+ */
+static std::unique_ptr<FdTransport> connectDevice(Device &device)
+{
+	int fds[2];
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) return nullptr;
+	device.fd = fds[1];
+	return std::unique_ptr<FdTransport>(new FdTransport(fds[0]));
+}
+
+/**
+ * Makes a pseudo terminal: the device end is the master, the transport opens the
+ *  terminal like a serial port
+ */
+static std::unique_ptr<SerialTransport> connectTerminal(Device &device)
+{
+	device.fd = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+	if (device.fd < 0 || grantpt(device.fd) != 0 || unlockpt(device.fd) != 0) return nullptr;
+	return std::unique_ptr<SerialTransport>(new SerialTransport(ptsname(device.fd)));
+}
+
+/**
+ * Waits until the condition holds, up to a second
+ */
+template<class F>
+static bool waitFor(F condition)
+{
+	for (int i = 0; i < 1000 && !condition(); i++) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	return condition();
+}
+
+static void testEscaping()
+{
+	Escaping escaping;
+	CHECK(escaping.escape("a,b;c/d") == "a/,b/;c//d");
+	CHECK(escaping.unescape("a/,b/;c//d") == "a,b;c/d");
+	std::vector<std::string> fields = escaping.split("5,a/,b,,c");
+	CHECK(fields.size() == 3 && fields[1] == "a/,b" && fields[2] == "c");
+	CHECK(escaping.trimLine("\r\n7,1\r") == "7,1\r");
+
+	// Whole commands are passed where they are in the fed bytes, a cut off one is joined
+	CommandParser parser(escaping);
+	const char first[] = "1,a/;;2,b";
+	std::string lines;
+	bool inPlace = false;
+	parser.feed(first, sizeof(first) - 1, [&](const char *line, std::size_t size) {
+		inPlace = line == first;
+		lines.append(line, size) += "|";
+	});
+	parser.feed(";3;", 3, [&](const char *line, std::size_t size) { lines.append(line, size) += "|"; });
+	CHECK(inPlace && lines == "1,a/;|2,b|3|");
+}
+
+static void testCommands()
+{
+	SendCommand command(9);
+	command.addArgument("x,y");
+	command.addArgument(-12);
+	command.addArgument(true);
+	command.addArgument(1.5f);
+	command.addBinArgument((int16_t)0x2C3B);
+	CHECK(command.commandString() == "9,x/,y,-12,1,1.5,/;/,;");
+
+	Escaping escaping;
+	ReceivedCommand received(escaping.split("9,x/,y,-12,1,1.5,/;/,"), escaping);
+	CHECK(received.ok() && received.cmdId == 9);
+	CHECK(received.readStringArg() == "x,y");
+	CHECK(received.readInt16Arg() == -12);
+	CHECK(received.readBoolArg());
+	CHECK(received.readFloatArg() == 1.5f);
+	CHECK(received.readBinArg<int16_t>() == 0x2C3B && received.isArgOk());
+	CHECK(!received.next());
+	received.readInt32Arg();
+	CHECK(!received.isArgOk());
+
+	ReceivedCommand unknown(escaping.split("x,1"), escaping);
+	CHECK(!unknown.ok());
+}
+
+static void testReceive()
+{
+	WorkerPool pool(2);
+	Device device;
+	std::unique_ptr<FdTransport> transport = connectDevice(device);
+	CmdMessenger messenger(*transport, pool);
+	std::atomic<int> values{ 0 };
+	std::atomic<int> unknown{ 0 };
+	std::string text;
+	messenger.attach(1, [&](ReceivedCommand &command) { text = command.readStringArg(); values++; });
+	messenger.attach(5, [&](ReceivedCommand &command) { values += command.readInt16Arg(); });
+	messenger.attach([&](ReceivedCommand &) { unknown++; });
+	CHECK(messenger.connect());
+
+	// Commands split over reads, with line ends of printLfCr
+	device.send("1,a/;");
+	device.send("b;\r\n5,7;\r\n");
+	device.send("8;");
+	CHECK(waitFor([&] { return values == 8 && unknown == 1; }));
+	CHECK(text == "a;b");
+	messenger.disconnect();
+	close(device.fd);
+}
+
+static void testAcknowledge()
+{
+	WorkerPool pool(1);
+	Device device;
+	std::unique_ptr<FdTransport> transport = connectDevice(device);
+	CmdMessenger messenger(*transport, pool);
+	CHECK(messenger.connect());
+
+	std::thread responder([&] {
+		CHECK(device.receive() == "3,1;");
+		device.send("2,busy;4,ok;");
+	});
+	SendCommand command(3, 4, std::chrono::milliseconds(1000));
+	command.addArgument(1);
+	ReceivedCommand acknowledge = messenger.sendCommand(command);
+	CHECK(acknowledge.ok() && acknowledge.cmdId == 4 && acknowledge.readStringArg() == "ok");
+	responder.join();
+
+	// No acknowledge: not ok after the time out
+	ReceivedCommand missing = messenger.sendCommand(SendCommand(3, 4, std::chrono::milliseconds(20)));
+	CHECK(!missing.ok());
+	CHECK(device.receive() == "3;");
+	messenger.disconnect();
+	close(device.fd);
+}
+
+static void testManyDevices()
+{
+	const int deviceCount = 200;
+	const int commandCount = 100;
+	WorkerPool pool(4);
+	std::vector<Device> devices(deviceCount);
+	std::vector<std::unique_ptr<FdTransport>> transports;
+	std::vector<std::unique_ptr<CmdMessenger>> messengers;
+	std::vector<int> next(deviceCount, 0);
+	std::atomic<int> outOfOrder{ 0 };
+	std::atomic<int> total{ 0 };
+
+	for (int i = 0; i < deviceCount; i++) {
+		transports.push_back(connectDevice(devices[i]));
+		messengers.emplace_back(new CmdMessenger(*transports[i], pool));
+		// Commands of one device are handled one at a time and in order
+		messengers[i]->attach(1, [&, i](ReceivedCommand &command) {
+			if (command.readInt32Arg() != next[i]++) outOfOrder++;
+			total++;
+		});
+		CHECK(messengers[i]->connect());
+	}
+	for (int n = 0; n < commandCount; n++)
+		for (int i = 0; i < deviceCount; i++)
+			devices[i].send("1," + std::to_string(n) + ";");
+	CHECK(waitFor([&] { return total == deviceCount * commandCount; }));
+	CHECK(outOfOrder == 0);
+	for (int i = 0; i < deviceCount; i++) {
+		messengers[i]->disconnect();
+		close(devices[i].fd);
+	}
+}
+
+static void testEventLoop(EventLoop::Backend backend)
+{
+	const int deviceCount = 20;
+	const int commandCount = 200;
+	EventLoop loop(backend);
+	CHECK(loop.isValid() && loop.start());
+	WorkerPool pool(2);
+	std::vector<Device> devices(deviceCount);
+	std::vector<std::unique_ptr<SerialTransport>> transports;
+	std::vector<std::unique_ptr<CmdMessenger>> messengers;
+	std::vector<int> next(deviceCount, 0);
+	std::atomic<int> outOfOrder{ 0 };
+	std::atomic<int> total{ 0 };
+
+	for (int i = 0; i < deviceCount; i++) {
+		transports.push_back(connectTerminal(devices[i]));
+		CHECK(transports[i] != nullptr);
+		// A small queue, so that the loop has to hold commands back
+		messengers.emplace_back(new CmdMessenger(*transports[i], pool, Escaping(), 4));
+		messengers[i]->attach(1, [&, i](ReceivedCommand &command) {
+			if (command.readInt32Arg() != next[i]++ || command.readStringArg() != "a;b") outOfOrder++;
+			total++;
+		});
+		CHECK(messengers[i]->connect(loop));
+	}
+	CHECK(loop.size() == deviceCount);
+
+	// Commands cut at every place, escapes included
+	std::string all;
+	for (int n = 0; n < commandCount; n++) all += "1," + std::to_string(n) + ",a/;b;";
+	for (std::size_t at = 0, piece = 1; at < all.size(); at += piece, piece = piece % 7 + 1)
+		for (int i = 0; i < deviceCount; i++)
+			devices[i].send(all.substr(at, piece));
+	CHECK(waitFor([&] { return total == deviceCount * commandCount; }));
+	CHECK(outOfOrder == 0);
+
+	// A device that goes away leaves the loop, one that disconnects too
+	close(devices[0].fd);
+	CHECK(waitFor([&] { return loop.size() == deviceCount - 1; }));
+	CHECK(!messengers[0]->isConnected());
+	CHECK(messengers[1]->disconnect());
+	CHECK(loop.size() == deviceCount - 2);
+
+	// Acknowledges are handed over by the loop
+	std::thread responder([&] {
+		CHECK(devices[2].receive() == "3;");
+		devices[2].send("4,ok;");
+	});
+	ReceivedCommand acknowledge = messengers[2]->sendCommand(SendCommand(3, 4, std::chrono::milliseconds(1000)));
+	CHECK(acknowledge.ok() && acknowledge.readStringArg() == "ok");
+	responder.join();
+
+	// More than the terminal holds, sent from two threads: each thread's commands stay in order
+	const int sendCount = 3000;
+	std::thread receiver([&] {
+		int nextOf[2] = { 0, 0 };
+		for (int n = 0; n < 2 * sendCount; n++) {
+			std::string command = devices[3].receive();
+			int sender = command[2] - '0';
+			if (command.size() < 6 || std::atoi(command.c_str() + 4) != nextOf[sender & 1]++) outOfOrder++;
+		}
+	});
+	std::vector<std::thread> senders;
+	for (int sender = 0; sender < 2; sender++)
+		senders.emplace_back([&, sender] {
+			for (int n = 0; n < sendCount; n++) {
+				SendCommand command(6);
+				command.addArgument(sender);
+				command.addArgument(n);
+				messengers[3]->sendCommand(command);
+			}
+		});
+	for (std::thread &sender : senders) sender.join();
+	receiver.join();
+	CHECK(outOfOrder == 0);
+
+	loop.stop();
+	messengers.clear();
+	CHECK(loop.size() == 0);
+	for (int i = 1; i < deviceCount; i++) close(devices[i].fd);
+}
+
+static void testSendQueue()
+{
+	WorkerPool pool(1);
+	Device device;
+	std::unique_ptr<FdTransport> transport = connectDevice(device);
+	CmdMessenger messenger(*transport, pool);
+	CHECK(messenger.connect());
+
+	// Strategies are applied in the order the commands were queued
+	SendCommandQueue sendQueue(messenger);
+	sendQueue.start();
+	sendQueue.suspend();
+	SendCommand collapseA(5);
+	collapseA.addArgument("a");
+	SendCommand collapseB(5);
+	collapseB.addArgument("b");
+	sendQueue.queueCommand(SendCommand(1));
+	sendQueue.queueCommand(SendCommand(2));
+	sendQueue.queueCommand(std::unique_ptr<CommandStrategy>(new CollapseCommandStrategy(collapseA)));
+	sendQueue.queueCommand(SendCommand(3));
+	sendQueue.queueCommand(std::unique_ptr<CommandStrategy>(new CollapseCommandStrategy(collapseB)));
+	sendQueue.sendCommand(SendCommand(9));
+	CHECK(sendQueue.count() == 6);
+	sendQueue.resume();
+	std::string sent;
+	for (int i = 0; i < 5; i++) sent += device.receive();
+	CHECK(sent == "9;1;2;5,b;3;");
+	CHECK(waitFor([&] { return sendQueue.count() == 0; }));
+	sendQueue.stop();
+
+	// A stale command is dropped when the one before it is sent
+	SendCommandQueue staleQueue(messenger);
+	staleQueue.addGeneralStrategy(std::unique_ptr<GeneralStrategy>(new StaleGeneralStrategy(std::chrono::milliseconds(20))));
+	staleQueue.start();
+	staleQueue.suspend();
+	staleQueue.queueCommand(SendCommand(1));
+	staleQueue.queueCommand(SendCommand(2));
+	std::this_thread::sleep_for(std::chrono::milliseconds(40));
+	staleQueue.queueCommand(SendCommand(3));
+	staleQueue.resume();
+	sent = device.receive();
+	sent += device.receive();
+	CHECK(sent == "1;3;");
+	CHECK(waitFor([&] { return staleQueue.count() == 0; }));
+	staleQueue.stop();
+	messenger.disconnect();
+	close(device.fd);
+}
+
+static void testCapture()
+{
+	char path[] = "/tmp/CommandMessengerTests.XXXXXX";
+	int fd = mkstemp(path);
+	CHECK(fd >= 0);
+	close(fd);
+
+	// Record a session
+	{
+		WorkerPool pool(1);
+		Device device;
+		std::unique_ptr<FdTransport> transport = connectDevice(device);
+		CmdMessenger messenger(*transport, pool);
+		std::atomic<int> handled{ 0 };
+		messenger.attach([&](ReceivedCommand &) { handled++; });
+		CaptureWriter writer;
+		CHECK(writer.open(path));
+		messenger.capture(&writer);
+		CHECK(messenger.connect());
+		device.send("1,a;");
+		device.send("2;");
+		CHECK(waitFor([&] { return handled == 2; }));
+		messenger.sendCommand(SendCommand(3));
+		CHECK(device.receive() == "3;");
+		messenger.disconnect();
+		messenger.capture(nullptr);
+		CHECK(writer.close());
+		close(device.fd);
+	}
+
+	CaptureReader capture;
+	CHECK(capture.open(path));
+	std::string received, sent;
+	std::chrono::microseconds lastTime{ 0 }, lastReceived{ 0 };
+	CaptureRecord record;
+	while (capture.next(record)) {
+		(record.direction == CaptureDirection::Received ? received : sent).append(record.data, record.size);
+		CHECK(record.time >= lastTime);
+		lastTime = record.time;
+		if (record.direction == CaptureDirection::Received) lastReceived = record.time;
+	}
+	CHECK(!capture.truncated());
+	CHECK(received == "1,a;2;" && sent == "3;");
+
+	// Replay to a parser, and to a messenger that calls its handlers
+	Escaping escaping;
+	CommandParser parser(escaping);
+	std::string lines;
+	ReplayDriver fullSpeed(capture);
+	CHECK(fullSpeed.replay(parser, [&](const char *line, std::size_t size) { lines.append(line, size) += "|"; }) == 6);
+	CHECK(lines == "1,a|2|");
+	{
+		WorkerPool pool(1);
+		FdTransport transport;
+		CmdMessenger messenger(transport, pool);
+		std::atomic<int> values{ 0 };
+		messenger.attach(1, [&](ReceivedCommand &command) { if (command.readStringArg() == "a") values++; });
+		messenger.attach(2, [&](ReceivedCommand &) { values += 10; });
+		auto start = std::chrono::steady_clock::now();
+		ReplayDriver original(capture, ReplayDriver::Timing::Original);
+		CHECK(original.replay(messenger) == 6);
+		CHECK(std::chrono::steady_clock::now() - start >= lastReceived);
+		CHECK(waitFor([&] { return values == 11; }));
+	}
+
+	// A capture cut off inside a record reads up to the record before
+	CHECK(truncate(path, 0) == 0);
+	{
+		CaptureWriter writer;
+		CHECK(writer.open(path));
+		writer.record(CaptureDirection::Received, "1;", 2);
+		writer.record(CaptureDirection::Received, "2;", 2);
+		CHECK(writer.close());
+	}
+	struct stat status;
+	CHECK(stat(path, &status) == 0);
+	CHECK(truncate(path, status.st_size - 1) == 0);
+	CHECK(capture.open(path));
+	received.clear();
+	while (capture.next(record)) received.append(record.data, record.size);
+	CHECK(received == "1;" && capture.truncated());
+	capture.close();
+	unlink(path);
+}
+
+int main()
+{
+	testEscaping();
+	testCommands();
+	testReceive();
+	testAcknowledge();
+	testManyDevices();
+	testEventLoop(EventLoop::Backend::Epoll);
+	testEventLoop(EventLoop::Backend::IoUring);
+	testSendQueue();
+	testCapture();
+	if (failures == 0) std::printf("All tests passed\n");
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,157 @@
+/*
+  CmdMessenger - library that provides command based messaging
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+  LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+  OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+  WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+  */
+
+#include <CmdDispatchQueue.h>
+
+/**
+ * CmdDispatchQueue constructor. frames must hold capacity * frameSize bytes
+ */
+CmdDispatchQueue::CmdDispatchQueue(char *frames, CmdQueuedFrame *slots, uint8_t capacity, uint8_t frameSize)
+{
+	this->frames = frames;
+	this->slots = slots;
+	this->capacity = (capacity >= CMDDISPATCH_NO_SLOT) ? CMDDISPATCH_NO_SLOT - 1 : capacity;
+	this->frameSize = frameSize;
+	dropped = 0;
+	reset();
+}
+
+/**
+ * Drops all queued commands
+ */
+void CmdDispatchQueue::reset()
+{
+	for (uint8_t i = 0; i < kPriorityImmediate; i++) {
+		heads[i] = CMDDISPATCH_NO_SLOT;
+		tails[i] = CMDDISPATCH_NO_SLOT;
+	}
+	for (uint8_t i = 0; i < capacity; i++)
+		slots[i].next = (i + 1 < capacity) ? i + 1 : CMDDISPATCH_NO_SLOT;
+	freeSlots = (capacity > 0) ? 0 : CMDDISPATCH_NO_SLOT;
+	count = 0;
+}
+
+/**
+ * Returns the number of commands waiting to be dispatched
+ */
+uint8_t CmdDispatchQueue::pending()
+{
+	return count;
+}
+
+/**
+ * Returns if there is no slot left for a received command
+ */
+bool CmdDispatchQueue::full()
+{
+	return freeSlots == CMDDISPATCH_NO_SLOT;
+}
+
+/**
+ * Returns the number of received commands that were dropped because the queue was full
+ */
+uint16_t CmdDispatchQueue::droppedCount()
+{
+	return dropped;
+}
+
+/**
+ * Stores a command at the end of the list of its class. When the queue is full, the newest
+ *  command of a lower class makes room, or else the command is dropped.
+ *  Returns false if the arguments do not fit in a slot
+ */
+bool CmdDispatchQueue::push(uint8_t priority, uint16_t id, uint8_t correlation, uint8_t port, const char *arguments, uint8_t length)
+{
+	if (length >= frameSize) return false;
+	if (full() && !evictBelow(priority)) {
+		dropped++;
+		return true;
+	}
+	uint8_t slot = freeSlots;
+	freeSlots = slots[slot].next;
+
+	memcpy(frame(slot), arguments, length);
+	frame(slot)[length] = '\0';
+	slots[slot].id = id;
+	slots[slot].correlation = correlation;
+	slots[slot].port = port;
+	slots[slot].next = CMDDISPATCH_NO_SLOT;
+
+	if (tails[priority] == CMDDISPATCH_NO_SLOT) heads[priority] = slot;
+	else slots[tails[priority]].next = slot;
+	tails[priority] = slot;
+	count++;
+	return true;
+}
+
+/**
+ * Drops the newest command of the lowest class below priority. Returns false if there is none
+ */
+bool CmdDispatchQueue::evictBelow(uint8_t priority)
+{
+	for (uint8_t lower = 0; lower < priority; lower++) {
+		uint8_t slot = heads[lower];
+		if (slot == CMDDISPATCH_NO_SLOT) continue;
+		// Find the slot before the tail
+		uint8_t previous = CMDDISPATCH_NO_SLOT;
+		while (slot != tails[lower]) {
+			previous = slot;
+			slot = slots[slot].next;
+		}
+		if (previous == CMDDISPATCH_NO_SLOT) heads[lower] = CMDDISPATCH_NO_SLOT;
+		else slots[previous].next = CMDDISPATCH_NO_SLOT;
+		tails[lower] = previous;
+		release(slot);
+		count--;
+		dropped++;
+		return true;
+	}
+	return false;
+}
+
+/**
+ * Takes the oldest command of the highest class out of the queue.
+ *  Returns its slot, which stays in use until released, or CMDDISPATCH_NO_SLOT
+ */
+uint8_t CmdDispatchQueue::pop()
+{
+	for (uint8_t priority = kPriorityImmediate; priority-- > 0;) {
+		uint8_t slot = heads[priority];
+		if (slot == CMDDISPATCH_NO_SLOT) continue;
+		heads[priority] = slots[slot].next;
+		if (heads[priority] == CMDDISPATCH_NO_SLOT) tails[priority] = CMDDISPATCH_NO_SLOT;
+		count--;
+		return slot;
+	}
+	return CMDDISPATCH_NO_SLOT;
+}
+
+/**
+ * Returns a slot taken by pop to the free slots
+ */
+void CmdDispatchQueue::release(uint8_t slot)
+{
+	slots[slot].next = freeSlots;
+	freeSlots = slot;
+}
@@ -0,0 +1,102 @@
+/*
+  CmdMessenger - library that provides command based messaging
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+  LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+  OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+  WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+  */
+
+#pragma once
+
+#include <CmdMessenger.h>
+
+#define CMDDISPATCH_NO_SLOT              0xFF // Slot index that marks the end of a list
+
+#ifndef CMDDISPATCH_FRAMESIZE
+#define CMDDISPATCH_FRAMESIZE            CMDMESSENGER_MESSENGERBUFFERSIZE // Room for the arguments of a command
+#endif
+
+/**
+ * Bookkeeping of a command waiting in a CmdDispatchQueue
+ */
+struct CmdQueuedFrame
+{
+	uint16_t id;                      // Command ID
+	uint8_t correlation;              // Correlation ID of the command, 0 if none
+	uint8_t port;                     // Port the command came in on
+	uint8_t next;                     // Next slot in the same list
+};
+
+/**
+ * Queue of received commands that wait to be dispatched, by priority class.
+ *
+ * While attached with CmdMessenger::attachQueue, received commands are not
+ * dispatched from feedinSerialData, but stored with their arguments.
+ * CmdMessenger::dispatchPending calls their callbacks, highest priority class
+ * first and in order of arrival within a class. Commands of class
+ * kPriorityImmediate, acknowledges and protocol frames are still handled at once.
+ * When the queue is full, the newest command of a lower class is dropped to make
+ * room, or else the received command is dropped. A command with more arguments
+ * than fit in a slot is dispatched at once.
+ */
+class CmdDispatchQueue
+{
+private:
+	char *frames;                     // Storage of the arguments, frameSize bytes per slot
+	CmdQueuedFrame *slots;            // Bookkeeping per slot
+	uint8_t capacity;                 // Number of slots
+	uint8_t frameSize;                // Maximum length of the arguments, terminator included
+	uint8_t heads[kPriorityImmediate];// Oldest slot per class
+	uint8_t tails[kPriorityImmediate];// Newest slot per class
+	uint8_t freeSlots;                // First unused slot
+	uint8_t count;                    // Number of queued commands
+	uint16_t dropped;                 // Number of commands dropped because the queue was full
+
+	bool push(uint8_t priority, uint16_t id, uint8_t correlation, uint8_t port, const char *arguments, uint8_t length);
+	bool evictBelow(uint8_t priority);
+	uint8_t pop();
+	void release(uint8_t slot);
+	char *frame(uint8_t slot) { return frames + slot * frameSize; }
+
+	friend class CmdMessenger;
+
+public:
+	CmdDispatchQueue(char *frames, CmdQueuedFrame *slots, uint8_t capacity, uint8_t frameSize);
+
+	void reset();
+	uint8_t pending();
+	bool full();
+	uint16_t droppedCount();
+};
+
+/**
+ * Dispatch queue that holds its own slots
+ */
+template < uint8_t Capacity, uint8_t FrameSize = CMDDISPATCH_FRAMESIZE >
+class CmdDispatchQueueSlots : public CmdDispatchQueue
+{
+private:
+	char frameData[Capacity * FrameSize];
+	CmdQueuedFrame slotData[Capacity];
+
+public:
+	CmdDispatchQueueSlots() : CmdDispatchQueue(frameData, slotData, Capacity, FrameSize)
+	{
+	}
+};
@@ -0,0 +1,81 @@
+/*
+  CmdMessenger - library that provides command based messaging
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+  LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+  OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+  WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+  */
+
+#include <CmdFrameBuffer.h>
+
+/**
+ * CmdFrameBuffer constructor
+ */
+CmdFrameBuffer::CmdFrameBuffer(char *buffer, uint16_t capacity)
+{
+	this->buffer = buffer;
+	this->capacity = capacity;
+	clear();
+}
+
+/**
+ * Appends a byte. Bytes that do not fit are dropped and flag the overflow
+ */
+size_t CmdFrameBuffer::write(uint8_t c)
+{
+	if (length >= capacity) {
+		overflow = true;
+		return 0;
+	}
+	buffer[length++] = (char)c;
+	return 1;
+}
+
+/**
+ * Empties the buffer and clears the overflow flag
+ */
+void CmdFrameBuffer::clear()
+{
+	length = 0;
+	overflow = false;
+}
+
+/**
+ * Drops everything from newLength on, and clears the overflow flag
+ */
+void CmdFrameBuffer::truncate(uint16_t newLength)
+{
+	if (newLength < length) length = newLength;
+	overflow = false;
+}
+
+/**
+ * Inserts count bytes at position, moving the rest of the data up
+ */
+bool CmdFrameBuffer::insert(uint16_t position, const char *str, uint16_t count)
+{
+	if (position > length || count > capacity - length) {
+		overflow = true;
+		return false;
+	}
+	memmove(buffer + position + count, buffer + position, length - position);
+	memcpy(buffer + position, str, count);
+	length += count;
+	return true;
+}
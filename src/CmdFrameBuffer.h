@@ -0,0 +1,60 @@
+/*
+  CmdMessenger - library that provides command based messaging
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+  LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+  OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+  WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+  */
+
+#pragma once
+
+#include <inttypes.h>
+#if ARDUINO >= 100
+#include <Arduino.h> 
+#else
+#include <WProgram.h> 
+#endif
+
+/**
+ * Print target that collects a frame in a fixed size buffer, so that it can
+ * be completed, inspected or stored before going out as a single write
+ */
+class CmdFrameBuffer : public Print
+{
+private:
+	char *buffer;                     // Storage, owned by the caller
+	uint16_t capacity;                // Size of the storage
+	uint16_t length;                  // Number of bytes written
+	bool overflow;                    // Indicates if a write did not fit
+
+public:
+	CmdFrameBuffer(char *buffer, uint16_t capacity);
+
+	virtual size_t write(uint8_t c);
+	using Print::write;
+
+	void clear();
+	void truncate(uint16_t newLength);
+	bool insert(uint16_t position, const char *str, uint16_t count);
+
+	const char *data() const { return buffer; }
+	uint16_t size() const { return length; }
+	uint16_t space() const { return capacity - length; }
+	bool overflowed() const { return overflow; }
+};
@@ -0,0 +1,112 @@
+/*
+  CmdMessenger - library that provides command based messaging
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+  LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+  OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+  WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+  */
+
+#include <CmdMemoryStream.h>
+
+/**
+ * CmdMemoryStream constructor. Received bytes are kept in a ring buffer of capacity bytes
+ */
+CmdMemoryStream::CmdMemoryStream(char *buffer, uint16_t capacity)
+{
+	this->buffer = buffer;
+	this->capacity = capacity;
+	peer = NULL;
+	clear();
+}
+
+/**
+ * Connects the stream that receives what is written to this one. Connect both ends
+ *  for a link in both directions, or NULL to drop written bytes
+ */
+void CmdMemoryStream::connect(CmdMemoryStream *newPeer)
+{
+	peer = newPeer;
+}
+
+/**
+ * Makes bytes come in on this stream. Returns how many fit in the ring buffer
+ */
+uint16_t CmdMemoryStream::feed(const char *data, uint16_t length)
+{
+	if (length > capacity - count) length = capacity - count;
+	for (uint16_t i = 0; i < length; i++)
+		buffer[(head + count + i) % capacity] = data[i];
+	count += length;
+	return length;
+}
+
+/**
+ * Makes a string come in on this stream. Returns how many bytes fit in the ring buffer
+ */
+uint16_t CmdMemoryStream::feed(const char *str)
+{
+	return feed(str, strlen(str));
+}
+
+/**
+ * Drops all received bytes
+ */
+void CmdMemoryStream::clear()
+{
+	head = 0;
+	count = 0;
+}
+
+/**
+ * Returns the number of received bytes
+ */
+int CmdMemoryStream::available()
+{
+	return count;
+}
+
+/**
+ * Returns the oldest received byte without taking it, or -1 if there is none
+ */
+int CmdMemoryStream::peek()
+{
+	return (count == 0) ? -1 : (uint8_t)buffer[head];
+}
+
+/**
+ * Takes the oldest received byte, or returns -1 if there is none
+ */
+int CmdMemoryStream::read()
+{
+	if (count == 0) return -1;
+	uint8_t c = buffer[head];
+	head = (head + 1) % capacity;
+	count--;
+	return c;
+}
+
+/**
+ * Passes a byte on to the connected stream. Returns 0 if it does not fit there
+ */
+size_t CmdMemoryStream::write(uint8_t c)
+{
+	if (peer == NULL) return 1;
+	char byte = (char)c;
+	return peer->feed(&byte, 1);
+}
@@ -0,0 +1,82 @@
+/*
+  CmdMessenger - library that provides command based messaging
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+  LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+  OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+  WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+  */
+
+#pragma once
+
+#include <inttypes.h>
+#if ARDUINO >= 100
+#include <Arduino.h> 
+#else
+#include <WProgram.h> 
+#endif
+
+/**
+ * One end of an in-memory link, for examples, tests and benchmarks that run without
+ * a serial connection.
+ *
+ * Bytes written to the stream come in on the stream it is connected to, as if sent
+ * over a wire; with nothing connected they are dropped. feed() makes bytes come in
+ * on the stream itself, as if the other end sent them. Received bytes wait in a ring
+ * buffer of the caller until they are read; bytes that do not fit are refused.
+ */
+class CmdMemoryStream : public Stream
+{
+private:
+	char *buffer;                     // Ring buffer of received bytes, owned by the caller
+	uint16_t capacity;                // Size of the ring buffer
+	uint16_t head;                    // Position of the oldest received byte
+	uint16_t count;                   // Number of received bytes
+	CmdMemoryStream *peer;            // Stream that receives what is written, or NULL
+
+public:
+	CmdMemoryStream(char *buffer, uint16_t capacity);
+
+	void connect(CmdMemoryStream *newPeer);
+	uint16_t feed(const char *data, uint16_t length);
+	uint16_t feed(const char *str);
+	void clear();
+	uint16_t room() const { return capacity - count; }
+
+	virtual int available();
+	virtual int peek();
+	virtual int read();
+	virtual void flush() {}
+	virtual size_t write(uint8_t c);
+	using Print::write;
+};
+
+/**
+ * Memory stream that holds its own ring buffer
+ */
+template < uint16_t Capacity >
+class CmdMemoryStreamBuffer : public CmdMemoryStream
+{
+private:
+	char bufferData[Capacity];
+
+public:
+	CmdMemoryStreamBuffer() : CmdMemoryStream(bufferData, Capacity)
+	{
+	}
+};
@@ -47,15 +47,41 @@ extern "C" {
 }
 #include <stdio.h>
 #include <CmdMessenger.h>
+#include <CmdTelemetry.h>
+#include <CmdReliable.h>
+#include <CmdDispatchQueue.h>
+#include <CmdSendQueue.h>
+#include <CmdPort.h>
 
 #define _CMDMESSENGER_VERSION 3_6 // software version of this library
 
+// Reads a function pointer from a handler table in program memory
+#if defined(pgm_read_ptr)
+#define CMDMESSENGER_READ_HANDLER(address) ((messengerCallbackFunction)pgm_read_ptr(address))
+#elif defined(__AVR__)
+#define CMDMESSENGER_READ_HANDLER(address) ((messengerCallbackFunction)pgm_read_word(address))
+#else
+#define CMDMESSENGER_READ_HANDLER(address) (*(address))
+#endif
+
+// Reads the IDs and name hashes of handler and name tables in program memory
+#if defined(pgm_read_word) && defined(pgm_read_dword)
+#define CMDMESSENGER_READ_WORD(address)  ((uint16_t)pgm_read_word(address))
+#define CMDMESSENGER_READ_DWORD(address) ((uint32_t)pgm_read_dword(address))
+#else
+#define CMDMESSENGER_READ_WORD(address)  (*(address))
+#define CMDMESSENGER_READ_DWORD(address) (*(address))
+#endif
+
 // **** Initialization ****
 
 /**
  * CmdMessenger constructor
  */
 CmdMessenger::CmdMessenger(Stream &ccomms, const char fld_separator, const char cmd_separator, const char esc_character)
+#if CMDMESSENGER_BATCHBUFFERSIZE != 0
+	: batchBuffer(batchData, CMDMESSENGER_BATCHBUFFERSIZE)
+#endif
 {
 	init(ccomms, fld_separator, cmd_separator, esc_character);
 }
@@ -65,9 +91,15 @@ CmdMessenger::CmdMessenger(Stream &ccomms, const char fld_separator, const char
  */
 void CmdMessenger::init(Stream &ccomms, const char fld_separator, const char cmd_separator, const char esc_character)
 {
-	default_callback = NULL;
+	default_callback = CmdDelegate();
+	idle_callback = NULL;
+	idling = false;
+	pollTimeLimit = 0;
 	comms = &ccomms;
+	out = comms;
 	print_newlines = false;
+	binaryIds = false;
+	messageIdEnd = CMDMESSENGER_NO_ID_END;
 	field_separator = fld_separator;
 	command_separator = cmd_separator;
 	escape_character = esc_character;
@@ -77,10 +109,56 @@ void CmdMessenger::init(Stream &ccomms, const char fld_separator, const char cmd
 
 #if CMDMESSENGER_MAXCALLBACKS != 0
 	for (int i = 0; i < CMDMESSENGER_MAXCALLBACKS; i++)
-		callbackList[i] = NULL;
+		callbackList[i] = CmdDelegate();
+#endif
+	handlerTable = NULL;
+	handlerTableSize = 0;
+	queue = NULL;
+	sendQueue = NULL;
+	dispatching = false;
+	ports = NULL;
+	portCount = 0;
+	activePort = 0;
+	selectedPort = 0;
+	budgeted = false;
+	readBudget = 0;
+	routes = NULL;
+	routeCount = 0;
+	forwardTarget = NULL;
+	deferTarget = NULL;
+	deferComplete = false;
+	bufferEnd = commandBuffer + CMDMESSENGER_MESSENGERBUFFERSIZE;
+#if CMDMESSENGER_MAXCALLBACKS != 0
+	// Every command starts in the normal class: 01 in every 2 bits
+	for (uint8_t i = 0; i < sizeof(priorities); i++)
+		priorities[i] = 0x55;
 #endif
+	nameTable = NULL;
+	nameOrder = NULL;
+	nameTableSize = 0;
+	messageIsName = false;
 
 	pauseProcessing = false;
+	startCommand = false;
+	streamIndex = 0;
+	streamLength = 0;
+	fieldsLeft = -1;
+	reliable = NULL;
+	correlating = false;
+	lastCorrelation = 0;
+	receivedCorrelation = 0;
+	replyCorrelation = 0;
+	batchCmdId = CMDMESSENGER_BATCH_CMDID;
+#if CMDMESSENGER_BATCHBUFFERSIZE != 0
+	batching = false;
+#endif
+#if CMDMESSENGER_MAXPENDINGACKS != 0
+	ack_callback = NULL;
+	for (int i = 0; i < CMDMESSENGER_MAXPENDINGACKS; i++) {
+		pendingAcks[i].state = kAckUnknown;
+		pendingAcks[i].correlation = 0;
+	}
+#endif
 }
 
 /**
@@ -92,6 +170,9 @@ void CmdMessenger::reset()
 	current = NULL;
 	last = NULL;
 	dumped = true;
+	idState = kIdLeading;
+	idValue = 0;
+	nameHash = cmdNameHash("");
 }
 
 /**
@@ -102,12 +183,40 @@ void CmdMessenger::printLfCr(bool addNewLine)
 	print_newlines = addNewLine;
 }
 
+/**
+ * Enables sending and receiving command IDs as a single byte instead of digits.
+ *  Only IDs 0 to 255 can be used. Both sides must enable it
+ */
+void CmdMessenger::binaryCommandIds(bool enable)
+{
+	binaryIds = enable;
+}
+
+/**
+ * Enables correlation IDs. A request (a command sent with reqAc) gets a field
+ *  CMDMESSENGER_CORRELATION_MARKER <id> appended, and commands sent from the callback
+ *  that handles it echo the same field. Acknowledges are matched on it, so several
+ *  requests with the same ack ID can be outstanding. Both sides must enable it
+ */
+void CmdMessenger::correlateRequests(bool enable)
+{
+	correlating = enable;
+}
+
 /**
  * Attaches an default function for commands that are not explicitly attached
  */
 void CmdMessenger::attach(messengerCallbackFunction newFunction)
 {
-	default_callback = newFunction;
+	default_callback = CmdDelegate(newFunction);
+}
+
+/**
+ * Attaches a default delegate for commands that are not explicitly attached
+ */
+void CmdMessenger::attach(const CmdDelegate &newDelegate)
+{
+	default_callback = newDelegate;
 }
 
 #if CMDMESSENGER_MAXCALLBACKS != 0
@@ -117,10 +226,293 @@ void CmdMessenger::attach(messengerCallbackFunction newFunction)
 void CmdMessenger::attach(byte msgId, messengerCallbackFunction newFunction)
 {
 	if (msgId >= 0 && msgId < CMDMESSENGER_MAXCALLBACKS)
-		callbackList[msgId] = newFunction;
+		callbackList[msgId] = CmdDelegate(newFunction);
+}
+
+/**
+ * Attaches a delegate to a command ID. The delegate gets this messenger, so the
+ *  same handler can serve several messengers
+ */
+void CmdMessenger::attach(byte msgId, const CmdDelegate &newDelegate)
+{
+	if (msgId < CMDMESSENGER_MAXCALLBACKS)
+		callbackList[msgId] = newDelegate;
+}
+
+/**
+ * Attaches a delegate to a command ID, in a priority class for dispatchPending
+ */
+void CmdMessenger::attach(byte msgId, const CmdDelegate &newDelegate, uint8_t priority)
+{
+	attach(msgId, newDelegate);
+	setPriority(msgId, priority);
+}
+
+/**
+ * Sets the priority class of a command ID: kPriorityLow, kPriorityNormal (default),
+ *  kPriorityHigh or kPriorityImmediate. Only used while a dispatch queue is attached
+ */
+void CmdMessenger::setPriority(byte msgId, uint8_t priority)
+{
+	if (msgId >= CMDMESSENGER_MAXCALLBACKS || priority > kPriorityImmediate) return;
+	uint8_t shift = (msgId & 3) * 2;
+	priorities[msgId >> 2] = (priorities[msgId >> 2] & ~(3 << shift)) | (priority << shift);
+}
+
+/**
+ * Attaches a function with user context to a command ID
+ */
+void CmdMessenger::attach(byte msgId, messengerDelegateFunction newFunction, void *context)
+{
+	attach(msgId, CmdDelegate(newFunction, context));
+}
+#endif
+
+/**
+ * Attaches a table of command handlers, for command IDs up to 65535 without a RAM
+ *  slot per ID. The table must be sorted on ascending ID and may be in program memory:
+ *  const CmdHandlerEntry handlers[] PROGMEM = { { kStatus, OnStatus }, { 1000, OnConfig } };
+ *  Handlers attached by ID take precedence over the table
+ */
+void CmdMessenger::attach(const CmdHandlerEntry *table, uint16_t count)
+{
+	handlerTable = table;
+	handlerTableSize = (table != NULL) ? count : 0;
+}
+
+/**
+ * Attaches a table of command names, so that commands can be sent as "led,1;" instead of "1,1;".
+ *  The name of a received command is hashed while it comes in, and looked up with a binary
+ *  search on the hash, so the cost does not grow with the length or number of names.
+ *  The table may be in program memory, in any order. The order array, of the same size,
+ *  is filled with the entries sorted on hash:
+ *  const CmdNameEntry names[] PROGMEM = { { cmdNameHash("led"), kSetLed }, ... };
+ *  Names must not start with a digit
+ */
+void CmdMessenger::attachNames(const CmdNameEntry *table, uint8_t count, uint8_t *order)
+{
+	nameTable = NULL;
+	nameTableSize = 0;
+	if (table == NULL || order == NULL) return;
+	nameTable = table;
+	nameOrder = order;
+	nameTableSize = count;
+	// Insertion sort of the indices on hash, once
+	for (uint8_t i = 0; i < count; i++) {
+		uint32_t hash = nameHashAt(i);
+		uint8_t j = i;
+		while (j > 0 && nameHashAt(order[j - 1]) > hash) {
+			order[j] = order[j - 1];
+			j--;
+		}
+		order[j] = i;
+	}
+}
+
+/**
+ * Returns the hash of an entry in the name table
+ */
+uint32_t CmdMessenger::nameHashAt(uint8_t index)
+{
+	return CMDMESSENGER_READ_DWORD(&nameTable[index].hash);
+}
+
+/**
+ * Looks up the command ID of a name hash. Returns false if the name is unknown
+ */
+bool CmdMessenger::findNamedId(uint32_t hash, uint16_t *id)
+{
+	uint8_t low = 0;
+	uint8_t high = nameTableSize;
+	while (low < high) {
+		uint8_t mid = low + ((high - low) >> 1);
+		uint32_t midHash = nameHashAt(nameOrder[mid]);
+		if (midHash < hash)
+			low = mid + 1;
+		else if (midHash > hash)
+			high = mid;
+		else {
+			*id = CMDMESSENGER_READ_WORD(&nameTable[nameOrder[mid]].id);
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * Attaches a queue for received commands. From now on, feedinSerialData stores commands
+ *  and dispatchPending calls their callbacks, highest priority class first.
+ *  Attach NULL to dispatch commands as soon as they are received again
+ */
+void CmdMessenger::attachQueue(CmdDispatchQueue *newQueue)
+{
+	queue = newQueue;
+}
+
+/**
+ * Attaches a queue for sent commands. From now on, commands are written as the stream
+ *  has room for them, and collapsible commands keep only their latest value.
+ *  Attach NULL to write commands at once again, after flushSendQueue. With ports, the
+ *  queue is that of the port commands are sent to now
+ */
+void CmdMessenger::attachSendQueue(CmdSendQueue *newQueue)
+{
+	sendQueue = newQueue;
+	if (ports != NULL) ports[activePort].sendQueue = newQueue;
+}
+
+/**
+ * Writes all commands in the send queue, or in the queue of every port, blocking until
+ *  they are handed to the stream
+ */
+void CmdMessenger::flushSendQueue()
+{
+	if (ports == NULL) {
+		if (sendQueue != NULL) sendQueue->drain(*comms, true);
+		return;
+	}
+	for (uint8_t i = 0; i < portCount; i++)
+		if (ports[i].sendQueue != NULL) ports[i].sendQueue->drain(*ports[i].stream, true);
+}
+
+/**
+ * Attaches streams that share the handlers and the stream buffer of this messenger,
+ *  instead of the stream it was made with. feedinSerialData reads from each port in
+ *  turn, up to its byte budget, and handlers reply on the port the command came in on.
+ *  Attach before the first poll. The reliable layer assumes a single port. Each port
+ *  has a send queue of its own, see CmdPort::attachSendQueue: the queue attached to the
+ *  messenger so far is flushed and replaced by that of the first port
+ */
+void CmdMessenger::attachPorts(CmdPort *newPorts, uint8_t count)
+{
+	if (newPorts == NULL || count == 0) return;
+	flushSendQueue();
+	ports = newPorts;
+	portCount = count;
+	activePort = 0;
+	selectedPort = 0;
+	reset();
+	streamIndex = 0;
+	streamLength = 0;
+	comms = ports[0].stream;
+	out = comms;
+	sendQueue = ports[0].sendQueue;
+}
+
+/**
+ * Selects the port that commands are sent to outside of handlers. Returns false if the
+ *  port does not exist, or the port can not change now: from within a handler, or while
+ *  bytes of the current port wait in the stream buffer
+ */
+bool CmdMessenger::selectPort(uint8_t index)
+{
+	if (ports == NULL || index >= portCount || dispatching) return false;
+	if (!switchPort(index)) return false;
+	selectedPort = index;
+	return true;
+}
+
+/**
+ * Attaches ranges of command IDs that are forwarded to another stream instead of handled.
+ *  A command is passed on as soon as its ID is in, and the rest of it as it comes in,
+ *  byte for byte, so escaping is kept and the arguments are never parsed. Commands that
+ *  came in on the target stream itself are handled as usual.
+ *  With ports, the port that starts a command on a target owns the target until the end
+ *  of the command. A command from another port for that target waits in the port's
+ *  command buffer, and holds up the rest of the port, until the owner is done.
+ *  Commands sent to the target stream by handlers are not held up, and would be mixed
+ *  into a forwarded command. Attach NULL to handle every command again
+ */
+void CmdMessenger::attachRoutes(const CmdRoute *newRoutes, uint8_t count)
+{
+	routes = newRoutes;
+	routeCount = (newRoutes != NULL) ? count : 0;
+}
+
+/**
+ * Returns the port the command being handled came in on, or else the selected port
+ */
+uint8_t CmdMessenger::currentPort()
+{
+	return activePort;
+}
+
+/**
+ * Attaches a reliable delivery layer. Commands sent from now on are numbered,
+ *  acknowledged and sent again when lost. Attach NULL to send plain commands again
+ */
+void CmdMessenger::attachReliable(CmdReliable *newReliable)
+{
+	reliable = newReliable;
+}
+
+/**
+ * Attaches a function that is called between polls while waiting for an acknowledge
+ *  or for room in the reliable window, so that control loops keep running
+ */
+void CmdMessenger::attachIdleCallback(messengerCallbackFunction newFunction)
+{
+	idle_callback = newFunction;
+}
+
+/**
+ * Sets the maximum time in ms spent handling received commands in one poll.
+ *  Commands left over are handled in the next poll. 0 (default) handles all available
+ */
+void CmdMessenger::setPollTimeLimit(unsigned int limit)
+{
+	pollTimeLimit = limit;
+}
+
+#if CMDMESSENGER_MAXPENDINGACKS != 0
+/**
+ * Attaches a function that is called when an acknowledge comes in or times out.
+ *  While attached, sendCmdEnd with reqAc returns at once, and acknowledges are
+ *  handled by feedinSerialData. Attach NULL to wait for acknowledges again
+ */
+void CmdMessenger::attachAckCallback(messengerAckCallbackFunction newFunction)
+{
+	ack_callback = newFunction;
+}
+
+/**
+ * Returns the number of sent commands still waiting for an acknowledge
+ */
+uint8_t CmdMessenger::pendingAckCount()
+{
+	uint8_t count = 0;
+	for (int i = 0; i < CMDMESSENGER_MAXPENDINGACKS; i++)
+		if (pendingAcks[i].state == kAckPending) count++;
+	return count;
 }
 #endif
 
+// **** Round trip time ****
+
+/**
+ * Returns the smoothed round trip time of acknowledged commands in ms
+ */
+unsigned int CmdMessenger::roundTripTime()
+{
+	return rtt.smoothed();
+}
+
+/**
+ * Returns the mean deviation of the round trip time in ms
+ */
+unsigned int CmdMessenger::roundTripVariance()
+{
+	return rtt.variance();
+}
+
+/**
+ * Returns the current adaptive time out in ms, including back off
+ */
+unsigned int CmdMessenger::retransmitTimeout()
+{
+	return rtt.timeout();
+}
+
 // **** Command processing ****
 
 /**
@@ -128,23 +520,119 @@ void CmdMessenger::attach(byte msgId, messengerCallbackFunction newFunction)
  */
 void CmdMessenger::feedinSerialData()
 {
-	while (!pauseProcessing && comms->available())
+	unsigned long pollStart = (pollTimeLimit != 0) ? millis() : 0;
+	if (ports != NULL) pollPorts(pollStart);
+	else while (!pauseProcessing && receiveCommand())
 	{
-		// The Stream class has a readBytes() function that reads many bytes at once. On Teensy 2.0 and 3.0, readBytes() is optimized.
-		// Benchmarks about the incredible difference it makes: http://www.pjrc.com/teensy/benchmark_usb_serial_receive.html
+		handleMessage();
+		if (pollTimeUp(pollStart)) break;
+	}
+	if (reliable != NULL) reliable->poll(*this);
+#if CMDMESSENGER_MAXPENDINGACKS != 0
+	expirePendingAcks();
+#endif
+	if (sendQueue != NULL) sendQueue->drain(*comms, false);
+}
 
-		size_t bytesAvailable = min(comms->available(), CMDMESSENGER_MAXSTREAMBUFFERSIZE);
-		comms->readBytes(streamBuffer, bytesAvailable);
+/**
+ * Handles the commands of each port in turn, up to its byte budget, and writes as much
+ *  of its send queue as the stream has room for. A port gets the whole budget before
+ *  the poll time limit is checked, so that no bytes of it are left in the stream buffer
+ *  when the next port takes over
+ */
+void CmdMessenger::pollPorts(unsigned long pollStart)
+{
+	if (pauseProcessing) return;
+	// Bytes left by a wait for an acknowledge belong to the active port, it goes first
+	uint8_t start = (streamIndex < streamLength) ? activePort : (activePort + 1) % portCount;
+	for (uint8_t i = 0; i < portCount; i++) {
+		switchPort((start + i) % portCount);
+		budgeted = true;
+		readBudget = ports[activePort].budget;
+		while (!pauseProcessing && receiveCommand())
+			handleMessage();
+		budgeted = false;
+		// Write what the stream has room for, the rest waits for the next turn of the port
+		if (sendQueue != NULL) sendQueue->drain(*comms, false);
+		if (streamIndex < streamLength || pollTimeUp(pollStart)) break;
+	}
+	switchPort(selectedPort);
+}
+
+/**
+ * Makes a port the one that is received from and sent to. Keeps the command that is
+ *  partly received on the current port. Returns false while bytes of the current port
+ *  wait in the stream buffer
+ */
+bool CmdMessenger::switchPort(uint8_t index)
+{
+	if (index == activePort) return true;
+	if (streamIndex < streamLength) return false;
 
-		// Process the bytes in the stream buffer, and handles dispatches callbacks, if commands are received
-		for (size_t byteNo = 0; byteNo < bytesAvailable; byteNo++)
-		{
-			int messageState = processLine(streamBuffer[byteNo]);
+	CmdPort &from = ports[activePort];
+	from.bufferIndex = bufferIndex;
+	memcpy(from.buffer, commandBuffer, bufferIndex);
+	from.lastChar = CmdlastChar;
+	from.idState = idState;
+	from.idValue = idValue;
+	from.idEnd = idEnd;
+	from.nameHash = nameHash;
+	from.forwardTarget = forwardTarget;
+	from.deferTarget = deferTarget;
+	from.deferComplete = deferComplete;
 
-			// If waiting for acknowledge command
-			if (messageState == kEndOfMessage)
-			{
-				handleMessage();
+	CmdPort &to = ports[index];
+	reset();
+	bufferIndex = to.bufferIndex;
+	memcpy(commandBuffer, to.buffer, bufferIndex);
+	CmdlastChar = to.lastChar;
+	idState = to.idState;
+	idValue = to.idValue;
+	idEnd = to.idEnd;
+	nameHash = to.nameHash;
+	forwardTarget = to.forwardTarget;
+	deferTarget = to.deferTarget;
+	deferComplete = to.deferComplete;
+	if (out == comms) out = to.stream;
+	comms = to.stream;
+	sendQueue = to.sendQueue;
+	activePort = index;
+	return true;
+}
+
+/**
+ * Processes stream bytes until a command is complete. Returns false when no more data is available.
+ *  The position in the stream buffer is kept between calls, so that a wait for an acknowledge
+ *  from within a callback continues where the outer loop left off
+ */
+bool CmdMessenger::receiveCommand()
+{
+	while (true) {
+		if (streamIndex >= streamLength) {
+			// A message that waits for its target holds up the rest of the port
+			if (deferTarget != NULL && !resumeForward()) return false;
+			// The Stream class has a readBytes() function that reads many bytes at once. On Teensy 2.0 and 3.0, readBytes() is optimized.
+			// Benchmarks about the incredible difference it makes: http://www.pjrc.com/teensy/benchmark_usb_serial_receive.html
+			int bytesAvailable = comms->available();
+			if (budgeted && bytesAvailable > readBudget) bytesAvailable = readBudget;
+			if (bytesAvailable <= 0) return false;
+			if (ports != NULL && routeCount != 0) streamLength = readToSeparator(min(bytesAvailable, CMDMESSENGER_MAXSTREAMBUFFERSIZE));
+			else streamLength = comms->readBytes(streamBuffer, min(bytesAvailable, CMDMESSENGER_MAXSTREAMBUFFERSIZE));
+			streamIndex = 0;
+			if (budgeted) readBudget -= streamLength;
+			if (streamLength == 0) return false;
+		}
+
+		// Process the bytes in the stream buffer, stop when a command is received
+		while (streamIndex < streamLength) {
+			if (forwardTarget != NULL) forwardBytes();
+			else if (deferTarget != NULL) {
+				if (deferComplete) return false;
+				deferBytes();
+			}
+			else if (processLine(streamBuffer[streamIndex++]) == kEndOfMessage) {
+				extractCorrelation();
+				return true;
 			}
 		}
 	}
@@ -160,73 +648,646 @@ uint8_t CmdMessenger::processLine(char serialChar)
 	bool escaped = isEscaped(&serialChar, escape_character, &CmdlastChar);
 	if ((serialChar == command_separator) && !escaped) {
 		commandBuffer[bufferIndex] = 0;
+		if (routeCount != 0 && idState == kIdDigits) {
+			// A command without arguments, forwarded as a whole
+			commandBuffer[bufferIndex++] = serialChar;
+			if (startForward()) {
+				if (deferTarget != NULL) deferComplete = true;
+				else forwardTarget = NULL;
+				return messageState;
+			}
+			commandBuffer[--bufferIndex] = 0;
+		}
 		if (bufferIndex > 0) {
 			messageState = kEndOfMessage;
+			messageLength = bufferIndex;
 			current = commandBuffer;
 			CmdlastChar = '\0';
+			// Keep the ID decoded on the way, if the first field was a plain ID
+			messageId = idValue;
+			messageNameHash = nameHash;
+			messageIsName = (idState == kIdName || idState == kIdNameComplete);
+			if (idState == kIdDigits || idState == kIdName) messageIdEnd = bufferIndex;
+			else if (idState == kIdComplete || idState == kIdNameComplete) messageIdEnd = idEnd;
+			else messageIdEnd = CMDMESSENGER_NO_ID_END;
 		}
 		reset();
 	}
+	else if (binaryIds && bufferIndex == 0 && !escaped && (serialChar == '\r' || serialChar == '\n')) {
+		// Line ends between commands would be taken for an ID
+	}
 	else {
+		bool idComplete = false;
+		if (idState <= kIdName) {
+			decodeId(serialChar, escaped);
+			idComplete = (idState == kIdComplete);
+		}
 		commandBuffer[bufferIndex] = serialChar;
 		bufferIndex++;
+		if (idComplete && routeCount != 0 && startForward()) return messageState;
 		if (bufferIndex >= bufferLastIndex) reset();
 	}
 	return messageState;
 }
 
+/**
+ * Starts forwarding the message coming in if a route holds its ID: passes on what has
+ *  come in so far, and sets the target for the rest. While another port forwards to the
+ *  target, the message is kept in the buffer instead, see deferBytes. Returns false if
+ *  it is not routed
+ */
+bool CmdMessenger::startForward()
+{
+	for (uint8_t i = 0; i < routeCount; i++) {
+		const CmdRoute &route = routes[i];
+		if (idValue < route.firstId || idValue > route.lastId) continue;
+		if (route.target == comms) return false;
+		if (targetTaken(route.target)) {
+			deferTarget = route.target;
+			deferComplete = false;
+			return true;
+		}
+		route.target->write((const uint8_t *)commandBuffer, bufferIndex);
+		forwardTarget = route.target;
+		char lastChar = CmdlastChar;
+		reset();
+		CmdlastChar = lastChar;
+		return true;
+	}
+	return false;
+}
+
+/**
+ * Passes on the stream bytes of a forwarded message up to its end, in one write
+ */
+void CmdMessenger::forwardBytes()
+{
+	uint16_t start = streamIndex;
+	while (streamIndex < streamLength) {
+		char c = streamBuffer[streamIndex++];
+		bool escaped = isEscaped(&c, escape_character, &CmdlastChar);
+		if (c == command_separator && !escaped) {
+			forwardTarget->write((const uint8_t *)streamBuffer + start, streamIndex - start);
+			forwardTarget = NULL;
+			CmdlastChar = '\0';
+			return;
+		}
+	}
+	forwardTarget->write((const uint8_t *)streamBuffer + start, streamIndex - start);
+}
+
+/**
+ * Collects the stream bytes of a message that waits for its target in the buffer, up to
+ *  its end. A message too long for the buffer is dropped, as any received command
+ *  that does not fit
+ */
+void CmdMessenger::deferBytes()
+{
+	while (streamIndex < streamLength) {
+		char c = streamBuffer[streamIndex++];
+		bool escaped = isEscaped(&c, escape_character, &CmdlastChar);
+		commandBuffer[bufferIndex++] = c;
+		if (c == command_separator && !escaped) {
+			deferComplete = true;
+			return;
+		}
+		if (bufferIndex >= bufferLastIndex) {
+			deferTarget = NULL;
+			reset();
+			return;
+		}
+	}
+}
+
+/**
+ * Passes on the message that waits in the buffer once no other port forwards to its
+ *  target, and forwards the rest of it as it comes in. Returns false while the target
+ *  is taken
+ */
+bool CmdMessenger::resumeForward()
+{
+	if (targetTaken(deferTarget)) return false;
+	deferTarget->write((const uint8_t *)commandBuffer, bufferIndex);
+	if (!deferComplete) forwardTarget = deferTarget;
+	else CmdlastChar = '\0';
+	deferTarget = NULL;
+	deferComplete = false;
+	char lastChar = CmdlastChar;
+	reset();
+	CmdlastChar = lastChar;
+	return true;
+}
+
+/**
+ * Returns if a port other than the active one is forwarding a message to the stream.
+ *  The port that started a message on a target owns it until the end of the message
+ */
+bool CmdMessenger::targetTaken(Stream *target)
+{
+	for (uint8_t i = 0; i < portCount; i++)
+		if (i != activePort && ports[i].forwardTarget == target) return true;
+	return false;
+}
+
+/**
+ * Reads stream bytes up to and including the first command separator. With routes
+ *  between ports, a message that has to wait for its target then leaves no bytes of
+ *  its port behind in the stream buffer, so that the other ports keep their turns
+ */
+uint16_t CmdMessenger::readToSeparator(uint16_t length)
+{
+	uint16_t count = 0;
+	while (count < length) {
+		int c = comms->read();
+		if (c < 0) break;
+		streamBuffer[count++] = (char)c;
+		if (c == command_separator) break;
+	}
+	return count;
+}
+
+/**
+ * Decodes the command ID from the characters of the first field, as they come in.
+ *  Anything other than a plain ID falls back to reading it from the buffer
+ */
+void CmdMessenger::decodeId(char serialChar, bool escaped)
+{
+	if (serialChar == field_separator && !escaped) {
+		if (idState == kIdDigits) idState = kIdComplete;
+		else if (idState == kIdName) idState = kIdNameComplete;
+		else idState = kIdNone;
+		idEnd = bufferIndex;
+	}
+	else if (binaryIds) {
+		// A single byte, escaped if it is a special character
+		if (idState == kIdLeading && (escaped || serialChar != escape_character)) {
+			idValue = (uint8_t)serialChar;
+			idState = kIdDigits;
+		}
+		else if (idState == kIdDigits) idState = kIdNone;
+	}
+	else if (valid_digit(serialChar) && !escaped && idState != kIdName) {
+		uint8_t digit = serialChar - '0';
+		if (idValue > 6553 || (idValue == 6553 && digit > 5)) idState = kIdNone;
+		else {
+			idValue = idValue * 10 + digit;
+			idState = kIdDigits;
+		}
+	}
+	else if (idState == kIdLeading && (white_space(serialChar) || serialChar == '\r' || serialChar == '\n')) {
+		// Like atoi, only skip white space in front of the ID
+	}
+	else if (nameTable != NULL && !escaped && serialChar != escape_character && idState != kIdDigits) {
+		// A command name, hashed as it comes in
+		nameHash = (nameHash ^ (uint8_t)serialChar) * 16777619UL;
+		idState = kIdName;
+	}
+	else {
+		idState = kIdNone;
+	}
+}
+
+/**
+ * Removes a trailing correlation field from the received command, and keeps its value
+ */
+void CmdMessenger::extractCorrelation()
+{
+	receivedCorrelation = 0;
+	if (!correlating) return;
+
+	// Find the last field
+	int separator = -1;
+	char lastChar = '\0';
+	for (uint8_t i = 0; i < messageLength; i++) {
+		char c = commandBuffer[i];
+		bool escaped = isEscaped(&c, escape_character, &lastChar);
+		if (c == field_separator && !escaped) separator = i;
+	}
+	if (separator < 0 || commandBuffer[separator + 1] != CMDMESSENGER_CORRELATION_MARKER) return;
+
+	uint16_t value = 0;
+	uint8_t i = separator + 2;
+	if (i >= messageLength) return;
+	for (; i < messageLength; i++) {
+		if (!valid_digit(commandBuffer[i])) return;
+		value = value * 10 + (commandBuffer[i] - '0');
+		// Stop before the value can wrap, #65537 is no correlation 1
+		if (value > 255) return;
+	}
+	if (value == 0) return;
+	receivedCorrelation = value;
+	commandBuffer[separator] = '\0';
+}
+
 /**
  * Dispatches attached callbacks based on command
  */
 void CmdMessenger::handleMessage()
 {
-	lastCommandId = readInt16Arg();
+	lastCommandId = receivedCommandId();
+	handleCommand();
+}
+
+/**
+ * Returns the ID of the received message. Uses the ID decoded while the message came in
+ *  and continues with the arguments after it, without scanning the ID again
+ */
+uint16_t CmdMessenger::receivedCommandId()
+{
+	if (messageIdEnd == CMDMESSENGER_NO_ID_END || messageState != kEndOfMessage)
+		return readCommandId();
+	messageState = kProcessingArguments;
+	current = NULL;
+	last = commandBuffer + messageIdEnd;
+	dumped = true;
+	if (messageIsName) {
+		// An unknown name goes to the default callback
+		uint16_t id = 0;
+		ArgOk = findNamedId(messageNameHash, &id);
+		return id;
+	}
+	ArgOk = true;
+	return messageId;
+}
+
+/**
+ * Reads the next argument as a command ID, 0 to 65535, or a single byte with binary IDs
+ */
+uint16_t CmdMessenger::readCommandId()
+{
+	if (binaryIds) {
+		if (!next()) {
+			ArgOk = false;
+			return 0;
+		}
+		dumped = true;
+		// The ID is the one byte in the field, after the escape character if escaped
+		const char *id = current;
+		bool escaped = (*id == escape_character);
+		if (escaped) id++;
+		ArgOk = (escaped || *id != '\0') && id[1] == '\0';
+		return (uint8_t)*id;
+	}
+	int32_t id = readInt32Arg();
+	if (id < 0 || id > 0xFFFF) ArgOk = false;
+	return id;
+}
+
+/**
+ * Dispatches a received command of which the ID has been read
+ */
+void CmdMessenger::handleCommand()
+{
+	if (ArgOk && lastCommandId == batchCmdId && batchCmdId != CMDMESSENGER_NO_BATCH_CMDID)
+		handleBatch();
+	else if (ArgOk && reliable != NULL && lastCommandId == CMDMESSENGER_RELIABLE_CMDID)
+		handleReliable();
+	else if (ArgOk && reliable != NULL && lastCommandId == CMDMESSENGER_RELIABLE_ACK_CMDID)
+		reliable->receiveAck(*this, readInt16Arg());
+	else if (ArgOk && reliable != NULL && lastCommandId == CMDMESSENGER_RELIABLE_SYNC_CMDID) {
+		uint8_t seq = readInt16Arg();
+		bool reply = readBoolArg();
+		reliable->receiveSync(*this, seq, reply);
+	}
+	else
+		dispatchCommand();
+}
+
+/**
+ * Dispatches the command in a reliable frame, if it is next in sequence
+ */
+void CmdMessenger::handleReliable()
+{
+	uint8_t seq = readInt16Arg();
+	if (!ArgOk || !reliable->receiveFrame(*this, seq)) return;
+	lastCommandId = readCommandId();
+	handleCommand();
+}
+
+/**
+ * Handles incoming data until the reliable window has room, or the default time out
+ *  passes. The window is sent again at least once before giving up, however long the
+ *  resend time out has backed off
+ */
+bool CmdMessenger::waitForWindow()
+{
+	unsigned long start = millis();
+	while (reliable->full()) {
+		unsigned long now = millis();
+		if (now - start >= (unsigned long)CMDMESSENGER_DEFAULT_TIMEOUT + reliable->resendTimeout(*this)) return false;
+		while (receiveCommand()) {
+			handleMessage();
+			if (pollTimeUp(now)) break;
+		}
+		reliable->poll(*this);
+		idle();
+	}
+	return true;
+}
+
+/**
+ * Calls the idle callback between polls of a wait. A wait started from the
+ *  idle callback itself does not call it again
+ */
+void CmdMessenger::idle()
+{
+	if (idle_callback == NULL || idling) return;
+	idling = true;
+	(*idle_callback)();
+	idling = false;
+}
+
+/**
+ * Returns if the poll that started at pollStart has used up the poll time limit
+ */
+bool CmdMessenger::pollTimeUp(unsigned long pollStart)
+{
+	return pollTimeLimit != 0 && millis() - pollStart >= pollTimeLimit;
+}
+
+/**
+ * Calls the callback attached to the last command ID, or queues the command
+ */
+void CmdMessenger::dispatchCommand()
+{
+#if CMDMESSENGER_MAXPENDINGACKS != 0
+	// An acknowledge we are waiting for is consumed, like a blocking wait would
+	if (ArgOk && resolvePendingAck(lastCommandId)) return;
+#endif
+	// Keep the command for dispatchPending, unless it must be handled at once
+	if (queue != NULL && ArgOk && deferCommand()) return;
+	invokeCallback();
+}
+
+/**
+ * Calls the callback attached to the last command ID
+ */
+void CmdMessenger::invokeCallback()
+{
+	// Commands sent from the callback are replies to this one
+	uint8_t outerCorrelation = replyCorrelation;
+	replyCorrelation = receivedCorrelation;
+	bool outerDispatching = dispatching;
+	dispatching = true;
 	// if command attached, we will call it
+	CmdDelegate callback;
 #if CMDMESSENGER_MAXCALLBACKS != 0
-	if (lastCommandId >= 0 && lastCommandId < CMDMESSENGER_MAXCALLBACKS && ArgOk && callbackList[lastCommandId] != NULL)
-		(*callbackList[lastCommandId])();
-	else // If command not attached, call default callback (if attached)
+	if (ArgOk && lastCommandId < CMDMESSENGER_MAXCALLBACKS)
+		callback = callbackList[lastCommandId];
 #endif
-		if (default_callback != NULL) (*default_callback)();
+	messengerCallbackFunction tableHandler = NULL;
+	if (!callback.isSet() && ArgOk && handlerTable != NULL)
+		tableHandler = findTableHandler(lastCommandId);
+	if (tableHandler != NULL)
+		(*tableHandler)();
+	else {
+		// If command not attached, call default callback (if attached)
+		if (!callback.isSet()) callback = default_callback;
+		if (callback.isSet()) callback(*this);
+	}
+	dispatching = outerDispatching;
+	replyCorrelation = outerCorrelation;
 }
 
 /**
- * Waits for reply from sender or timeout before continuing
+ * Returns the priority class of a command ID
  */
-bool CmdMessenger::blockedTillReply(unsigned int timeout, byte ackCmdId)
+uint8_t CmdMessenger::commandPriority(uint16_t id)
 {
-	unsigned long time = millis();
-	unsigned long start = time;
-	bool receivedAck = false;
-	while ((time - start) < timeout && !receivedAck) {
-		time = millis();
-		receivedAck = checkForAck(ackCmdId);
+#if CMDMESSENGER_MAXCALLBACKS != 0
+	if (id < CMDMESSENGER_MAXCALLBACKS)
+		return (priorities[id >> 2] >> ((id & 3) * 2)) & 3;
+#endif
+	return kPriorityNormal;
+}
+
+/**
+ * Stores the received command, with the arguments that have not been read, in the queue.
+ *  Returns false if it must be dispatched at once
+ */
+bool CmdMessenger::deferCommand()
+{
+	uint8_t priority = commandPriority(lastCommandId);
+	if (priority >= kPriorityImmediate) return false;
+	char *start = (last != NULL) ? last : commandBuffer + messageLength;
+	char *end = argumentsEnd();
+	if (end < start) end = start;
+	return queue->push(priority, lastCommandId, receivedCorrelation, activePort, start, end - start);
+}
+
+/**
+ * Returns the end of the arguments of the received command: the end of the message,
+ *  or inside a batch, the end of the fields left in the current command
+ */
+char *CmdMessenger::argumentsEnd()
+{
+	char *end = commandBuffer + messageLength;
+	if (last == NULL) return end;
+	char *position = last;
+	int16_t fields = fieldsLeft;
+	bool inField = false;
+	char lastChar = '\0';
+	for (; position < end; position++) {
+		char c = *position;
+		bool escaped = isEscaped(&c, escape_character, &lastChar);
+		if (c == '\0' && !escaped) break;
+		if (c == field_separator && !escaped) {
+			// Empty fields are skipped, like split_r does
+			if (inField && --fields == 0) break;
+			inField = false;
+		}
+		else inField = true;
 	}
-	return receivedAck;
+	return position;
 }
 
 /**
- *   Loops as long data is available to determine if acknowledge has come in
+ * Dispatches commands kept in the dispatch queue, highest priority class first.
+ *  Returns the number of commands dispatched. Does nothing from within a callback
  */
-bool CmdMessenger::checkForAck(byte ackCommand)
+uint8_t CmdMessenger::dispatchPending(uint8_t maxCommands)
 {
-	while (comms->available()) {
-		//Processes a byte and determines if an acknowlegde has come in
-		int messageState = processLine(comms->read());
-		if (messageState == kEndOfMessage) {
-			int id = readInt16Arg();
-			if (ackCommand == id && ArgOk) {
+	if (queue == NULL || dispatching) return 0;
+	// The replies of a command go to its port, which can not be changed to while
+	// bytes of the current port wait in the stream buffer
+	if (ports != NULL && streamIndex < streamLength) return 0;
+	uint8_t dispatched = 0;
+	while (dispatched < maxCommands) {
+		uint8_t slot = queue->pop();
+		if (slot == CMDDISPATCH_NO_SLOT) break;
+		// Read the arguments from the slot, the command buffer may hold a command coming in
+		char *arguments = queue->frame(slot);
+		lastCommandId = queue->slots[slot].id;
+		receivedCorrelation = queue->slots[slot].correlation;
+		if (ports != NULL) switchPort(queue->slots[slot].port);
+		messageState = kProcessingArguments;
+		current = NULL;
+		last = arguments;
+		dumped = true;
+		ArgOk = true;
+		fieldsLeft = -1;
+		bufferEnd = arguments + queue->frameSize;
+		invokeCallback();
+		bufferEnd = commandBuffer + CMDMESSENGER_MESSENGERBUFFERSIZE;
+		queue->release(slot);
+		dispatched++;
+	}
+	if (ports != NULL) switchPort(selectedPort);
+	return dispatched;
+}
+
+/**
+ * Returns the handler of a command ID in the attached table, or NULL.
+ *  Binary search, so a lookup reads at most log2(size) + 1 entries from program memory
+ */
+messengerCallbackFunction CmdMessenger::findTableHandler(uint16_t id)
+{
+	uint16_t low = 0;
+	uint16_t high = handlerTableSize;
+	while (low < high) {
+		uint16_t mid = low + ((high - low) >> 1);
+		uint16_t midId = CMDMESSENGER_READ_WORD(&handlerTable[mid].id);
+		if (midId < id)
+			low = mid + 1;
+		else if (midId > id)
+			high = mid;
+		else
+			return CMDMESSENGER_READ_HANDLER(&handlerTable[mid].handler);
+	}
+	return NULL;
+}
+
+/**
+ * Dispatches the commands packed in a batch frame, in order.
+ * Every command is prefixed with its number of fields, id included,
+ * so that a callback cannot read into the next command
+ */
+void CmdMessenger::handleBatch()
+{
+	int16_t fieldCount = readInt16Arg();
+	while (ArgOk && fieldCount > 0) {
+		fieldsLeft = fieldCount;
+		lastCommandId = readCommandId();
+		if (!ArgOk) break;
+		dispatchCommand();
+		// Skip the arguments the callback did not read
+		while (fieldsLeft > 0 && next());
+		fieldsLeft = -1;
+		fieldCount = readInt16Arg();
+	}
+	fieldsLeft = -1;
+}
+
+/**
+ * Waits for reply from sender or timeout before continuing
+ *  Commands other than the acknowledge are dispatched while waiting
+ */
+bool CmdMessenger::blockedTillReply(unsigned int timeout, byte ackCmdId, uint8_t correlation)
+{
+	unsigned long start = millis();
+	unsigned long now = start;
+	// The acknowledge may come after the byte budget of the port
+	bool wasBudgeted = budgeted;
+	budgeted = false;
+	while ((now - start) < timeout) {
+		// Handle what is available, up to the poll time limit, before checking the time again
+		while (receiveCommand()) {
+			lastCommandId = receivedCommandId();
+			// A reply without correlation field matches any request
+			if (ArgOk && lastCommandId == ackCmdId &&
+				(receivedCorrelation == 0 || receivedCorrelation == correlation)) {
+				rtt.sample(millis() - start);
+				budgeted = wasBudgeted;
 				return true;
 			}
-			else {
-				return false;
-			}
+			handleCommand();
+			if (pollTimeUp(now)) break;
 		}
-		return false;
+		if (sendQueue != NULL) sendQueue->drain(*comms, false);
+		idle();
+		now = millis();
 	}
+	rtt.backoff();
+	budgeted = wasBudgeted;
 	return false;
 }
 
+#if CMDMESSENGER_MAXPENDINGACKS != 0
+/**
+ * Stores a sent command that waits for an acknowledge. Returns its slot, or -1 if the table is full
+ */
+int8_t CmdMessenger::addPendingAck(byte cmdId, byte ackCmdId, unsigned int timeout, uint8_t correlation,
+	messengerAckCallbackFunction callback)
+{
+	for (int i = 0; i < CMDMESSENGER_MAXPENDINGACKS; i++) {
+		PendingAck &pending = pendingAcks[i];
+		if (pending.state != kAckPending) {
+			pending.state = kAckPending;
+			pending.cmdId = cmdId;
+			pending.ackCmdId = ackCmdId;
+			pending.correlation = correlation;
+			pending.timeout = timeout;
+			pending.sent = millis();
+			pending.callback = callback;
+			return i;
+		}
+	}
+	return -1;
+}
+
+/**
+ * Returns the acknowledge state of the command with this correlation ID in a slot
+ */
+uint8_t CmdMessenger::ackState(uint8_t slot, uint8_t correlation)
+{
+	if (slot >= CMDMESSENGER_MAXPENDINGACKS || pendingAcks[slot].correlation != correlation)
+		return kAckUnknown;
+	return pendingAcks[slot].state;
+}
+
+/**
+ * Completes the command this acknowledge belongs to: the one with the received
+ *  correlation ID, or else the oldest waiting for it. Returns false if there is none
+ */
+bool CmdMessenger::resolvePendingAck(uint16_t ackCmdId)
+{
+	unsigned long now = millis();
+	int oldest = -1;
+	for (int i = 0; i < CMDMESSENGER_MAXPENDINGACKS; i++) {
+		PendingAck &pending = pendingAcks[i];
+		if (pending.state == kAckPending && pending.ackCmdId == ackCmdId &&
+			(receivedCorrelation == 0 || receivedCorrelation == pending.correlation) &&
+			(oldest < 0 || now - pending.sent > now - pendingAcks[oldest].sent))
+			oldest = i;
+	}
+	if (oldest < 0) return false;
+
+	PendingAck &pending = pendingAcks[oldest];
+	pending.state = kAckReceived;
+	rtt.sample(now - pending.sent);
+	messengerAckCallbackFunction callback = (pending.callback != NULL) ? pending.callback : ack_callback;
+	if (callback != NULL) (*callback)(pending.cmdId, true);
+	return true;
+}
+
+/**
+ * Reports commands whose acknowledge did not come in within their time out
+ */
+void CmdMessenger::expirePendingAcks()
+{
+	unsigned long now = millis();
+	for (int i = 0; i < CMDMESSENGER_MAXPENDINGACKS; i++) {
+		PendingAck &pending = pendingAcks[i];
+		if (pending.state == kAckPending && now - pending.sent >= pending.timeout) {
+			pending.state = kAckTimedOut;
+			rtt.backoff();
+			messengerAckCallbackFunction callback = (pending.callback != NULL) ? pending.callback : ack_callback;
+			if (callback != NULL) (*callback)(pending.cmdId, false);
+		}
+	}
+}
+#endif
+
 /**
  * Gets next argument. Returns true if an argument is available
  */
@@ -241,8 +1302,12 @@ bool CmdMessenger::next()
 		temppointer = commandBuffer;
 		messageState = kProcessingArguments;
 	default:
-		if (dumped)
+		if (dumped) {
+			// Inside a batch, stop at the end of the current command
+			if (fieldsLeft == 0) return false;
 			current = split_r(temppointer, field_separator, &last);
+			if (current != NULL && fieldsLeft > 0) fieldsLeft--;
+		}
 		if (current != NULL) {
 			dumped = true;
 			return true;
@@ -270,7 +1335,7 @@ bool CmdMessenger::isArgOk()
 /**
  * Returns the commandID of the current command
  */
-uint8_t CmdMessenger::commandID()
+uint16_t CmdMessenger::commandID()
 {
 	return lastCommandId;
 }
@@ -280,12 +1345,31 @@ uint8_t CmdMessenger::commandID()
 /**
  * Send start of command. This makes it easy to send multiple arguments per command
  */
-void CmdMessenger::sendCmdStart(byte cmdId)
+void CmdMessenger::sendCmdStart(uint16_t cmdId)
 {
 	if (!startCommand) {
+#if CMDMESSENGER_BATCHBUFFERSIZE != 0
+		if (batching) {
+			out->print(field_separator);
+			batchCommandStart = batchBuffer.size();
+		}
+		else
+#endif
+		if (reliable != NULL) {
+			// Collect the command in the window, wait for room first
+			if (reliable->full()) waitForWindow();
+			out = reliable->beginFrame();
+		}
+		else if (sendQueue != NULL) {
+			// Collect the command in the send queue
+			out = sendQueue->beginFrame(*comms, cmdId);
+		}
 		startCommand = true;
 		pauseProcessing = true;
-		comms->print(cmdId);
+		printCommandId(out, cmdId);
+#if CMDMESSENGER_MAXPENDINGACKS != 0
+		sendCommandId = cmdId;
+#endif
 	}
 }
 
@@ -295,7 +1379,7 @@ void CmdMessenger::sendCmdStart(byte cmdId)
 void CmdMessenger::sendCmdEscArg(char* arg)
 {
 	if (startCommand) {
-		comms->print(field_separator);
+		out->print(field_separator);
 		printEsc(arg);
 	}
 }
@@ -314,8 +1398,8 @@ void CmdMessenger::sendCmdfArg(const char * const fmt, ...)
 		vsnprintf(msg, maxMessageSize, fmt, args);
 		va_end(args);
 
-		comms->print(field_separator);
-		comms->print(msg);
+		out->print(field_separator);
+		out->print(msg);
 	}
 }
 
@@ -327,23 +1411,58 @@ void CmdMessenger::sendCmdSciArg(double arg, unsigned int n)
 {
 	if (startCommand)
 	{
-		comms->print(field_separator);
+		out->print(field_separator);
 		printSci(arg, n);
 	}
 }
 
+/**
+ * Send a telemetry frame as a single escaped argument
+ */
+void CmdMessenger::sendCmdTelemetryArg(CmdTelemetry &telemetry, const int32_t *values)
+{
+	if (startCommand) {
+		out->print(field_separator);
+		telemetry.encode(*this, values);
+	}
+}
+
 /**
  * Send end of command
+ *  With reqAc, waits for the acknowledge and returns if it came in. If an ack
+ *  callback is attached, returns at once with whether the command could be queued.
+ *  With reliable delivery or a send queue, returns if the command was accepted
  */
 bool CmdMessenger::sendCmdEnd(bool reqAc, byte ackCmdId, unsigned int timeout)
 {
 	bool ackReply = false;
+#if CMDMESSENGER_BATCHBUFFERSIZE != 0
+	if (startCommand && batching) {
+		// The commands of a batch are not acknowledged one by one
+		if (reqAc) dropBatchCommand();
+		else ackReply = endBatchCommand();
+	}
+	else
+#endif
 	if (startCommand) {
-		comms->print(command_separator);
-		if (print_newlines)
-			comms->println(); // should append BOTH \r\n
-		if (reqAc) {
-			ackReply = blockedTillReply(timeout, ackCmdId);
+		bool capturedFrame = (out != comms);
+		// A request gets a new correlation ID, a reply echoes the received one
+		uint8_t correlation = reqAc ? newCorrelation() : replyCorrelation;
+		bool sent = finishFrame(correlation);
+		ackReply = capturedFrame && sent;
+		// Callbacks dispatched while waiting for the acknowledge may send commands
+		startCommand = false;
+		if (timeout == CMDMESSENGER_ADAPTIVE_TIMEOUT)
+			timeout = rtt.timeout();
+#if CMDMESSENGER_MAXPENDINGACKS != 0
+		if (sent && reqAc && ack_callback != NULL) {
+			// Returns at once, the acknowledge is reported to the ack callback
+			ackReply = addPendingAck(sendCommandId, ackCmdId, timeout, correlation, NULL) >= 0;
+		}
+		else
+#endif
+		if (sent && reqAc) {
+			ackReply = blockedTillReply(timeout, ackCmdId, correlation);
 		}
 	}
 	pauseProcessing = false;
@@ -351,14 +1470,175 @@ bool CmdMessenger::sendCmdEnd(bool reqAc, byte ackCmdId, unsigned int timeout)
 	return ackReply;
 }
 
+#if CMDMESSENGER_MAXPENDINGACKS != 0
+/**
+ * Send end of command, and track its acknowledge without waiting for it.
+ *  The returned handle can be polled. The callback, or else the attached ack callback,
+ *  is called when the acknowledge comes in or times out
+ */
+CmdAckHandle CmdMessenger::sendCmdEndAsync(byte ackCmdId, unsigned int timeout, messengerAckCallbackFunction callback)
+{
+	CmdAckHandle handle;
+#if CMDMESSENGER_BATCHBUFFERSIZE != 0
+	if (startCommand && batching) {
+		dropBatchCommand();
+		startCommand = false;
+	}
+#endif
+	if (startCommand) {
+		uint8_t correlation = newCorrelation();
+		bool sent = finishFrame(correlation);
+		startCommand = false;
+		if (timeout == CMDMESSENGER_ADAPTIVE_TIMEOUT)
+			timeout = rtt.timeout();
+		int8_t slot = sent ? addPendingAck(sendCommandId, ackCmdId, timeout, correlation, callback) : -1;
+		if (slot >= 0) {
+			handle.messenger = this;
+			handle.slot = slot;
+			handle.correlation = correlation;
+		}
+	}
+	pauseProcessing = false;
+	startCommand = false;
+	return handle;
+}
+#endif
+
+/**
+ * Returns a new correlation ID, never 0
+ */
+uint8_t CmdMessenger::newCorrelation()
+{
+	if (++lastCorrelation == 0) lastCorrelation = 1;
+	return lastCorrelation;
+}
+
+/**
+ * Completes the frame of the command being sent: adds the correlation field and the
+ *  command separator, or hands it to the reliable window. Returns false if it was dropped
+ */
+bool CmdMessenger::finishFrame(uint8_t correlation)
+{
+	if (correlating && correlation != 0) {
+		out->print(field_separator);
+		out->print(CMDMESSENGER_CORRELATION_MARKER);
+		out->print(correlation);
+	}
+	if (reliable != NULL && out != comms) {
+		// Collected in the reliable window
+		out = comms;
+		return reliable->endFrame(*this);
+	}
+	out->print(command_separator);
+	if (print_newlines)
+		out->println(); // should append BOTH \r\n
+	if (out != comms) {
+		// Collected in the send queue
+		out = comms;
+		return sendQueue->endFrame();
+	}
+	return true;
+}
+
+/**
+ * Sets the command ID of batch frames, sent and received (default: CMDMESSENGER_BATCH_CMDID).
+ *  Both sides must use the same ID. CMDMESSENGER_NO_BATCH_CMDID stops receiving batch
+ *  frames, so that a callback can be attached to CMDMESSENGER_BATCH_CMDID
+ */
+void CmdMessenger::setBatchCommandId(uint16_t cmdId)
+{
+	batchCmdId = cmdId;
+}
+
+#if CMDMESSENGER_BATCHBUFFERSIZE != 0
+/**
+ * Start collecting sent commands into a single batch frame
+ *  Commands are sent when endBatch is called. The frame must fit the receivers command buffer.
+ *  Commands that request an acknowledge are not added to a batch: sendCmdEnd returns false
+ */
+void CmdMessenger::beginBatch()
+{
+	if (batching || startCommand || batchCmdId == CMDMESSENGER_NO_BATCH_CMDID) return;
+	batching = true;
+	batchBuffer.clear();
+	out = &batchBuffer;
+	printCommandId(out, batchCmdId);
+}
+
+/**
+ * Prefix the command just written to the batch with its number of fields.
+ *  Returns false, and drops the command, if it did not fit in the batch buffer
+ */
+bool CmdMessenger::endBatchCommand()
+{
+	const char *data = batchBuffer.data();
+	uint16_t end = batchBuffer.size();
+	uint8_t fieldCount = 1;
+	char lastChar = '\0';
+	for (uint16_t i = batchCommandStart; i < end; i++) {
+		char c = data[i];
+		bool escaped = isEscaped(&c, escape_character, &lastChar);
+		// Empty fields are skipped by the receiver, so they are not counted
+		if (c == field_separator && !escaped && i + 1 < end && data[i + 1] != field_separator) fieldCount++;
+	}
+
+	char prefix[5];
+	uint8_t prefixLength = 0;
+	if (fieldCount >= 100) prefix[prefixLength++] = '0' + fieldCount / 100;
+	if (fieldCount >= 10) prefix[prefixLength++] = '0' + (fieldCount / 10) % 10;
+	prefix[prefixLength++] = '0' + fieldCount % 10;
+	prefix[prefixLength++] = field_separator;
+
+	// Keep room for the command separator and newline of the batch frame. The receiver
+	// drops frames that fill its command buffer, so one more byte stays unused
+	uint8_t reserved = print_newlines ? 3 : 2;
+	if (batchBuffer.overflowed() || !batchBuffer.insert(batchCommandStart, prefix, prefixLength) ||
+		batchBuffer.space() < reserved) {
+		dropBatchCommand();
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Removes the command being sent from the batch, with its leading separator
+ */
+void CmdMessenger::dropBatchCommand()
+{
+	batchBuffer.truncate(batchCommandStart - 1);
+}
+
+/**
+ * Send the commands collected since beginBatch as one frame, with a single write.
+ *  Returns true if a frame was sent
+ */
+bool CmdMessenger::endBatch()
+{
+	if (!batching || startCommand) return false;
+	batching = false;
+	out = comms;
+
+	// Only the batch ID: nothing to send
+	const char *data = batchBuffer.data();
+	if (memchr(data, field_separator, batchBuffer.size()) == NULL) return false;
+
+	batchBuffer.print(command_separator);
+	if (print_newlines)
+		batchBuffer.println(); // should append BOTH \r\n
+	if (batchBuffer.overflowed()) return false;
+	comms->write((const uint8_t *)data, batchBuffer.size());
+	return true;
+}
+#endif
+
 /**
  * Send a command without arguments, with acknowledge
  */
-bool CmdMessenger::sendCmd(byte cmdId, bool reqAc, byte ackCmdId)
+bool CmdMessenger::sendCmd(uint16_t cmdId, bool reqAc, byte ackCmdId)
 {
 	if (!startCommand) {
 		sendCmdStart(cmdId);
-		return sendCmdEnd(reqAc, ackCmdId, CMDMESSENGER_DEFAULT_TIMEOUT);
+		return sendCmdEnd(reqAc, ackCmdId, CMDMESSENGER_ADAPTIVE_TIMEOUT);
 	}
 	return false;
 }
@@ -366,43 +1646,50 @@ bool CmdMessenger::sendCmd(byte cmdId, bool reqAc, byte ackCmdId)
 /**
  * Send a command without arguments, without acknowledge
  */
-bool CmdMessenger::sendCmd(byte cmdId)
+bool CmdMessenger::sendCmd(uint16_t cmdId)
 {
 	if (!startCommand) {
 		sendCmdStart(cmdId);
-		return sendCmdEnd(false, 1, CMDMESSENGER_DEFAULT_TIMEOUT);
+		return sendCmdEnd(false, 1, CMDMESSENGER_ADAPTIVE_TIMEOUT);
 	}
 	return false;
 }
 
-// **** Command receiving ****
+// **** Acknowledge handles ****
 
 /**
- * Find next argument in command
+ * CmdAckHandle constructor, of a command that has not been sent
  */
-int CmdMessenger::findNext(char *str, char delim)
+CmdAckHandle::CmdAckHandle()
 {
-	int pos = 0;
-	bool escaped = false;
-	bool EOL = false;
-	ArglastChar = '\0';
-	while (true) {
-		escaped = isEscaped(str, escape_character, &ArglastChar);
-		EOL = (*str == '\0' && !escaped);
-		if (EOL) {
-			return pos;
-		}
-		if (*str == field_separator && !escaped) {
-			return pos;
-		}
-		else {
-			str++;
-			pos++;
-		}
-	}
-	return pos;
+	messenger = NULL;
+	slot = 0;
+	correlation = 0;
+}
+
+/**
+ * Returns if the acknowledge came in or timed out
+ */
+bool CmdAckHandle::isDone()
+{
+	return result() != kAckPending;
 }
 
+/**
+ * Returns the acknowledge state: kAckPending, kAckReceived, kAckTimedOut, or kAckUnknown
+ *  if the command was not sent or its slot has been reused by a later command
+ */
+uint8_t CmdAckHandle::result()
+{
+#if CMDMESSENGER_MAXPENDINGACKS != 0
+	if (messenger != NULL)
+		return messenger->ackState(slot, correlation);
+#endif
+	return kAckUnknown;
+}
+
+// **** Command receiving ****
+
 /**
  * Read the next argument as int
  */
@@ -533,6 +1820,48 @@ uint8_t CmdMessenger::compareStringArg(char *string)
 	return 0;
 }
 
+/**
+ * Reads the arguments of a typed handler into values. kinds holds the kind of each
+ *  argument in 4 bits, the first one lowest. Returns false when an argument is missing
+ */
+bool CmdMessenger::readTypedArgs(uint32_t kinds, CmdArgValue *values)
+{
+	for (; kinds != kArgEnd; kinds >>= 4, values++) {
+		switch (kinds & 0xF) {
+		case kArgBool:   values->boolValue = readBoolArg(); break;
+		case kArgChar:   values->charValue = readCharArg(); break;
+		case kArgInt16:  values->int16Value = readInt16Arg(); break;
+		case kArgInt32:  values->int32Value = readInt32Arg(); break;
+		case kArgFloat:  values->floatValue = readFloatArg(); break;
+		case kArgDouble: values->doubleValue = readDoubleArg(); break;
+		case kArgString: values->stringValue = readStringArg(); break;
+		default:
+			values->stringValue = readStringArg();
+			if (ArgOk) values->uint32Value = strtoul(values->stringValue, NULL, 10);
+		}
+		if (!ArgOk) return false;
+	}
+	return true;
+}
+
+/**
+ * Read the next argument as telemetry frame and decode it into values
+ * Note that values is left untouched if the frame cannot be decoded
+ */
+bool CmdMessenger::readTelemetryArg(CmdTelemetry &telemetry, int32_t *values)
+{
+	if (next()) {
+		dumped = true;
+		unescape(current);
+		// Varints are self-delimiting, the end of the buffer is the hard limit
+		const char *end = bufferEnd;
+		ArgOk = telemetry.decode(current, end, values);
+		return ArgOk;
+	}
+	ArgOk = false;
+	return false;
+}
+
 // **** Escaping tools ****
 
 /**
@@ -557,7 +1886,9 @@ void CmdMessenger::unescape(char *fromChar)
 
 /**
  * Split string in different tokens, based on delimiter
- * Note that this is basically strtok_r, but with support for an escape character
+ * Note that this is basically strtok_r, but with support for an escape character.
+ *  Each character is looked at once, and the scan stops at the end of the buffer,
+ *  also after an escaped \0 of a binary argument
  */
 char* CmdMessenger::split_r(char *str, const char delim, char **nextp)
 {
@@ -566,20 +1897,29 @@ char* CmdMessenger::split_r(char *str, const char delim, char **nextp)
 	if (str == NULL) {
 		str = *nextp;
 	}
-	// Strip leading delimiters
-	while (findNext(str, delim) == 0 && *str) {
+	// Nothing left after an empty command
+	if (str == NULL) {
+		return NULL;
+	}
+	// Strip leading delimiters. A field starts after each, so none of them is escaped
+	while (str < bufferEnd && *str == delim) {
 		str++;
 	}
 	// If this is a \0 char, return null
-	if (*str == '\0') {
+	if (str >= bufferEnd || *str == '\0') {
 		return NULL;
 	}
 	// Set start of return pointer to this position
 	ret = str;
-	// Find next delimiter
-	str += findNext(str, delim);
+	// Find next unescaped delimiter, in the same pass as the escape state
+	bool escaped = false;
+	for (; str < bufferEnd; str++) {
+		if (escaped) escaped = false;
+		else if (*str == escape_character) escaped = true;
+		else if (*str == delim || *str == '\0') break;
+	}
 	// and exchange this for a a \0 char. This will terminate the char
-	if (*str) {
+	if (str < bufferEnd && *str) {
 		*str++ = '\0';
 	}
 	// Set the next pointer to this char
@@ -620,9 +1960,27 @@ void CmdMessenger::printEsc(char *str)
 void CmdMessenger::printEsc(char str)
 {
 	if (str == field_separator || str == command_separator || str == escape_character || str == '\0') {
-		comms->print(escape_character);
+		out->print(escape_character);
+	}
+	out->print(str);
+}
+
+/**
+ * Print a command ID, as digits or as a single escaped byte. With binary IDs,
+ *  line ends are escaped too, so that they are not taken for the end of a line
+ */
+void CmdMessenger::printCommandId(Print *target, uint16_t id)
+{
+	if (!binaryIds) {
+		target->print(id);
+		return;
+	}
+	char c = (char)id;
+	if (c == field_separator || c == command_separator || c == escape_character || c == '\0' ||
+		c == '\r' || c == '\n') {
+		target->print(escape_character);
 	}
-	comms->print(str);
+	target->print(c);
 }
 
 /**
@@ -633,20 +1991,20 @@ void CmdMessenger::printSci(double f, unsigned int digits)
 	// handle sign
 	if (f < 0.0)
 	{
-		Serial.print('-');
+		out->print('-');
 		f = -f;
 	}
 
 	// handle infinite values
 	if (isinf(f))
 	{
-		Serial.print("INF");
+		out->print("INF");
 		return;
 	}
 	// handle Not a Number
 	if (isnan(f))
 	{
-		Serial.print("NaN");
+		out->print("NaN");
 		return;
 	}
 
@@ -679,5 +2037,5 @@ void CmdMessenger::printSci(double f, unsigned int digits)
 	sprintf(format, "%%ld.%%0%dldE%%+d", digits);
 	char output[16];
 	sprintf(output, format, whole, part, exponent);
-	comms->print(output);
+	out->print(output);
 }
@@ -32,11 +32,141 @@
 #endif
 
 //#include "Stream.h"
+#include <CmdFrameBuffer.h>
+#include <CmdRttEstimator.h>
+
+class CmdTelemetry;
+class CmdReliable;
+class CmdDispatchQueue;
+class CmdSendQueue;
+class CmdPort;
 
 extern "C"
 {
 	// callback functions always follow the signature: void cmd(void);
 	typedef void(*messengerCallbackFunction) (void);
+	// acknowledge callbacks follow the signature: void ack(byte cmdId, bool acknowledged);
+	typedef void(*messengerAckCallbackFunction) (byte cmdId, bool acknowledged);
+}
+
+class CmdMessenger;
+
+// delegate functions follow the signature: void cmd(CmdMessenger &messenger, void *context);
+typedef void(*messengerDelegateFunction) (CmdMessenger &messenger, void *context);
+
+// Enable-if and convertibility tests, as <type_traits> is not available on every board
+template<bool Condition, class T = void> struct CmdEnableIf {};
+template<class T> struct CmdEnableIf<true, T> { typedef T Type; };
+
+template<class F>
+struct CmdIsDelegateFunction
+{
+	static char test(messengerDelegateFunction);
+	static long test(...);
+	static F make();
+	static const bool value = sizeof(test(make())) == sizeof(char);
+};
+
+/**
+ * Callback with user context: a function that gets the messenger that received
+ *  the command and a pointer to user data. Does not allocate. Made from
+ *  - a plain callback:          CmdDelegate(OnCommand)
+ *  - a function and context:    CmdDelegate(OnCommand, &state)
+ *  - a captureless lambda:      [](CmdMessenger &messenger, void *context) { ... }
+ *  - a member function:         CmdDelegate::bind<Heater, &Heater::onSetPower>(&heater)
+ */
+class CmdDelegate
+{
+private:
+	messengerDelegateFunction function;  // Function to call, NULL if not set
+	void *context;                       // Passed to the function
+
+	static void callPlain(CmdMessenger &, void *plain)
+	{
+		(*reinterpret_cast<messengerCallbackFunction>(plain))();
+	}
+
+	template<class T, void (T::*Method)(CmdMessenger &)>
+	static void callMember(CmdMessenger &messenger, void *object)
+	{
+		(static_cast<T *>(object)->*Method)(messenger);
+	}
+
+public:
+	CmdDelegate() : function(NULL), context(NULL) {}
+
+	CmdDelegate(messengerDelegateFunction newFunction, void *newContext = NULL)
+		: function(newFunction), context(newContext) {}
+
+	CmdDelegate(messengerCallbackFunction plain)
+		: function(plain != NULL ? &callPlain : NULL), context(reinterpret_cast<void *>(plain)) {}
+
+	/**
+	 * Converts a captureless lambda with the delegate signature. Other lambdas are
+	 *  left to the plain callback overloads, so attach(id, []() { ... }) is not ambiguous
+	 */
+	template<class F, class = typename CmdEnableIf<CmdIsDelegateFunction<F>::value>::Type>
+	CmdDelegate(F lambda) : function(lambda), context(NULL) {}
+
+	/**
+	 * Binds a member function void T::Method(CmdMessenger &) to an object
+	 */
+	template<class T, void (T::*Method)(CmdMessenger &)>
+	static CmdDelegate bind(T *object)
+	{
+		return CmdDelegate(&callMember<T, Method>, object);
+	}
+
+	bool isSet() const { return function != NULL; }
+
+	void operator()(CmdMessenger &messenger) const { (*function)(messenger, context); }
+};
+
+/**
+ * Entry of a command handler table, see CmdMessenger::attach(const CmdHandlerEntry *, uint16_t)
+ */
+struct CmdHandlerEntry
+{
+	uint16_t id;                         // Command ID
+	messengerCallbackFunction handler;   // Function called for the command
+};
+
+/**
+ * Range of command IDs forwarded to another stream, see CmdMessenger::attachRoutes
+ */
+struct CmdRoute
+{
+	uint16_t firstId;                    // First command ID of the range
+	uint16_t lastId;                     // Last command ID of the range, inclusive
+	Stream *target;                      // Stream the commands are forwarded to
+};
+
+/**
+ * Returns if the IDs in a handler table are in strictly ascending order. For use in a
+ *  static_assert on a constexpr table:
+ *  static_assert(cmdHandlersSorted(handlers), "handlers must be sorted on id");
+ */
+template<size_t N>
+constexpr bool cmdHandlersSorted(const CmdHandlerEntry(&table)[N], size_t i = 1)
+{
+	return i >= N || (table[i - 1].id < table[i].id && cmdHandlersSorted(table, i + 1));
+}
+
+/**
+ * Entry of a command name table, see CmdMessenger::attachNames
+ */
+struct CmdNameEntry
+{
+	uint32_t hash;                       // cmdNameHash of the name
+	uint16_t id;                         // Command ID the name stands for
+};
+
+/**
+ * FNV-1a hash of a command name, evaluated at compile time for a string literal
+ */
+constexpr uint32_t cmdNameHash(const char *name, uint32_t hash = 2166136261UL)
+{
+	return (*name == '\0') ? hash : cmdNameHash(name + 1, (hash ^ (uint8_t)*name) * 16777619UL);
 }
 
 #ifndef CMDMESSENGER_MAXCALLBACKS
@@ -48,9 +178,32 @@ extern "C"
 #ifndef CMDMESSENGER_MAXSTREAMBUFFERSIZE
 #define CMDMESSENGER_MAXSTREAMBUFFERSIZE 512  // The length of the streambuffer   (default: 64)
 #endif
+#ifndef CMDMESSENGER_BATCHBUFFERSIZE
+#define CMDMESSENGER_BATCHBUFFERSIZE     CMDMESSENGER_MESSENGERBUFFERSIZE // The length of the batch buffer, 0 disables batching
+#endif
+#ifndef CMDMESSENGER_BATCH_CMDID
+#define CMDMESSENGER_BATCH_CMDID         255  // Reserved command ID of batch frames (default: 255)
+#endif
+#define CMDMESSENGER_NO_BATCH_CMDID      0xFFFF // Batch frames are not received, see setBatchCommandId
+#ifndef CMDMESSENGER_RELIABLE_CMDID
+#define CMDMESSENGER_RELIABLE_CMDID      254  // Reserved command ID of reliable frames (default: 254)
+#endif
+#ifndef CMDMESSENGER_RELIABLE_ACK_CMDID
+#define CMDMESSENGER_RELIABLE_ACK_CMDID  253  // Reserved command ID of reliable acknowledges (default: 253)
+#endif
+#ifndef CMDMESSENGER_RELIABLE_SYNC_CMDID
+#define CMDMESSENGER_RELIABLE_SYNC_CMDID 252  // Reserved command ID of reliable sequence syncs (default: 252)
+#endif
+#ifndef CMDMESSENGER_MAXPENDINGACKS
+#define CMDMESSENGER_MAXPENDINGACKS      4    // The maximum number of outstanding asynchronous acknowledges (default: 4)
+#endif
 #ifndef CMDMESSENGER_DEFAULT_TIMEOUT
 #define CMDMESSENGER_DEFAULT_TIMEOUT     5000 // Time out on unanswered messages. (default: 5s)
 #endif
+#define CMDMESSENGER_ADAPTIVE_TIMEOUT    0    // Time out derived from the measured round trip time
+#ifndef CMDMESSENGER_CORRELATION_MARKER
+#define CMDMESSENGER_CORRELATION_MARKER  '#'  // Starts the correlation field at the end of a command (default: '#')
+#endif
 
 // Message States
 enum
@@ -60,25 +213,115 @@ enum
 	kProcessingArguments,			 // Message is received, arguments are being read parsed
 };
 
+// States of the command ID decoded while a message comes in
+enum
+{
+	kIdLeading,                    // No ID characters yet
+	kIdDigits,                     // Receiving the ID
+	kIdName,                       // Receiving a command name
+	kIdComplete,                   // ID field ended with a field separator
+	kIdNameComplete,               // Name field ended with a field separator
+	kIdNone,                       // Not a plain ID, read it from the buffer instead
+};
+#define CMDMESSENGER_NO_ID_END       0xFF // messageIdEnd when the ID must be read from the buffer
+
+/**
+ * Unsigned word that holds the varint encoding of a type of the given size
+ */
+template < int Size > struct CmdVarint { typedef uint32_t Word; };
+template < > struct CmdVarint < 8 > { typedef uint64_t Word; };
+
+// Priority classes of received commands, see CmdMessenger::attachQueue
+enum
+{
+	kPriorityLow,                  // Dispatched after all other queued commands
+	kPriorityNormal,               // Default class of every command
+	kPriorityHigh,                 // Dispatched before all other queued commands
+	kPriorityImmediate,            // Never queued, dispatched as soon as it is received
+};
+
+// Acknowledge states
+enum
+{
+	kAckPending,                   // Acknowledge has not come in yet
+	kAckReceived,                  // Acknowledge came in
+	kAckTimedOut,                  // Acknowledge did not come in within the time out
+	kAckUnknown,                   // Command is not tracked (anymore)
+};
+
 #define white_space(c) ((c) == ' ' || (c) == '\t')
 #define valid_digit(c) ((c) >= '0' && (c) <= '9')
 
+class CmdMessenger;
+
+/**
+ * Handle to a command sent with sendCmdEndAsync, to poll for its acknowledge
+ */
+class CmdAckHandle
+{
+private:
+	CmdMessenger *messenger;          // Messenger that tracks the command, NULL if not sent
+	uint8_t slot;                     // Index in the pending acknowledge table
+	uint8_t correlation;              // Correlation ID of the command
+
+	friend class CmdMessenger;
+
+public:
+	CmdAckHandle();
+
+	bool isDone();
+	uint8_t result();
+};
+
+// Kinds of the arguments of typed handlers, see CmdMessenger::readTypedArgs
+enum
+{
+	kArgEnd,                       // No more arguments
+	kArgBool,                      // Read with readBoolArg
+	kArgChar,                      // Read with readCharArg
+	kArgInt16,                     // Read with readInt16Arg
+	kArgInt32,                     // Read with readInt32Arg
+	kArgUInt32,                    // Unsigned 32 bit integer
+	kArgFloat,                     // Read with readFloatArg
+	kArgDouble,                    // Read with readDoubleArg
+	kArgString,                    // Read with readStringArg
+};
+
+/**
+ * Argument of a typed handler, as read by CmdMessenger::readTypedArgs
+ */
+union CmdArgValue
+{
+	bool boolValue;
+	char charValue;
+	int16_t int16Value;
+	int32_t int32Value;
+	uint32_t uint32Value;
+	float floatValue;
+	double doubleValue;
+	char *stringValue;
+};
+
+template<class... Args> struct CmdTypedHandler;
+template<class F> struct CmdLambdaTraits;
+
 class CmdMessenger
 {
 private:
 	// **** Private variables *** 
 
 	bool    startCommand;            // Indicates if sending of a command is underway
-	uint8_t lastCommandId;		    // ID of last received command 
+	uint16_t lastCommandId;		    // ID of last received command 
 	uint8_t bufferIndex;              // Index where to write data in buffer
 	uint8_t bufferLength;             // Is set to CMDMESSENGER_MESSENGERBUFFERSIZE
 	uint8_t bufferLastIndex;          // The last index of the buffer
-	char ArglastChar;                 // Bookkeeping of argument escape char 
 	char CmdlastChar;                 // Bookkeeping of command escape char 
 	bool pauseProcessing;             // pauses processing of new commands, during sending
 	bool print_newlines;              // Indicates if \r\n should be added after send command
 	char commandBuffer[CMDMESSENGER_MESSENGERBUFFERSIZE]; // Buffer that holds the data
 	char streamBuffer[CMDMESSENGER_MAXSTREAMBUFFERSIZE]; // Buffer that holds the data
+	uint16_t streamIndex;             // Index of the next unprocessed byte in streamBuffer
+	uint16_t streamLength;            // Number of bytes read into streamBuffer
 	uint8_t messageState;             // Current state of message processing
 	bool dumped;                      // Indicates if last argument has been externally read 
 	bool ArgOk;						// Indicated if last fetched argument could be read
@@ -86,14 +329,80 @@ private:
 	char *last;                       // Pointer to previous buffer position
 	char prevChar;                    // Previous char (needed for unescaping)
 	Stream *comms;                    // Serial data stream
+	Print *out;                       // Target of sent commands: comms, or the batch buffer
+	int16_t fieldsLeft;               // Fields left in the current batched command, -1 outside batches
+	CmdReliable *reliable;            // Reliable delivery layer, if attached
+	CmdRttEstimator rtt;              // Round trip time of acknowledged commands
+	bool correlating;                 // Indicates if requests and replies carry a correlation ID
+	uint8_t lastCorrelation;          // Correlation ID of the last request
+	uint8_t receivedCorrelation;      // Correlation ID of the received command, 0 if none
+	uint8_t replyCorrelation;         // Correlation ID echoed by commands sent from a callback
+	uint8_t messageLength;            // Length of the received command
+	bool binaryIds;                   // Indicates if command IDs are sent as a single byte
+	uint8_t idState;                  // State of the ID of the message coming in
+	uint16_t idValue;                 // ID of the message coming in, so far
+	uint8_t idEnd;                    // Buffer index of the field separator after the ID
+	uint16_t messageId;               // ID of the received message
+	uint8_t messageIdEnd;             // Buffer index of the end of the ID, or CMDMESSENGER_NO_ID_END
 
 	char command_separator;           // Character indicating end of command (default: ';')
 	char field_separator;				// Character indicating end of argument (default: ',')
 	char escape_character;		    // Character indicating escaping of special chars
 
-	messengerCallbackFunction default_callback;            // default callback function  
+	CmdDelegate default_callback;                          // default callback function  
+	messengerCallbackFunction idle_callback;               // called between polls while waiting
+	bool idling;                      // Indicates if the idle callback is running
+	unsigned int pollTimeLimit;       // Maximum time in ms spent handling commands per poll, 0 for no limit
+#if CMDMESSENGER_MAXCALLBACKS != 0
+	CmdDelegate callbackList[CMDMESSENGER_MAXCALLBACKS];  // list of attached callback functions
+#endif
+	const CmdHandlerEntry *handlerTable;  // Sorted table of handlers in program memory, or NULL
+	uint16_t handlerTableSize;        // Number of entries in the handler table
+	CmdDispatchQueue *queue;          // Queue of received commands for dispatchPending, if attached
+	CmdSendQueue *sendQueue;          // Queue of sent commands, if attached
+	bool dispatching;                 // Indicates if a callback is running
+	CmdPort *ports;                   // Streams served in turn, NULL to serve comms only
+	uint8_t portCount;                // Number of ports
+	uint8_t activePort;               // Port whose commands are received, and sent to
+	uint8_t selectedPort;             // Port sent to outside the turns of feedinSerialData
+	bool budgeted;                    // Indicates if reading is limited to readBudget
+	uint16_t readBudget;              // Bytes the active port may still read in its turn
+	const CmdRoute *routes;           // Ranges of command IDs forwarded to other streams, or NULL
+	uint8_t routeCount;               // Number of routes
+	Stream *forwardTarget;            // Stream the message coming in is forwarded to, or NULL
+	Stream *deferTarget;              // Stream another port forwards to, that the message in the buffer waits for
+	bool deferComplete;               // Indicates if the message waiting for deferTarget is in the buffer in full
+	const char *bufferEnd;            // End of the buffer that holds the arguments being read
 #if CMDMESSENGER_MAXCALLBACKS != 0
-	messengerCallbackFunction callbackList[CMDMESSENGER_MAXCALLBACKS];  // list of attached callback functions
+	uint8_t priorities[(CMDMESSENGER_MAXCALLBACKS + 3) / 4]; // Priority class per command ID, 2 bits each
+#endif
+	const CmdNameEntry *nameTable;    // Table of command names in program memory, or NULL
+	uint8_t *nameOrder;               // Indices in the name table, sorted on hash
+	uint8_t nameTableSize;            // Number of entries in the name table
+	uint32_t nameHash;                // Hash of the name of the message coming in, so far
+	uint32_t messageNameHash;         // Hash of the name of the received message
+	bool messageIsName;               // Indicates if the received message starts with a name
+#if CMDMESSENGER_MAXPENDINGACKS != 0
+	struct PendingAck
+	{
+		uint8_t state;                // Acknowledge state, the slot is in use while kAckPending
+		byte cmdId;                   // ID of the sent command
+		uint16_t ackCmdId;            // ID of the expected acknowledge command
+		uint8_t correlation;          // Correlation ID of the sent command
+		unsigned int timeout;         // Time out, relative to sent
+		unsigned long sent;           // Time the command was sent
+		messengerAckCallbackFunction callback; // callback of this command, or NULL
+	};
+	byte sendCommandId;               // ID of the command being sent
+	messengerAckCallbackFunction ack_callback; // callback for asynchronous acknowledges
+	PendingAck pendingAcks[CMDMESSENGER_MAXPENDINGACKS]; // acknowledges that have not come in yet
+#endif
+	uint16_t batchCmdId;              // Command ID of batch frames
+#if CMDMESSENGER_BATCHBUFFERSIZE != 0
+	bool batching;                    // Indicates if sent commands are collected in a batch
+	uint16_t batchCommandStart;       // Position in the batch buffer of the command being sent
+	char batchData[CMDMESSENGER_BATCHBUFFERSIZE]; // Buffer that holds the batch frame
+	CmdFrameBuffer batchBuffer;
 #endif
 
 
@@ -104,12 +413,54 @@ private:
 	// **** Command processing ****
 
 	inline uint8_t processLine(char serialChar) __attribute__((always_inline));
+	inline void decodeId(char serialChar, bool escaped) __attribute__((always_inline));
+	uint16_t receivedCommandId();
 	inline void handleMessage() __attribute__((always_inline));
-	inline bool blockedTillReply(unsigned int timeout = CMDMESSENGER_DEFAULT_TIMEOUT, byte ackCmdId = 1) __attribute__((always_inline));
-	inline bool checkForAck(byte AckCommand) __attribute__((always_inline));
+	void dispatchCommand();
+	void invokeCallback();
+	bool deferCommand();
+	char *argumentsEnd();
+	uint8_t commandPriority(uint16_t id);
+	messengerCallbackFunction findTableHandler(uint16_t id);
+	inline uint32_t nameHashAt(uint8_t index) __attribute__((always_inline));
+	bool findNamedId(uint32_t hash, uint16_t *id);
+	uint16_t readCommandId();
+	void handleBatch();
+#if CMDMESSENGER_BATCHBUFFERSIZE != 0
+	bool endBatchCommand();
+	void dropBatchCommand();
+#endif
+	inline bool blockedTillReply(unsigned int timeout = CMDMESSENGER_ADAPTIVE_TIMEOUT, byte ackCmdId = 1, uint8_t correlation = 0) __attribute__((always_inline));
+	void extractCorrelation();
+	bool receiveCommand();
+	void handleCommand();
+	void handleReliable();
+	bool waitForWindow();
+	bool switchPort(uint8_t index);
+	void pollPorts(unsigned long pollStart);
+	bool startForward();
+	void forwardBytes();
+	void deferBytes();
+	bool resumeForward();
+	bool targetTaken(Stream *target);
+	uint16_t readToSeparator(uint16_t length);
+	void idle();
+	inline bool pollTimeUp(unsigned long pollStart) __attribute__((always_inline));
+#if CMDMESSENGER_MAXPENDINGACKS != 0
+	int8_t addPendingAck(byte cmdId, byte ackCmdId, unsigned int timeout, uint8_t correlation,
+		messengerAckCallbackFunction callback);
+	bool resolvePendingAck(uint16_t ackCmdId);
+	void expirePendingAcks();
+	uint8_t ackState(uint8_t slot, uint8_t correlation);
+
+	friend class CmdAckHandle;
+#endif
 
 	// **** Command sending ****
 
+	uint8_t newCorrelation();
+	bool finishFrame(uint8_t correlation);
+
 	/**
 	 * Print variable of type T binary in binary format
 	 */
@@ -126,8 +477,6 @@ private:
 
 	// **** Command receiving ****
 
-	int findNext(char *str, char delim);
-
 	/**
 	 * Read a variable of any type in binary format
 	 */
@@ -158,6 +507,73 @@ private:
 		return value;
 	}
 
+	// **** Variable length integers ****
+
+	/**
+	 * Print an unsigned integer as escaped varint: 7 bits per byte, least
+	 * significant group first, high bit set on all but the last byte
+	 */
+	template < class W >
+	void writeVarint(W value)
+	{
+		while (value >= 0x80) {
+			printEsc((char)(value | 0x80));
+			value >>= 7;
+		}
+		printEsc((char)value);
+	}
+
+	/**
+	 * Read a varint from an unescaped buffer and advance the pointer past it.
+	 * The bounds are folded into a single limit, so the loop tests one
+	 * pointer compare and the continuation bit per byte
+	 */
+	template < class W >
+	static bool readVarint(const char **str, const char *end, W *value)
+	{
+		const uint8_t *p = (const uint8_t *)*str;
+		const uint8_t *limit = (const uint8_t *)end;
+		const uint8_t maxBytes = (sizeof(W) * 8 + 6) / 7;
+		if (limit - p > maxBytes) limit = p + maxBytes;
+
+		W result = 0;
+		uint8_t shift = 0;
+		while (p < limit) {
+			uint8_t b = *p++;
+			result |= (W)(b & 0x7F) << shift;
+			if (!(b & 0x80)) {
+				*str = (const char *)p;
+				*value = result;
+				return true;
+			}
+			shift += 7;
+		}
+		return false;
+	}
+
+	/**
+	 * Map signed values to unsigned words so that values close to zero give short varints.
+	 * Unsigned values are passed through
+	 */
+	template < class T, class W >
+	static W zigzag(T value)
+	{
+		W word = (W)value;                // sign extends
+		if ((T)-1 > (T)0) return word;
+		return (word << 1) ^ (W)(0 - (word >> (sizeof(W) * 8 - 1)));
+	}
+
+	template < class T, class W >
+	static T unzigzag(W word)
+	{
+		if ((T)-1 > (T)0) return (T)word;
+		return (T)((word >> 1) ^ (W)(0 - (word & 1)));
+	}
+
+	friend class CmdTelemetry;
+	friend class CmdReliable;
+	friend class CmdSendQueue;
+
 	// **** Escaping tools ****
 
 	char *split_r(char *str, const char delim, char **nextp);
@@ -165,6 +581,7 @@ private:
 
 	void printEsc(char *str);
 	void printEsc(char str);
+	void printCommandId(Print *target, uint16_t id);
 
 public:
 
@@ -178,18 +595,112 @@ public:
 		
 	void reset();
 	void printLfCr(bool addNewLine = true);
+	void binaryCommandIds(bool enable = true);
+	void correlateRequests(bool enable = true);
 	void attach(messengerCallbackFunction newFunction);
+	void attach(const CmdDelegate &newDelegate);
 	#if CMDMESSENGER_MAXCALLBACKS != 0
 	void attach(byte msgId, messengerCallbackFunction newFunction);
+	void attach(byte msgId, const CmdDelegate &newDelegate);
+	void attach(byte msgId, messengerDelegateFunction newFunction, void *context);
+	void attach(byte msgId, const CmdDelegate &newDelegate, uint8_t priority);
+	void setPriority(byte msgId, uint8_t priority);
+	#endif
+	void attach(const CmdHandlerEntry *table, uint16_t count);
+	void attachNames(const CmdNameEntry *table, uint8_t count, uint8_t *order);
+
+	/**
+	 * Attaches a table of command names, with an array of the same size for its sorted order
+	 */
+	template<size_t N>
+	void attachNames(const CmdNameEntry(&table)[N], uint8_t(&order)[N])
+	{
+		static_assert(N <= 255, "A name table holds up to 255 names");
+		attachNames(table, N, order);
+	}
+
+	/**
+	 * Attaches a table of command handlers, see attach(const CmdHandlerEntry *, uint16_t)
+	 */
+	template<size_t N>
+	void attach(const CmdHandlerEntry(&table)[N])
+	{
+		attach(table, N);
+	}
+#if CMDMESSENGER_MAXCALLBACKS != 0
+
+	/**
+	 * Attaches a function with typed arguments to a command ID, for example
+	 *  attach<kSetLed>(OnSetLed) with void OnSetLed(bool on, int16_t level).
+	 *  The arguments are read in order with the reader of their type, and the
+	 *  function is only called if every argument could be read
+	 */
+	template<uint16_t Id, class... Args>
+	void attach(void(*handler)(Args...))
+	{
+		static_assert(Id < CMDMESSENGER_MAXCALLBACKS, "Command ID is beyond CMDMESSENGER_MAXCALLBACKS");
+		CmdTypedHandler<Args...>::attach(*this, Id, handler);
+	}
+
+	/**
+	 * Attaches a captureless lambda with typed arguments to a command ID, for example
+	 *  attach<kSetLed>([](bool on, int16_t level) { ... })
+	 */
+	template<uint16_t Id, class F>
+	void attach(F lambda)
+	{
+		attach<Id>(static_cast<typename CmdLambdaTraits<F>::Function>(lambda));
+	}
+#endif
+	void attachReliable(CmdReliable *newReliable);
+	void attachQueue(CmdDispatchQueue *newQueue);
+	void attachSendQueue(CmdSendQueue *newQueue);
+	void flushSendQueue();
+	void attachPorts(CmdPort *newPorts, uint8_t count);
+
+	/**
+	 * Attaches an array of ports, see attachPorts(CmdPort *, uint8_t)
+	 */
+	template<size_t N>
+	void attachPorts(CmdPort(&newPorts)[N])
+	{
+		static_assert(N <= 255, "A messenger serves up to 255 ports");
+		attachPorts(newPorts, N);
+	}
+	bool selectPort(uint8_t index);
+	void attachRoutes(const CmdRoute *newRoutes, uint8_t count);
+
+	/**
+	 * Attaches an array of routes, see attachRoutes(const CmdRoute *, uint8_t)
+	 */
+	template<size_t N>
+	void attachRoutes(const CmdRoute(&newRoutes)[N])
+	{
+		static_assert(N <= 255, "A messenger holds up to 255 routes");
+		attachRoutes(newRoutes, N);
+	}
+	uint8_t currentPort();
+	void attachIdleCallback(messengerCallbackFunction newFunction);
+	void setPollTimeLimit(unsigned int limit);
+	#if CMDMESSENGER_MAXPENDINGACKS != 0
+	void attachAckCallback(messengerAckCallbackFunction newFunction);
+	uint8_t pendingAckCount();
 	#endif
 
+	// **** Round trip time ****
+
+	unsigned int roundTripTime();
+	unsigned int roundTripVariance();
+	unsigned int retransmitTimeout();
+
 	// **** Command processing ****
 
 	void feedinSerialData();
+	uint8_t dispatchPending(uint8_t maxCommands = 255);
 	bool next();
 	bool available();
 	bool isArgOk();
-	uint8_t commandID();
+	uint16_t commandID();
 
 	// ****  Command sending ****
 
@@ -198,8 +709,8 @@ public:
 	 * Note that the argument is sent as string
 	 */
 	template < class T >
-	bool sendCmd(byte cmdId, T arg, bool reqAc = false, byte ackCmdId = 1,
-		unsigned int timeout = CMDMESSENGER_DEFAULT_TIMEOUT)
+	bool sendCmd(uint16_t cmdId, T arg, bool reqAc = false, byte ackCmdId = 1,
+		unsigned int timeout = CMDMESSENGER_ADAPTIVE_TIMEOUT)
 	{
 		if (!startCommand) {
 			sendCmdStart(cmdId);
@@ -214,8 +725,8 @@ public:
 	 * Note that the argument is sent in binary format
 	 */
 	template < class T >
-	bool sendBinCmd(byte cmdId, T arg, bool reqAc = false, byte ackCmdId = 1,
-		unsigned int timeout = CMDMESSENGER_DEFAULT_TIMEOUT)
+	bool sendBinCmd(uint16_t cmdId, T arg, bool reqAc = false, byte ackCmdId = 1,
+		unsigned int timeout = CMDMESSENGER_ADAPTIVE_TIMEOUT)
 	{
 		if (!startCommand) {
 			sendCmdStart(cmdId);
@@ -225,14 +736,26 @@ public:
 		return false;
 	}
 
-	bool sendCmd(byte cmdId);
-	bool sendCmd(byte cmdId, bool reqAc, byte ackCmdId);
+	bool sendCmd(uint16_t cmdId);
+	bool sendCmd(uint16_t cmdId, bool reqAc, byte ackCmdId);
 	// **** Command sending with multiple arguments ****
 
-	void sendCmdStart(byte cmdId);
+	void sendCmdStart(uint16_t cmdId);
 	void sendCmdEscArg(char *arg);
 	void sendCmdfArg(const char * const fmt, ...);
-	bool sendCmdEnd(bool reqAc = false, byte ackCmdId = 1, unsigned int timeout = CMDMESSENGER_DEFAULT_TIMEOUT);
+	bool sendCmdEnd(bool reqAc = false, byte ackCmdId = 1, unsigned int timeout = CMDMESSENGER_ADAPTIVE_TIMEOUT);
+#if CMDMESSENGER_MAXPENDINGACKS != 0
+	CmdAckHandle sendCmdEndAsync(byte ackCmdId = 1, unsigned int timeout = CMDMESSENGER_ADAPTIVE_TIMEOUT,
+		messengerAckCallbackFunction callback = NULL);
+#endif
+
+	// **** Command sending in batches ****
+
+	void setBatchCommandId(uint16_t cmdId);
+#if CMDMESSENGER_BATCHBUFFERSIZE != 0
+	void beginBatch();
+	bool endBatch();
+#endif
 
 	/**
 	 * Send a single argument as string
@@ -241,8 +764,8 @@ public:
 	template < class T > void sendCmdArg(T arg)
 	{
 		if (startCommand) {
-			comms->print(field_separator);
-			comms->print(arg);
+			out->print(field_separator);
+			out->print(arg);
 		}
 	}
 
@@ -253,8 +776,8 @@ public:
 	template < class T > void sendCmdArg(T arg, unsigned int n)
 	{
 		if (startCommand) {
-			comms->print(field_separator);
-			comms->print(arg, n);
+			out->print(field_separator);
+			out->print(arg, n);
 		}
 	}
 
@@ -272,11 +795,31 @@ public:
 	template < class T > void sendCmdBinArg(T arg)
 	{
 		if (startCommand) {
-			comms->print(field_separator);
+			out->print(field_separator);
 			writeBin(arg);
 		}
 	}
 
+	/**
+	 * Send a telemetry frame: the channel values as zigzag varint deltas
+	 *  against the previous frame, or as a keyframe. See CmdTelemetry
+	 *  Note that this will only succeed if a sendCmdStart has been issued first
+	 */
+	void sendCmdTelemetryArg(CmdTelemetry & telemetry, const int32_t *values);
+
+	/**
+	 * Send a single integer argument as varint: 1 byte up to 63, 2 bytes up to 8191, etc.
+	 *  Signed types are zigzag encoded. The bytes are escaped like binary arguments
+	 *  Note that this will only succeed if a sendCmdStart has been issued first
+	 */
+	template < class T > void sendCmdVarintArg(T arg)
+	{
+		if (startCommand) {
+			out->print(field_separator);
+			writeVarint(zigzag< T, typename CmdVarint < sizeof(T) >::Word >(arg));
+		}
+	}
+
 	// **** Command receiving ****
 	bool readBoolArg();
 	int16_t readInt16Arg();
@@ -287,6 +830,8 @@ public:
 	char *readStringArg();
 	void copyStringArg(char *string, uint8_t size);
 	uint8_t compareStringArg(char *string);
+	bool readTelemetryArg(CmdTelemetry & telemetry, int32_t *values);
+	bool readTypedArgs(uint32_t kinds, CmdArgValue *values);
 
 	/**
 	 * Read an argument of any type in binary format
@@ -302,6 +847,24 @@ public:
 		}
 	}
 
+	/**
+	 * Read an integer argument of any size sent with sendCmdVarintArg
+	 */
+	template < class T > T readVarintArg()
+	{
+		typedef typename CmdVarint < sizeof(T) >::Word Word;
+		if (next()) {
+			Word word;
+			const char *str = current;
+			dumped = true;
+			unescape(current);
+			ArgOk = readVarint(&str, bufferEnd, &word);
+			return ArgOk ? unzigzag< T, Word >(word) : 0;
+		}
+		ArgOk = false;
+		return 0;
+	}
+
 	// **** Escaping tools ****
 
 	void unescape(char *fromChar);
@@ -309,3 +872,163 @@ public:
 
 
 };
+
+// **** Typed handlers ****
+
+/**
+ * Gives the kind of a command argument of type T, and takes the value of that type
+ *  from what was read
+ */
+template<class T> struct CmdArgReader
+{
+	static_assert(sizeof(T) == 0, "Typed handlers take bool, char, integers of up to 32 bits, float, double and char * arguments. Take a 64 bit integer as char * and convert it");
+};
+
+template<> struct CmdArgReader<bool>
+{
+	enum { kind = kArgBool };
+	static bool get(const CmdArgValue &value) { return value.boolValue; }
+};
+
+template<> struct CmdArgReader<char>
+{
+	enum { kind = kArgChar };
+	static char get(const CmdArgValue &value) { return value.charValue; }
+};
+
+template<> struct CmdArgReader<signed char>
+{
+	enum { kind = kArgInt16 };
+	static signed char get(const CmdArgValue &value) { return value.int16Value; }
+};
+
+template<> struct CmdArgReader<unsigned char>
+{
+	enum { kind = kArgInt16 };
+	static unsigned char get(const CmdArgValue &value) { return value.int16Value; }
+};
+
+template<> struct CmdArgReader<short>
+{
+	enum { kind = kArgInt16 };
+	static short get(const CmdArgValue &value) { return value.int16Value; }
+};
+
+template<> struct CmdArgReader<unsigned short>
+{
+	enum { kind = kArgUInt32 };
+	static unsigned short get(const CmdArgValue &value) { return value.uint32Value; }
+};
+
+template<> struct CmdArgReader<int>
+{
+	enum { kind = sizeof(int) == 2 ? kArgInt16 : kArgInt32 };
+	static int get(const CmdArgValue &value) { return sizeof(int) == 2 ? value.int16Value : value.int32Value; }
+};
+
+template<> struct CmdArgReader<unsigned int>
+{
+	enum { kind = kArgUInt32 };
+	static unsigned int get(const CmdArgValue &value) { return value.uint32Value; }
+};
+
+template<> struct CmdArgReader<long>
+{
+	enum { kind = kArgInt32 };
+	static long get(const CmdArgValue &value) { return value.int32Value; }
+};
+
+template<> struct CmdArgReader<unsigned long>
+{
+	enum { kind = kArgUInt32 };
+	static unsigned long get(const CmdArgValue &value) { return value.uint32Value; }
+};
+
+template<> struct CmdArgReader<float>
+{
+	enum { kind = kArgFloat };
+	static float get(const CmdArgValue &value) { return value.floatValue; }
+};
+
+template<> struct CmdArgReader<double>
+{
+	enum { kind = kArgDouble };
+	static double get(const CmdArgValue &value) { return value.doubleValue; }
+};
+
+template<> struct CmdArgReader<char *>
+{
+	enum { kind = kArgString };
+	static char *get(const CmdArgValue &value) { return value.stringValue; }
+};
+
+template<> struct CmdArgReader<const char *>
+{
+	enum { kind = kArgString };
+	static const char *get(const CmdArgValue &value) { return value.stringValue; }
+};
+
+/**
+ * Kinds of the arguments Args, 4 bits each with the first argument lowest
+ */
+template<class... Args> struct CmdArgKinds
+{
+	static const uint32_t value = kArgEnd;
+};
+
+template<class First, class... Rest> struct CmdArgKinds<First, Rest...>
+{
+	static const uint32_t value = (uint32_t)CmdArgReader<First>::kind | (CmdArgKinds<Rest...>::value << 4);
+};
+
+/**
+ * Indices 0 to N - 1, to pass the arguments that were read
+ */
+template<unsigned... I> struct CmdIndices {};
+template<unsigned N, unsigned... I> struct CmdMakeIndices : CmdMakeIndices<N - 1, N - 1, I...> {};
+template<unsigned... I> struct CmdMakeIndices<0, I...> { typedef CmdIndices<I...> Type; };
+
+/**
+ * Calls a function with typed arguments from the received command. All arguments are
+ *  read by readTypedArgs, which is shared by every typed handler, so the code made
+ *  for each function type only passes the values on
+ */
+template<class... Args>
+struct CmdTypedHandler
+{
+	static_assert(sizeof...(Args) <= 8, "Typed handlers take up to 8 arguments");
+	typedef void(*Function)(Args...);
+
+	static void call(CmdMessenger &messenger, void *handler)
+	{
+		CmdArgValue values[sizeof...(Args) + 1];
+		if (!messenger.readTypedArgs(CmdArgKinds<Args...>::value, values)) return;
+		pass(reinterpret_cast<Function>(handler), values, typename CmdMakeIndices<sizeof...(Args)>::Type());
+	}
+
+	/**
+	 * Attaches call with the handler as its context. Not inlined, so that attach<Id>
+	 *  passes no more than a plain attach
+	 */
+	__attribute__((noinline)) static void attach(CmdMessenger &messenger, byte msgId, Function handler)
+	{
+		messenger.attach(msgId, &call, reinterpret_cast<void *>(handler));
+	}
+
+private:
+	template<unsigned... I>
+	static void pass(Function handler, const CmdArgValue *values, CmdIndices<I...>)
+	{
+		(*handler)(CmdArgReader<Args>::get(values[I])...);
+	}
+};
+
+/**
+ * Gives the function pointer type of a captureless lambda
+ */
+template<class F> struct CmdLambdaTraits : CmdLambdaTraits<decltype(&F::operator())> {};
+
+template<class C, class... Args> struct CmdLambdaTraits<void(C::*)(Args...) const>
+{
+	typedef void(*Function)(Args...);
+};
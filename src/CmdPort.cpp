@@ -0,0 +1,69 @@
+/*
+  CmdMessenger - library that provides command based messaging
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+  LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+  OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+  WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+  */
+
+#include <CmdPort.h>
+
+/**
+ * CmdPort constructor. At most budget bytes are read from the stream per turn
+ */
+CmdPort::CmdPort(Stream &stream, uint16_t budget)
+{
+	this->stream = &stream;
+	this->budget = (budget > 0) ? budget : 1;
+	bufferIndex = 0;
+	lastChar = '\0';
+	idState = kIdLeading;
+	idValue = 0;
+	idEnd = 0;
+	nameHash = cmdNameHash("");
+	forwardTarget = NULL;
+	deferTarget = NULL;
+	deferComplete = false;
+	sendQueue = NULL;
+}
+
+/**
+ * Sets the number of bytes read from the stream per turn
+ */
+void CmdPort::setBudget(uint16_t bytes)
+{
+	budget = (bytes > 0) ? bytes : 1;
+}
+
+/**
+ * Attaches a queue for the commands sent on this port, see CmdMessenger::attachSendQueue.
+ *  Attach before the ports are attached to the messenger
+ */
+void CmdPort::attachSendQueue(CmdSendQueue *queue)
+{
+	sendQueue = queue;
+}
+
+/**
+ * Returns the stream of the port
+ */
+Stream &CmdPort::getStream()
+{
+	return *stream;
+}
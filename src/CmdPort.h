@@ -0,0 +1,67 @@
+/*
+  CmdMessenger - library that provides command based messaging
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+  LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+  OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+  WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+  */
+
+#pragma once
+
+#include <CmdMessenger.h>
+
+#ifndef CMDPORT_BUDGET
+#define CMDPORT_BUDGET                   64   // Bytes read from a port per turn (default: 64)
+#endif
+
+/**
+ * Stream of a messenger that serves several streams, see CmdMessenger::attachPorts.
+ *
+ * Holds what the port needs between turns: the command that is partly received,
+ * and how far its ID has been decoded. The handlers and the stream buffer are
+ * those of the messenger, so a port costs a command buffer instead of a messenger.
+ * Each port can have a send queue of its own, so that commands queued for one port
+ * wait for room on that port while other ports take their turns.
+ */
+class CmdPort
+{
+private:
+	Stream *stream;                   // Stream of the port
+	uint16_t budget;                  // Bytes read from the stream per turn
+	char buffer[CMDMESSENGER_MESSENGERBUFFERSIZE]; // Command that is partly received
+	uint8_t bufferIndex;              // Number of bytes in the buffer
+	char lastChar;                    // Bookkeeping of command escape char
+	uint8_t idState;                  // State of the ID of the message coming in
+	uint16_t idValue;                 // ID of the message coming in, so far
+	uint8_t idEnd;                    // Buffer index of the field separator after the ID
+	uint32_t nameHash;                // Hash of the name of the message coming in, so far
+	Stream *forwardTarget;            // Stream the message coming in is forwarded to, or NULL
+	Stream *deferTarget;              // Stream the message in the buffer waits for, or NULL
+	bool deferComplete;               // Indicates if the waiting message is in the buffer in full
+	CmdSendQueue *sendQueue;          // Queue of commands sent on this port, if attached
+
+	friend class CmdMessenger;
+
+public:
+	CmdPort(Stream &stream, uint16_t budget = CMDPORT_BUDGET);
+
+	void setBudget(uint16_t bytes);
+	void attachSendQueue(CmdSendQueue *queue);
+	Stream &getStream();
+};
@@ -0,0 +1,282 @@
+/*
+  CmdMessenger - library that provides command based messaging
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+  LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+  OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+  WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+  */
+
+#include <CmdReliable.h>
+
+/**
+ * CmdReliable constructor. frames must hold window * frameSize bytes
+ */
+CmdReliable::CmdReliable(char *frames, uint8_t *frameLengths, uint8_t window, uint8_t frameSize)
+	: capture(frames, frameSize)
+{
+	this->frames = frames;
+	this->frameLengths = frameLengths;
+	this->window = (window > 127) ? 127 : window;
+	this->frameSize = frameSize;
+	timeout = CMDMESSENGER_ADAPTIVE_TIMEOUT;
+	retransmissions = 0;
+	reset();
+}
+
+/**
+ * Drops all unacknowledged frames and restarts sequence numbering
+ */
+void CmdReliable::reset()
+{
+	first = 0;
+	count = 0;
+	nextSeq = 0;
+	expectedSeq = 0;
+	received = false;
+	synced = false;
+	timing = false;
+}
+
+/**
+ * Sets a fixed time before unacknowledged frames are sent again.
+ *  CMDMESSENGER_ADAPTIVE_TIMEOUT (default) derives it from the measured round trip time
+ */
+void CmdReliable::setTimeout(unsigned int timeout)
+{
+	this->timeout = timeout;
+}
+
+/**
+ * Returns the number of sent frames that have not been acknowledged yet
+ */
+uint8_t CmdReliable::unacknowledged()
+{
+	return count;
+}
+
+/**
+ * Returns the number of frames that have been sent again
+ */
+uint16_t CmdReliable::retransmitCount()
+{
+	return retransmissions;
+}
+
+/**
+ * Indicates if the window is full
+ */
+bool CmdReliable::full()
+{
+	return count >= window;
+}
+
+/**
+ * Returns the target a new command is written to: the first free slot of the window.
+ *  When the window is full, the returned target takes nothing
+ */
+Print *CmdReliable::beginFrame()
+{
+	if (full()) {
+		capture = CmdFrameBuffer(frames, 0);
+	}
+	else {
+		uint8_t slot = (first + count) % window;
+		capture = CmdFrameBuffer(frames + slot * frameSize, frameSize);
+	}
+	return &capture;
+}
+
+/**
+ * Adds the written command to the window and sends it. Returns false if it did not fit
+ */
+bool CmdReliable::endFrame(CmdMessenger &messenger)
+{
+	if (full() || capture.overflowed()) return false;
+
+	uint8_t slot = (first + count) % window;
+	frameLengths[slot] = capture.size();
+	unsigned long now = millis();
+	if (!synced) {
+		// Kept until the receiver confirmed the sequence number of the first frame
+		if (count == 0) {
+			sendSync(messenger, nextSeq, false);
+			timerStart = now;
+		}
+		count++;
+		nextSeq++;
+		return true;
+	}
+	if (count == 0) timerStart = now;
+	if (!timing) {
+		// Time one frame at a time
+		timing = true;
+		timedSeq = nextSeq;
+		timedStart = now;
+	}
+	count++;
+	nextSeq++;
+	transmit(messenger, slot);
+	return true;
+}
+
+/**
+ * Sends the frame in a window slot, with its sequence header, as one write
+ */
+void CmdReliable::transmit(CmdMessenger &messenger, uint8_t slot)
+{
+	// The sequence number of a slot follows from its distance to the oldest frame
+	uint8_t seq = nextSeq - count + (slot + window - first) % window;
+	Stream *comms = messenger.comms;
+	messenger.printCommandId(comms, CMDMESSENGER_RELIABLE_CMDID);
+	comms->print(messenger.field_separator);
+	comms->print(seq);
+	comms->print(messenger.field_separator);
+	comms->write((const uint8_t *)frames + slot * frameSize, frameLengths[slot]);
+	comms->print(messenger.command_separator);
+	if (messenger.print_newlines)
+		comms->println(); // should append BOTH \r\n
+}
+
+/**
+ * Handles a received frame header. Returns true if the frame is next in sequence and must be dispatched
+ */
+bool CmdReliable::receiveFrame(CmdMessenger &messenger, uint8_t seq)
+{
+	int8_t distance = (int8_t)(uint8_t)(seq - expectedSeq);
+	if (!received || distance == 0 || distance >= (int8_t)window || distance < -(int8_t)window) {
+		// Next in sequence, or too far off to be part of the window: the sender restarted
+		expectedSeq = seq + 1;
+		received = true;
+		sendAck(messenger, seq);
+		return true;
+	}
+	// A duplicate, or a frame after a lost one: repeat the last acknowledge
+	sendAck(messenger, expectedSeq - 1);
+	return false;
+}
+
+/**
+ * Removes acknowledged frames from the window. Acknowledges are cumulative
+ */
+void CmdReliable::receiveAck(CmdMessenger &messenger, uint8_t seq)
+{
+	// Acknowledges from before a restart do not count for the new frames
+	if (!synced) return;
+	uint8_t oldestSeq = nextSeq - count;
+	uint8_t acknowledged = (uint8_t)(seq - oldestSeq) + 1;
+	// Old or unknown sequence number. 0 repeats the acknowledge of the frame before the oldest
+	if (acknowledged == 0 || acknowledged > count) return;
+
+	unsigned long now = millis();
+	if (timing && (uint8_t)(timedSeq - oldestSeq) < acknowledged) {
+		messenger.rtt.sample(now - timedStart);
+		timing = false;
+	}
+	// New data got through: a time out doubled by earlier resends no longer applies
+	messenger.rtt.resetBackoff();
+	first = (first + acknowledged) % window;
+	count -= acknowledged;
+	timerStart = now;
+}
+
+/**
+ * Handles a sync. A request sets the sequence number of the next frame to dispatch,
+ *  and is confirmed; a confirmation lets the sender send its window
+ */
+void CmdReliable::receiveSync(CmdMessenger &messenger, uint8_t seq, bool reply)
+{
+	if (!reply) {
+		expectedSeq = seq;
+		received = true;
+		sendSync(messenger, seq, true);
+		return;
+	}
+	if (synced || count == 0 || seq != (uint8_t)(nextSeq - count)) return;
+	synced = true;
+	unsigned long now = millis();
+	for (uint8_t i = 0; i < count; i++)
+		transmit(messenger, (first + i) % window);
+	timing = true;
+	timedSeq = seq;
+	timedStart = now;
+	timerStart = now;
+}
+
+/**
+ * Sends a cumulative acknowledge. It goes to the stream directly, also while a batch is collected
+ */
+void CmdReliable::sendAck(CmdMessenger &messenger, uint8_t seq)
+{
+	Stream *comms = messenger.comms;
+	messenger.printCommandId(comms, CMDMESSENGER_RELIABLE_ACK_CMDID);
+	comms->print(messenger.field_separator);
+	comms->print(seq);
+	comms->print(messenger.command_separator);
+	if (messenger.print_newlines)
+		comms->println(); // should append BOTH \r\n
+}
+
+/**
+ * Sends a sync request or confirmation. Like acknowledges, it goes to the stream directly
+ */
+void CmdReliable::sendSync(CmdMessenger &messenger, uint8_t seq, bool reply)
+{
+	Stream *comms = messenger.comms;
+	messenger.printCommandId(comms, CMDMESSENGER_RELIABLE_SYNC_CMDID);
+	comms->print(messenger.field_separator);
+	comms->print(seq);
+	if (reply) {
+		comms->print(messenger.field_separator);
+		comms->print('1');
+	}
+	comms->print(messenger.command_separator);
+	if (messenger.print_newlines)
+		comms->println(); // should append BOTH \r\n
+}
+
+/**
+ * Returns the time an unacknowledged frame waits before the window is sent again
+ */
+unsigned int CmdReliable::resendTimeout(CmdMessenger &messenger)
+{
+	return (timeout == CMDMESSENGER_ADAPTIVE_TIMEOUT) ? messenger.rtt.timeout() : timeout;
+}
+
+/**
+ * Sends the whole window again if the oldest frame was not acknowledged in time.
+ *  Before the receiver confirmed the first sequence number, sends the sync again instead
+ */
+void CmdReliable::poll(CmdMessenger &messenger)
+{
+	if (count == 0 || millis() - timerStart < resendTimeout(messenger)) return;
+	if (!synced) {
+		sendSync(messenger, nextSeq - count, false);
+		messenger.rtt.backoff();
+		timerStart = millis();
+		return;
+	}
+	for (uint8_t i = 0; i < count; i++) {
+		transmit(messenger, (first + i) % window);
+		retransmissions++;
+	}
+	// A frame that is sent twice gives no usable round trip sample
+	timing = false;
+	messenger.rtt.backoff();
+	timerStart = millis();
+}
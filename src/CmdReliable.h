@@ -0,0 +1,115 @@
+/*
+  CmdMessenger - library that provides command based messaging
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+  LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+  OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+  WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+  */
+
+#pragma once
+
+#include <CmdMessenger.h>
+
+#ifndef CMDRELIABLE_FRAMESIZE
+#define CMDRELIABLE_FRAMESIZE            (CMDMESSENGER_MESSENGERBUFFERSIZE - 10) // Room for the sequence header
+#endif
+
+/**
+ * Sliding window reliable delivery on top of a CmdMessenger.
+ *
+ * While attached with CmdMessenger::attachReliable, every command sent with
+ * sendCmdStart / sendCmdEnd is kept in the window and sent as
+ *   CMDMESSENGER_RELIABLE_CMDID, seq, cmdId, args...;
+ * The receiver dispatches frames in sequence order and answers with a
+ * cumulative acknowledge of the last in-order sequence number
+ *   CMDMESSENGER_RELIABLE_ACK_CMDID, seq;
+ * Acknowledged frames leave the window. When the oldest frame is not
+ * acknowledged in time, all frames in the window are sent again (go-back-N).
+ * The time out follows the round trip time measured by the messenger, and
+ * backs off on every resend.
+ * Out of order frames are dropped by the receiver and cause it to repeat its
+ * last acknowledge.
+ * After a reset, or a restart of the sender, the first sequence number is
+ * announced before any frame is sent, and sent again until the receiver
+ * confirms it
+ *   CMDMESSENGER_RELIABLE_SYNC_CMDID, seq;     answered with
+ *   CMDMESSENGER_RELIABLE_SYNC_CMDID, seq, 1;
+ * so that the receiver does not take the new frames for duplicates.
+ *
+ * Both ends attach a CmdReliable with the same window size.
+ */
+class CmdReliable
+{
+private:
+	char *frames;                     // Storage of window frames, frameSize bytes each
+	uint8_t *frameLengths;            // Length of each stored frame
+	uint8_t window;                   // Number of frames that can be unacknowledged
+	uint8_t frameSize;                // Maximum length of a frame
+	uint8_t first;                    // Slot of the oldest unacknowledged frame
+	uint8_t count;                    // Number of unacknowledged frames
+	uint8_t nextSeq;                  // Sequence number of the next sent frame
+	uint8_t expectedSeq;              // Sequence number of the next frame to dispatch
+	bool received;                    // Indicates if any frame has been dispatched
+	bool synced;                      // Indicates if the receiver confirmed the first sequence number
+	unsigned int timeout;             // Time before the window is sent again, 0 for adaptive
+	unsigned long timerStart;         // Time the oldest frame was last sent, or last acknowledge
+	bool timing;                      // Indicates if a frame is timed for a round trip sample
+	uint8_t timedSeq;                 // Sequence number of the timed frame
+	unsigned long timedStart;         // Time the timed frame was sent
+	uint16_t retransmissions;         // Number of frames sent again
+	CmdFrameBuffer capture;           // Collects the command being sent
+
+	Print *beginFrame();
+	bool endFrame(CmdMessenger & messenger);
+	void transmit(CmdMessenger & messenger, uint8_t slot);
+	bool receiveFrame(CmdMessenger & messenger, uint8_t seq);
+	void receiveAck(CmdMessenger & messenger, uint8_t seq);
+	void receiveSync(CmdMessenger & messenger, uint8_t seq, bool reply);
+	void sendAck(CmdMessenger & messenger, uint8_t seq);
+	void sendSync(CmdMessenger & messenger, uint8_t seq, bool reply);
+	void poll(CmdMessenger & messenger);
+	unsigned int resendTimeout(CmdMessenger & messenger);
+	bool full();
+
+	friend class CmdMessenger;
+
+public:
+	CmdReliable(char *frames, uint8_t *frameLengths, uint8_t window, uint8_t frameSize);
+
+	void reset();
+	void setTimeout(unsigned int timeout);
+	uint8_t unacknowledged();
+	uint16_t retransmitCount();
+};
+
+/**
+ * Reliable delivery layer that holds its own window of frames
+ */
+template < uint8_t Window, uint8_t FrameSize = CMDRELIABLE_FRAMESIZE >
+class CmdReliableWindow : public CmdReliable
+{
+private:
+	char frameData[Window * FrameSize];
+	uint8_t lengths[Window];
+
+public:
+	CmdReliableWindow() : CmdReliable(frameData, lengths, Window, FrameSize)
+	{
+	}
+};
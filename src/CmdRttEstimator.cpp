@@ -0,0 +1,111 @@
+/*
+  CmdMessenger - library that provides command based messaging
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+  LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+  OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+  WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+  */
+
+#include <CmdRttEstimator.h>
+
+/**
+ * CmdRttEstimator constructor
+ */
+CmdRttEstimator::CmdRttEstimator()
+{
+	reset();
+}
+
+/**
+ * Forgets all samples
+ */
+void CmdRttEstimator::reset()
+{
+	srtt8 = 0;
+	rttvar4 = 0;
+	backoffShift = 0;
+	measured = false;
+}
+
+/**
+ * Adds a measured round trip time in ms
+ */
+void CmdRttEstimator::sample(unsigned long rtt)
+{
+	if (rtt > CMDMESSENGER_DEFAULT_TIMEOUT) rtt = CMDMESSENGER_DEFAULT_TIMEOUT;
+	if (!measured) {
+		srtt8 = rtt << 3;
+		rttvar4 = rtt << 1;
+		measured = true;
+	}
+	else {
+		// srtt += (rtt - srtt) / 8, rttvar += (|rtt - srtt| - rttvar) / 4
+		long error = (long)rtt - (long)(srtt8 >> 3);
+		srtt8 += error;
+		if (error < 0) error = -error;
+		rttvar4 += error - (long)(rttvar4 >> 2);
+	}
+	backoffShift = 0;
+}
+
+/**
+ * Doubles the time out, after it expired
+ */
+void CmdRttEstimator::backoff()
+{
+	if (timeout() < CMDMESSENGER_DEFAULT_TIMEOUT) backoffShift++;
+}
+
+/**
+ * Undoes the doubling of the time out. Call when an acknowledge covers data that was
+ *  not acknowledged before: while frames keep being sent again, no sample can reset it
+ */
+void CmdRttEstimator::resetBackoff()
+{
+	backoffShift = 0;
+}
+
+/**
+ * Returns the time out in ms to wait for an acknowledge
+ */
+unsigned int CmdRttEstimator::timeout()
+{
+	if (!measured) return CMDMESSENGER_DEFAULT_TIMEOUT;
+	uint32_t rto = (srtt8 >> 3) + rttvar4;
+	if (rto < CMDMESSENGER_MIN_TIMEOUT) rto = CMDMESSENGER_MIN_TIMEOUT;
+	rto <<= backoffShift;
+	if (rto > CMDMESSENGER_DEFAULT_TIMEOUT) rto = CMDMESSENGER_DEFAULT_TIMEOUT;
+	return rto;
+}
+
+/**
+ * Returns the smoothed round trip time in ms
+ */
+unsigned int CmdRttEstimator::smoothed()
+{
+	return srtt8 >> 3;
+}
+
+/**
+ * Returns the mean deviation of the round trip time in ms
+ */
+unsigned int CmdRttEstimator::variance()
+{
+	return rttvar4 >> 2;
+}
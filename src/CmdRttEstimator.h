@@ -0,0 +1,71 @@
+/*
+  CmdMessenger - library that provides command based messaging
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+  LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+  OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+  WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+  */
+
+#pragma once
+
+#include <inttypes.h>
+#if ARDUINO >= 100
+#include <Arduino.h> 
+#else
+#include <WProgram.h> 
+#endif
+
+#ifndef CMDMESSENGER_DEFAULT_TIMEOUT
+#define CMDMESSENGER_DEFAULT_TIMEOUT     5000 // Time out on unanswered messages. (default: 5s)
+#endif
+#ifndef CMDMESSENGER_MIN_TIMEOUT
+#define CMDMESSENGER_MIN_TIMEOUT         50   // Lower bound of the adaptive time out (default: 50 ms)
+#endif
+
+/**
+ * Round trip time estimator, after RFC 6298 (Jacobson / Karels).
+ *
+ * Keeps a smoothed round trip time and its mean deviation, and derives a
+ * time out of srtt + 4 * rttvar. The time out doubles with every expiry and
+ * is reset by the next sample, or by resetBackoff when new data is
+ * acknowledged (RFC 6298, section 5). It starts at, and never exceeds,
+ * CMDMESSENGER_DEFAULT_TIMEOUT.
+ * Samples of commands that were sent more than once must not be fed in, as
+ * it is unknown which transmission was acknowledged (Karn's algorithm).
+ */
+class CmdRttEstimator
+{
+private:
+	uint32_t srtt8;                   // Smoothed round trip time in ms, times 8
+	uint32_t rttvar4;                 // Mean deviation in ms, times 4
+	uint8_t backoffShift;             // Number of expiries since the last sample
+	bool measured;                    // Indicates if a sample has come in
+
+public:
+	CmdRttEstimator();
+
+	void reset();
+	void sample(unsigned long rtt);
+	void backoff();
+	void resetBackoff();
+
+	unsigned int timeout();
+	unsigned int smoothed();
+	unsigned int variance();
+};
@@ -0,0 +1,242 @@
+/*
+  CmdMessenger - library that provides command based messaging
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+  LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+  OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+  WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+  */
+
+#include <CmdSendQueue.h>
+
+// Not every core declares Print::availableForWrite
+#if ARDUINO >= 10800
+#define CMDSENDQUEUE_ROOM(stream) ((stream).availableForWrite())
+#else
+#define CMDSENDQUEUE_ROOM(stream) 0
+#endif
+
+/**
+ * CmdSendQueue constructor. frames must hold capacity * frameSize bytes
+ */
+CmdSendQueue::CmdSendQueue(char *frames, CmdSendSlot *slots, uint8_t capacity, uint8_t frameSize)
+	: capture(frames, 0)
+{
+	this->frames = frames;
+	this->slots = slots;
+	this->capacity = (capacity > 0) ? capacity : 1;
+	this->frameSize = frameSize;
+	roomReported = false;
+	collapsed = 0;
+	dropped = 0;
+	expired = 0;
+	timeToLive = 0;
+#if CMDMESSENGER_MAXCALLBACKS != 0
+	for (uint8_t i = 0; i < sizeof(collapsible); i++)
+		collapsible[i] = 0;
+#endif
+	reset();
+}
+
+/**
+ * Drops all queued frames
+ */
+void CmdSendQueue::reset()
+{
+	first = 0;
+	count = 0;
+	written = 0;
+}
+
+/**
+ * Marks a command ID as collapsible: a newer command with this ID replaces a queued one.
+ *  Only IDs below CMDMESSENGER_MAXCALLBACKS can be collapsible
+ */
+void CmdSendQueue::setCollapsible(byte id, bool collapse)
+{
+#if CMDMESSENGER_MAXCALLBACKS != 0
+	if (id >= CMDMESSENGER_MAXCALLBACKS) return;
+	if (collapse) collapsible[id >> 3] |= (1 << (id & 7));
+	else collapsible[id >> 3] &= ~(1 << (id & 7));
+#endif
+}
+
+/**
+ * Sets the time in ms that frames queued from now on may wait before they are
+ *  dropped instead of written. 0 lets them wait indefinitely
+ */
+void CmdSendQueue::setTimeToLive(uint16_t ms)
+{
+	timeToLive = ms;
+}
+
+/**
+ * Returns if a command ID is collapsible
+ */
+bool CmdSendQueue::isCollapsible(uint16_t id)
+{
+#if CMDMESSENGER_MAXCALLBACKS != 0
+	return id < CMDMESSENGER_MAXCALLBACKS && (collapsible[id >> 3] & (1 << (id & 7)));
+#else
+	return false;
+#endif
+}
+
+/**
+ * Returns the number of frames that have not been written completely
+ */
+uint8_t CmdSendQueue::pending()
+{
+	return count;
+}
+
+/**
+ * Returns the number of frames that were replaced by a newer frame with the same ID
+ */
+uint16_t CmdSendQueue::collapsedCount()
+{
+	return collapsed;
+}
+
+/**
+ * Returns the number of frames dropped because they did not fit in a slot
+ */
+uint16_t CmdSendQueue::droppedCount()
+{
+	return dropped;
+}
+
+/**
+ * Returns the number of frames dropped because they waited past their time to live
+ */
+uint16_t CmdSendQueue::expiredCount()
+{
+	return expired;
+}
+
+/**
+ * Returns if the frame in a slot waited past its time to live
+ */
+bool CmdSendQueue::isExpired(uint8_t slot, unsigned long now)
+{
+	return slots[slot].timeToLive != 0 && now - slots[slot].queuedAt > slots[slot].timeToLive;
+}
+
+/**
+ * Removes the frames that waited past their time to live, keeping the order of the others.
+ *  A partly written oldest frame is kept, as dropping it would corrupt the stream
+ */
+void CmdSendQueue::dropExpired()
+{
+	unsigned long now = millis();
+	uint8_t kept = (written > 0) ? 1 : 0;
+	for (uint8_t i = kept; i < count; i++) {
+		uint8_t queued = (first + i) % capacity;
+		if (isExpired(queued, now)) {
+			expired++;
+			continue;
+		}
+		uint8_t slot = (first + kept) % capacity;
+		if (slot != queued) {
+			memcpy(frame(slot), frame(queued), slots[queued].length);
+			slots[slot] = slots[queued];
+		}
+		kept++;
+	}
+	count = kept;
+}
+
+/**
+ * Returns the target a new command is written to: the first free slot.
+ *  When the queue is full, the oldest frame is written out first
+ */
+Print *CmdSendQueue::beginFrame(Stream &comms, uint16_t id)
+{
+	if (count >= capacity) dropExpired();
+	if (count >= capacity) {
+		while (!writeOldest(comms, 0xFFFF));
+	}
+	uint8_t slot = (first + count) % capacity;
+	capture = CmdFrameBuffer(frame(slot), frameSize);
+	frameId = id;
+	return &capture;
+}
+
+/**
+ * Queues the captured frame, or replaces the queued frame with the same collapsible ID.
+ *  Returns false if the frame did not fit in a slot
+ */
+bool CmdSendQueue::endFrame()
+{
+	if (capture.overflowed()) {
+		dropped++;
+		return false;
+	}
+	uint8_t slot = (first + count) % capacity;
+	if (isCollapsible(frameId)) {
+		// The oldest frame can not be replaced once it is partly written
+		for (uint8_t i = (written > 0) ? 1 : 0; i < count; i++) {
+			uint8_t queued = (first + i) % capacity;
+			if (slots[queued].id == frameId) {
+				memcpy(frame(queued), frame(slot), capture.size());
+				slots[queued].length = capture.size();
+				slots[queued].timeToLive = timeToLive;
+				slots[queued].queuedAt = millis();
+				collapsed++;
+				return true;
+			}
+		}
+	}
+	slots[slot].id = frameId;
+	slots[slot].length = capture.size();
+	slots[slot].timeToLive = timeToLive;
+	slots[slot].queuedAt = millis();
+	count++;
+	return true;
+}
+
+/**
+ * Drops expired frames, then writes queued frames as far as the stream has room.
+ *  With all, or when the stream never reports room, writes every frame
+ */
+void CmdSendQueue::drain(Stream &comms, bool all)
+{
+	dropExpired();
+	while (count > 0) {
+		int room = CMDSENDQUEUE_ROOM(comms);
+		if (room > 0) roomReported = true;
+		if (all || !roomReported) room = 0xFFFF;
+		if (room <= 0 || !writeOldest(comms, room)) return;
+	}
+}
+
+/**
+ * Writes up to room bytes of the oldest frame. Returns true when the frame is written completely
+ */
+bool CmdSendQueue::writeOldest(Stream &comms, uint16_t room)
+{
+	uint8_t length = slots[first].length - written;
+	if (length > room) length = room;
+	comms.write((const uint8_t *)frame(first) + written, length);
+	written += length;
+	if (written < slots[first].length) return false;
+	written = 0;
+	first = (first + 1) % capacity;
+	count--;
+	return true;
+}
@@ -0,0 +1,118 @@
+/*
+  CmdMessenger - library that provides command based messaging
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+  LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+  OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+  WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+  */
+
+#pragma once
+
+#include <CmdMessenger.h>
+
+#ifndef CMDSENDQUEUE_FRAMESIZE
+#define CMDSENDQUEUE_FRAMESIZE           CMDMESSENGER_MESSENGERBUFFERSIZE // Longest command the receiver takes
+#endif
+
+/**
+ * Bookkeeping of a command waiting in a CmdSendQueue
+ */
+struct CmdSendSlot
+{
+	uint16_t id;                      // Command ID
+	uint8_t length;                   // Length of the frame, separators included
+	uint16_t timeToLive;              // Time in ms the frame may wait, 0 when it never expires
+	unsigned long queuedAt;           // Time the frame was queued
+};
+
+/**
+ * Queue of sent commands that go out as the stream has room for them.
+ *
+ * While attached with CmdMessenger::attachSendQueue, sent commands are stored
+ * instead of written. feedinSerialData, and waits for acknowledges, write them
+ * as far as availableForWrite allows, so that sending does not block.
+ * A command ID marked collapsible keeps only its latest value: a new command
+ * with that ID replaces the queued one in place, so the link carries the most
+ * recent value instead of a backlog of old ones.
+ * When the queue is full, the oldest command is written out, blocking, to make room.
+ * Streams that do not report availableForWrite get the queue written in full
+ * on every poll, which still collapses the commands sent between polls.
+ * With setTimeToLive, frames that waited longer than their time to live are
+ * dropped instead of written, so that a slow link sends fresh values rather
+ * than working through stale ones.
+ */
+class CmdSendQueue
+{
+private:
+	char *frames;                     // Storage of queued frames, frameSize bytes each
+	CmdSendSlot *slots;               // Bookkeeping per slot
+	uint8_t capacity;                 // Number of slots
+	uint8_t frameSize;                // Maximum length of a frame
+	uint8_t first;                    // Slot of the oldest queued frame
+	uint8_t count;                    // Number of queued frames
+	uint8_t written;                  // Bytes of the oldest frame already written
+	uint16_t frameId;                 // ID of the command being captured
+	bool roomReported;                // Indicates if the stream ever reported room to write
+	uint16_t collapsed;               // Number of frames replaced by a newer one
+	uint16_t dropped;                 // Number of frames that did not fit in a slot
+	uint16_t expired;                 // Number of frames dropped past their time to live
+	uint16_t timeToLive;              // Time to live given to newly queued frames
+#if CMDMESSENGER_MAXCALLBACKS != 0
+	uint8_t collapsible[(CMDMESSENGER_MAXCALLBACKS + 7) / 8]; // Collapsible flag per command ID
+#endif
+	CmdFrameBuffer capture;           // Collects the command being sent
+
+	Print *beginFrame(Stream & comms, uint16_t id);
+	bool endFrame();
+	void drain(Stream & comms, bool all);
+	bool writeOldest(Stream & comms, uint16_t room);
+	bool isCollapsible(uint16_t id);
+	bool isExpired(uint8_t slot, unsigned long now);
+	void dropExpired();
+	char *frame(uint8_t slot) { return frames + slot * frameSize; }
+
+	friend class CmdMessenger;
+
+public:
+	CmdSendQueue(char *frames, CmdSendSlot *slots, uint8_t capacity, uint8_t frameSize);
+
+	void reset();
+	void setCollapsible(byte id, bool collapse = true);
+	void setTimeToLive(uint16_t ms);
+	uint8_t pending();
+	uint16_t collapsedCount();
+	uint16_t droppedCount();
+	uint16_t expiredCount();
+};
+
+/**
+ * Send queue that holds its own slots
+ */
+template < uint8_t Capacity, uint8_t FrameSize = CMDSENDQUEUE_FRAMESIZE >
+class CmdSendQueueSlots : public CmdSendQueue
+{
+private:
+	char frameData[Capacity * FrameSize];
+	CmdSendSlot slotData[Capacity];
+
+public:
+	CmdSendQueueSlots() : CmdSendQueue(frameData, slotData, Capacity, FrameSize)
+	{
+	}
+};
@@ -0,0 +1,116 @@
+/*
+  CmdMessenger - library that provides command based messaging
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+  LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+  OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+  WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+  */
+
+#include <CmdTelemetry.h>
+
+/**
+ * CmdTelemetry constructor. history must hold channels values
+ */
+CmdTelemetry::CmdTelemetry(int32_t *history, uint8_t channels, uint8_t keyframeInterval)
+{
+	this->history = history;
+	this->channels = (channels > CMDTELEMETRY_MAXCHANNELS) ? CMDTELEMETRY_MAXCHANNELS : channels;
+	this->keyframeInterval = keyframeInterval;
+	reset();
+}
+
+/**
+ * Forces a keyframe as next sent frame, and ignores received frames until a keyframe comes in
+ */
+void CmdTelemetry::reset()
+{
+	framesSinceKeyframe = 0;
+	synced = false;
+}
+
+/**
+ * Returns the number of values per frame
+ */
+uint8_t CmdTelemetry::channelCount()
+{
+	return channels;
+}
+
+/**
+ * Prints a frame as keyframe or as deltas against the previous frame
+ */
+void CmdTelemetry::encode(CmdMessenger &messenger, const int32_t *values)
+{
+	bool keyframe = !synced || (keyframeInterval != 0 && framesSinceKeyframe >= keyframeInterval);
+	if (keyframe) {
+		messenger.writeVarint((uint32_t)1);
+		for (uint8_t i = 0; i < channels; i++) {
+			messenger.writeVarint(CmdMessenger::zigzag< int32_t, uint32_t >(values[i]));
+			history[i] = values[i];
+		}
+		framesSinceKeyframe = 1;
+		synced = true;
+		return;
+	}
+
+	// Header: one bit per changed channel, bit 0 is the keyframe flag
+	uint32_t changed = 0;
+	for (uint8_t i = 0; i < channels; i++) {
+		if (values[i] != history[i]) changed |= (uint32_t)1 << i;
+	}
+	messenger.writeVarint(changed << 1);
+	for (uint8_t i = 0; i < channels; i++) {
+		if (changed & ((uint32_t)1 << i)) {
+			// Wrapping subtraction, the receiver adds it back with the same wrap
+			messenger.writeVarint(CmdMessenger::zigzag< int32_t, uint32_t >((int32_t)((uint32_t)values[i] - (uint32_t)history[i])));
+			history[i] = values[i];
+		}
+	}
+	framesSinceKeyframe++;
+}
+
+/**
+ * Decodes an unescaped frame into values. Delta frames are rejected until a keyframe has been seen
+ */
+bool CmdTelemetry::decode(const char *data, const char *end, int32_t *values)
+{
+	uint32_t header;
+	uint32_t value;
+	if (!CmdMessenger::readVarint(&data, end, &header)) return false;
+
+	bool keyframe = header & 1;
+	if (!keyframe && !synced) return false;
+	uint32_t changed = keyframe ? 0xFFFFFFFF : header >> 1;
+
+	for (uint8_t i = 0; i < channels; i++) {
+		if (changed & ((uint32_t)1 << i)) {
+			if (!CmdMessenger::readVarint(&data, end, &value)) {
+				synced = false;
+				return false;
+			}
+			if (keyframe)
+				history[i] = CmdMessenger::unzigzag< int32_t, uint32_t >(value);
+			else
+				history[i] = (int32_t)((uint32_t)history[i] + (uint32_t)CmdMessenger::unzigzag< int32_t, uint32_t >(value));
+		}
+		values[i] = history[i];
+	}
+	synced = true;
+	return true;
+}
@@ -0,0 +1,82 @@
+/*
+  CmdMessenger - library that provides command based messaging
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+  LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+  OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+  WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+  */
+
+#pragma once
+
+#include <CmdMessenger.h>
+
+#ifndef CMDTELEMETRY_KEYFRAME_INTERVAL
+#define CMDTELEMETRY_KEYFRAME_INTERVAL   32   // Frames between two keyframes      (default: 32)
+#endif
+#define CMDTELEMETRY_MAXCHANNELS         31   // One bit per channel in the frame header
+
+/**
+ * Delta encoder / decoder for streams of slowly changing integer samples.
+ *
+ * Every frame is sent as a single escaped argument. A keyframe holds all
+ * channel values as zigzag varints. Other frames hold a header with a bit
+ * per changed channel, followed by the zigzag varint delta of those channels
+ * against the previous frame, so an unchanged channel costs nothing.
+ * A keyframe is sent every keyframeInterval frames, which lets a receiver
+ * that joins mid-stream or lost a frame resynchronize.
+ *
+ * Sender and receiver each use their own instance with the same channel count.
+ */
+class CmdTelemetry
+{
+private:
+	int32_t *history;                 // Values of the previous frame
+	uint8_t channels;                 // Number of values per frame
+	uint8_t keyframeInterval;         // Frames between keyframes, 0 sends only the first
+	uint8_t framesSinceKeyframe;      // Frames sent since last keyframe
+	bool synced;                      // Indicates if history holds a full frame
+
+	void encode(CmdMessenger & messenger, const int32_t *values);
+	bool decode(const char *data, const char *end, int32_t *values);
+
+	friend class CmdMessenger;
+
+public:
+	CmdTelemetry(int32_t *history, uint8_t channels,
+		uint8_t keyframeInterval = CMDTELEMETRY_KEYFRAME_INTERVAL);
+
+	void reset();
+	uint8_t channelCount();
+};
+
+/**
+ * Telemetry encoder / decoder that holds its own history for a fixed number of channels
+ */
+template < uint8_t Channels >
+class CmdTelemetryChannels : public CmdTelemetry
+{
+private:
+	int32_t values[Channels];
+
+public:
+	CmdTelemetryChannels(uint8_t keyframeInterval = CMDTELEMETRY_KEYFRAME_INTERVAL)
+		: CmdTelemetry(values, Channels, keyframeInterval)
+	{
+	}
+};